@@ -3,16 +3,28 @@
  *
  * A meeting scheduler with a web interface, allowing users to schedule meetings
  * and reservations over four weeks (Monday–Thursday, 9:00–16:30, with a 12:00–13:00 break).
+ * The calendar can be changed at startup (see Run below).
  * Users can add meetings, reserve time slots, view schedules, export to ICS (calendar format),
  * and clear the schedule via a web browser at http://localhost:8888.
  *
  * Compile with:
- *     gcc cweb.c -o cweb -lmicrohttpd
+ *     gcc cweb.c -o cweb -lmicrohttpd -lpthread -lz
+ * or, to have --bench count allocations too:
+ *     gcc -DCOUNT_ALLOCATIONS cweb.c -o cweb -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc -lmicrohttpd -lpthread -lz
  *
  * Run:
  *     ./cweb
+ *     ./cweb --weeks 13 --days 5 --slot-minutes 15 --hours 08:00-18:00 --break 12:30-13:30
+ *     ./cweb --data-dir data      (keep the schedules in ./data across restarts)
+ *     ./cweb --bench all          (measure instead of serving, see BENCHMARKS)
+ *     ./cweb --port 80 --max-connections 20000 --connection-timeout 120
+ *                                 (see SERVER OPTIONS)
+ * Stop it with Ctrl+C (or SIGTERM): requests in progress are finished first.
  *
- * Open http://localhost:8888 in your browser to use it.
+ * Open http://localhost:8888 in your browser to use it. Teams that want their own schedule
+ * use http://localhost:8888/u/<team>/ instead (or send a "session" cookie naming the team).
+ * Programs can use the JSON API under /api/ instead (see JSON API).
+ * Counters and latencies for monitoring are at http://localhost:8888/metrics (see METRICS).
  *
  * This version includes a fix for fortnightly meetings (they now occur every two weeks,
  * e.g., Week 1 and Week 3) and detailed comments for beginners learning C.
@@ -20,728 +32,6520 @@
 
  #include <microhttpd.h>  // Library for creating a web server
  #include <stdio.h>       // For printing and file operations
- #include <stdlib.h>      // For memory allocation (malloc) and random numbers (rand)
+ #include <stdlib.h>      // For memory allocation (malloc)
  #include <string.h>      // For string operations (strcmp, strcpy)
  #include <stdbool.h>     // For true/false values
+ #include <stdint.h>      // For fixed-size integers (uint16_t)
+ #include <limits.h>      // For the largest values of integer types (LLONG_MAX)
  #include <time.h>        // For seeding random numbers and date handling
+ #include <stdarg.h>      // For functions taking a variable number of arguments (like printf)
+ #include <pthread.h>     // For locks shared between server threads
+ #include <stdatomic.h>   // For counters that many threads can update safely
+ #include <zlib.h>        // For gzip compression of pages
+ #include <errno.h>       // For error codes of system calls
+ #include <fcntl.h>       // For opening files (open)
+ #include <unistd.h>      // For writing, syncing and closing files
+ #include <sys/mman.h>    // For mapping files into memory (mmap)
+ #include <sys/stat.h>    // For file sizes and creating directories
+ #include <sys/socket.h>  // For the benchmark's HTTP clients (socket, connect)
+ #include <netinet/in.h>  // For IPv4 addresses
+ #include <netinet/tcp.h> // For TCP_NODELAY
+ #include <arpa/inet.h>   // For htons (port numbers in network byte order)
+ #include <signal.h>      // For stopping cleanly on SIGINT / SIGTERM
+ #include <sys/resource.h> // For raising the limit on open files (one per connection)
+ #include <sys/select.h>  // For FD_SETSIZE (the most connections select can watch)
  
  // Define the port where the web server will listen (like a radio frequency for web requests)
  #define PORT 8888
+ #define THREAD_POOL_SIZE 4 // Number of threads answering requests at the same time
+ // (both can be changed at startup, see SERVER OPTIONS)
  
  // -------------------------
  // SCHEDULER DATA AND SETUP
  // -------------------------
  
  // Constants to set limits and options
- #define MAX_DAYS 4         // We only schedule Monday to Thursday
- #define MAX_WEEKS 4        // Schedule covers 4 weeks
- #define MAX_SLOTS 14       // 14 time slots per day (30-min intervals, 9:00–16:30, excluding break)
- #define MAX_MEETINGS 100   // Max number of scheduled meetings
  #define MAX_RESERVATIONS 50 // Max number of reserved time slots
  #define MAX_STR 64         // Max length for strings (e.g., meeting names)
+ #define MAX_HORIZON_WEEKS 104 // Longest plan (two years)
+ #define MAX_WEEK_DAYS 7    // Longest working week (Monday to Sunday)
+ #define MAX_DAY_SLOTS 64   // Most time slots in one day (one bit each in a SlotMask)
+ #define MAX_ATTENDEES 64   // Most named attendees in one schedule (one bit each in an AttendeeSet)
+ #define MAX_MEETING_ATTENDEES 16 // Most attendees of one meeting
+ #define MAX_BREAKS 4       // Most breaks in one day
+ #define MIN_SLOT_MINUTES 5 // Shortest time slot
+ #define MAX_MEETING_MINUTES 90 // Longest meeting or reservation
+ #define MAX_DURATION (MAX_MEETING_MINUTES / MIN_SLOT_MINUTES) // Longest meeting in slots, for any slot length
  
- // Lists of valid days, times, and options
- const char *DAYS[MAX_DAYS] = {"Monday", "Tuesday", "Wednesday", "Thursday"};
- const char *TIME_SLOTS[MAX_SLOTS] = {
-     "09:00", "09:30", "10:00", "10:30", "11:00", "11:30",
-     "13:00", "13:30", "14:00", "14:30", "15:00", "15:30",
-     "16:00", "16:30"
- };
- const char *BREAK_SLOTS[2] = {"12:00", "12:30"}; // Times reserved for lunch break
+ // Lists of valid days and options
+ const char *DAYS[MAX_WEEK_DAYS] = {"Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday", "Sunday"};
  const char *FREQUENCIES[4] = {"weekly", "fortnightly", "third_week", "monthly"};
- const int DURATIONS[3] = {1, 2, 3}; // Duration in 30-min slots: 1=30 min, 2=60 min, 3=90 min
+ 
+ // How often a meeting repeats (index into FREQUENCIES)
+ typedef enum { FREQ_WEEKLY, FREQ_FORTNIGHTLY, FREQ_THIRD_WEEK, FREQ_MONTHLY, FREQ_COUNT } Frequency;
+ // A meeting meets every FREQ_PERIOD weeks. Its "phase" is the first week it meets in
+ // (0 to period - 1): a fortnightly meeting with phase 1 meets in weeks 2, 4, 6, ...
+ // Third_week meets once every four weeks, like monthly, so it stays a single meeting in
+ // the default four weeks.
+ #define MAX_PERIOD 4
+ const int FREQ_PERIOD[FREQ_COUNT] = {1, 2, 4, 4};
+ 
+ // One day's slots packed into the bits of a number: bit i set = slot i is booked.
+ // Checking or booking a whole meeting is then a single AND / OR instead of a loop.
+ typedef uint64_t SlotMask;
+ 
+ // The attendees of a meeting the same way: bit a set = attendee a (see ATTENDEES) attends
+ typedef uint64_t AttendeeSet;
+ 
+ // The calendar meetings are planned in: how many weeks, which days, and how each day is
+ // cut into time slots. Break times (like lunch) get no slots at all. The settings come
+ // from the command line (see main); init_calendar works out the rest once at startup.
+ // After that it is only read, so all threads share it without locks.
+ typedef struct {
+     int weeks;                          // Length of the plan in weeks
+     int days;                           // Working days per week, from Monday (4 = Monday to Thursday)
+     int slot_minutes;                   // Length of one time slot
+     int day_start;                      // Start of the working day (minutes after midnight)
+     int day_end;                        // End of the working day (minutes after midnight)
+     int break_count;                    // Number of breaks
+     int break_start[MAX_BREAKS];        // Start of each break (minutes after midnight)
+     int break_end[MAX_BREAKS];          // End of each break
+     // Filled in by init_calendar:
+     int slots;                          // Time slots per day
+     int slot_start[MAX_DAY_SLOTS];      // Start of each slot (minutes after midnight)
+     char slot_names[MAX_DAY_SLOTS][8];  // Start of each slot as text (e.g., "09:30")
+     int max_duration;                   // Longest meeting in slots
+     SlotMask fits_mask[MAX_DURATION + 1]; // fits_mask[d]: start slots where a d-slot meeting
+                                           // ends in time and does not run into a break
+ } Calendar;
+ 
+ // Default: 4 weeks, Monday to Thursday, 9:00-17:00 in 30-minute slots, lunch 12:00-13:00
+ Calendar calendar = {
+     .weeks = 4, .days = 4, .slot_minutes = 30, .day_start = 9 * 60, .day_end = 17 * 60,
+     .break_count = 1, .break_start = {12 * 60}, .break_end = {13 * 60},
+ };
  
  // Struct to hold meeting details (like a form for a meeting request)
  typedef struct {
      char name[MAX_STR];          // Meeting name (e.g., "Team Sync")
      char type[MAX_STR];          // Type (e.g., "One-to-one")
-     int duration;               // Duration in slots (1, 2, or 3)
+     int duration;               // Duration in slots (1 to calendar.max_duration)
      int preferred_hours[8];     // Preferred start times (slot indices, -1 ends list)
-     char fixed_day[MAX_STR];    // Optional fixed day (e.g., "Monday")
-     char fixed_time[MAX_STR];   // Optional fixed time (e.g., "10:00")
-     char frequency[MAX_STR];    // How often it repeats (e.g., "weekly")
+     int fixed_day;              // Optional fixed day index (e.g., 0=Monday), -1 if any day
+     int fixed_time;             // Optional fixed slot index (see calendar.slot_names), -1 if any time
+     Frequency frequency;        // How often it repeats (e.g., FREQ_WEEKLY)
+     char attendees[4 * MAX_STR]; // Who attends, names separated by ',' or ';' ("" = everyone)
  } Meeting;
  
  // Struct for a reserved time slot (like booking a room)
  typedef struct {
-     char day[MAX_STR];          // Day of reservation (e.g., "Tuesday")
-     char start_time[MAX_STR];   // Start time (e.g., "14:00")
+     int day;                    // Day index of reservation (e.g., 1=Tuesday)
+     int start_time;             // Start slot index (see calendar.slot_names)
      int duration;              // Duration in slots
+     int next_in_day;            // Next reservation on the same day (-1 = last)
  } Reservation;
  
- // Struct for a scheduled meeting (what actually goes on the calendar)
+ // An accepted meeting as the scheduler keeps it: the same rules as Meeting, but packed
+ // into small numbers, with the name and type stored once in the scheduler's string arena
  typedef struct {
-     int week;                   // Week number (0 to 3, for Week 1 to 4)
-     int day;                    // Day index (0=Monday, ..., 3=Thursday)
-     int start_time;             // Time slot index (0=9:00, ..., 13=16:30)
-     char name[MAX_STR];         // Meeting name
-     char type[MAX_STR];         // Meeting type
-     int duration;              // Duration in slots
-     char frequency[MAX_STR];    // Frequency
+     uint32_t name;              // Offset of the name in scheduler->strings
+     uint32_t type;              // Offset of the type in scheduler->strings
+     uint8_t duration;           // Duration in slots
+     uint8_t frequency;          // Frequency
+     int8_t fixed_day;           // Fixed day index, -1 if any day
+     int8_t fixed_time;          // Fixed slot index, -1 if any time
+     int8_t preferred_hours[8];  // Preferred start slots, -1 ends list
+     AttendeeSet attendees;      // Who attends (0 = everyone, see ATTENDEES)
+ } MeetingRecord;
+ 
+ // Struct for a scheduled meeting (what actually goes on the calendar). Everything else
+ // about it (name, type, duration, frequency) is looked up through meeting_id.
+ typedef struct {
+     uint32_t meeting_id;        // Meeting it belongs to (index into scheduler->meetings)
+     int32_t next_in_day;        // Next entry in the same week and day (-1 = last)
+     uint8_t week;               // Week index (0 to calendar.weeks - 1, shown as Week 1 and up)
+     uint8_t day;                // Day index (0 to calendar.days - 1, 0=Monday)
+     uint8_t start_time;         // Time slot index (0 to calendar.slots - 1, see calendar.slot_names)
  } ScheduleEntry;
  
- // Main scheduler struct to hold all data (like a big organizer)
+ // Where every occurrence of a meeting is: one day and start, in every period-th week
+ typedef struct {
+     int8_t day;    // Day index
+     int8_t start;  // Start slot
+     int8_t phase;  // First week it meets in (see FREQ_PERIOD), -1 = not placed
+ } Placement;
+ 
+ // Main scheduler struct to hold all data (like a big organizer).
+ // The meetings, the schedule and the strings live in malloc'd arrays that grow in chunks
+ // as needed, so an empty schedule takes almost no memory.
  typedef struct {
-     ScheduleEntry schedule[MAX_MEETINGS * MAX_WEEKS]; // Array of scheduled meetings
+     ScheduleEntry *schedule;                         // Array of scheduled meetings
      int schedule_count;                              // How many meetings are scheduled
-     Reservation reservations[MAX_RESERVATIONS];      // Array of reservations
+     int schedule_capacity;                           // Room in schedule before it has to grow
+     MeetingRecord *meetings;                         // Every accepted meeting request, as asked for
+                                                      // (duration 0 = deleted; ids never change)
+     int meeting_count;                               // How many meetings were accepted
+     int meeting_capacity;
+     Placement *placements;                           // Where each meeting is, kept by add_schedule_entry
+     int placement_capacity;
+     char *strings;                                   // Names and types, each stored once ('\0' after each)
+     uint32_t strings_len;                            // Bytes used in strings
+     uint32_t strings_capacity;
+     uint32_t *string_index;                          // Hash table of the strings' offsets (see STRINGS)
+     uint32_t string_index_size;                      // Slots in string_index (a power of two, or 0)
+     uint32_t string_count;                           // Strings in string_index
+     Reservation reservations[MAX_RESERVATIONS];      // Array of reservations (duration 0 = deleted)
      int reservation_count;                          // How many reservations exist
-     double total_hours[MAX_DAYS];                   // Total hours booked per day
-     double meeting_hours[MAX_DAYS];                 // Meeting hours per day
-     bool blocked_slots[MAX_WEEKS][MAX_DAYS][MAX_SLOTS]; // Tracks booked slots
+     uint32_t attendee_names[MAX_ATTENDEES];          // Offset of each attendee's name in strings
+     int attendee_count;                              // Attendees named so far (they are never removed)
+     // Booked slots of every attendee (see ATTENDEES): one SlotMask per week/day each, attendee
+     // a's at attendee_slots[a * weeks * days + day_cell(week, day)]; room for attendee_capacity
+     SlotMask *attendee_slots;
+     int attendee_capacity;
+     uint64_t random_state;                          // Random number generator (see next_random)
+     // Arrays sized by the calendar, all in one malloc'd block (grid). The week/day ones
+     // are indexed by day_cell(week, day), the others by day.
+     void *grid;
+     SlotMask *blocked_slots;                        // Booked slots of each week/day, one bit per slot
+                                                     // (reservations and meetings for everyone)
+     SlotMask *attendee_busy;                        // Slots any attendee has booked (the OR of them all)
+     // Where each duration can still start on each week/day for everyone (free_starts of
+     // blocked_slots | attendee_busy), kept up to date by block_slots; see start_mask
+     SlotMask *start_masks;
+     double *total_hours;                            // Total hours booked per day
+     double *meeting_hours;                          // Meeting hours per day
+     // Days ordered by total_hours (a min-heap, see DAY LOAD) so the least busy day is
+     // always at day_heap[0]; day_heap_pos[day] says where each day is in day_heap
+     int *day_heap;
+     int *day_heap_pos;
+     // Entries of each week/day chained through next_in_day, so pages can list one day
+     // without searching the whole schedule (indices into schedule, -1 = empty)
+     int *day_first;
+     int *day_last;
+     // Same for reservations, which repeat every week (indices into reservations)
+     int *reservation_first;
+     int *reservation_last;
  } MeetingScheduler;
  
+ // Events the scheduler counts for /metrics (see METRICS)
+ typedef enum {
+     COUNT_PLACEMENT_ATTEMPTS,    // add_meeting calls
+     COUNT_PLACEMENTS,            // ... that placed the meeting
+     COUNT_PLACEMENT_CANDIDATES,  // Day and phase pairs add_meeting checked for a free start
+     COUNT_FAILED_FIXED_TIME,     // Not placed: the fixed time runs past the day or into a break
+     COUNT_FAILED_DAY_FULL,       // Not placed: every allowed day has 2.5 hours of meetings a week
+     COUNT_FAILED_NO_SLOT,        // Not placed: no start is free in every week it meets in
+     COUNT_FAILED_NO_MEMORY,      // Not placed: out of memory
+     COUNT_FAILED_ATTENDEES,      // Not placed: its attendees would be more than MAX_ATTENDEES
+     COUNT_RESERVATION_ATTEMPTS,  // reserve_slot calls
+     COUNT_RESERVATIONS,          // ... that reserved the slots
+     COUNT_SOLVER_RUNS,           // solve_schedule calls
+     COUNT_SOLVER_SOLVED,         // ... that found a schedule
+     COUNT_SOLVER_TIMEOUTS,       // ... that ran out of time
+     COUNT_SOLVER_STEPS,          // Search steps taken by the solver
+     COUNTER_COUNT
+ } Counter;
+ 
+ void count_event(Counter counter, uint64_t amount); // Defined in METRICS
+ 
  // -------------------------
  // HELPER FUNCTIONS
  // -------------------------
  
- // Finds the index of a time in TIME_SLOTS (e.g., "09:30" -> 1)
+ // Finds the index of a time slot (e.g., "09:30" -> 1 with the default calendar)
  int find_slot_index(const char *time) {
-     for (int i = 0; i < MAX_SLOTS; i++) {
-         if (strcmp(TIME_SLOTS[i], time) == 0) // strcmp returns 0 if strings match
+     for (int i = 0; i < calendar.slots; i++) {
+         if (strcmp(calendar.slot_names[i], time) == 0) // strcmp returns 0 if strings match
              return i;
      }
      return -1; // Return -1 if time not found
  }
  
- // Finds the index of a day in DAYS (e.g., "Tuesday" -> 1)
+ // Finds the index of a working day (e.g., "Tuesday" -> 1)
  int find_day_index(const char *day) {
-     for (int i = 0; i < MAX_DAYS; i++) {
+     for (int i = 0; i < calendar.days; i++) {
          if (strcmp(DAYS[i], day) == 0)
              return i;
      }
      return -1; // Return -1 if day not found
  }
  
- // Checks if a time is during the lunch break (12:00 or 12:30)
- bool is_break_slot(const char *time) {
-     return (strcmp(time, BREAK_SLOTS[0]) == 0 || strcmp(time, BREAK_SLOTS[1]) == 0);
+ // Finds the index of a frequency in FREQUENCIES (e.g., "fortnightly" -> FREQ_FORTNIGHTLY)
+ int find_frequency_index(const char *frequency) {
+     for (int i = 0; i < FREQ_COUNT; i++) {
+         if (strcmp(FREQUENCIES[i], frequency) == 0)
+             return i;
+     }
+     return -1; // Return -1 if frequency not found
+ }
+ 
+ // Returns the bits for duration_slots slots starting at start_idx (e.g., start=2, duration=3 -> 0b11100)
+ SlotMask slot_window(int start_idx, int duration_slots) {
+     return (((SlotMask)1 << duration_slots) - 1) << start_idx;
+ }
+ 
+ // Reads a time like "09:30" into minutes after midnight; -1 if it is not a valid time
+ int parse_clock_time(const char *text) {
+     int hour, minute;
+     char extra;
+     if (sscanf(text, "%d:%d%c", &hour, &minute, &extra) != 2 || hour < 0 || hour > 24 || minute < 0 || minute > 59)
+         return -1;
+     return hour * 60 + minute;
+ }
+ 
+ // Checks the calendar settings and works out its time slots (call once at startup,
+ // before scheduling anything). Returns NULL if fine, otherwise what is wrong.
+ const char *init_calendar(void) {
+     Calendar *c = &calendar;
+     if (c->weeks < 1 || c->weeks > MAX_HORIZON_WEEKS)
+         return "weeks must be between 1 and 104";
+     if (c->days < 1 || c->days > MAX_WEEK_DAYS)
+         return "days must be between 1 and 7";
+     if (c->slot_minutes < MIN_SLOT_MINUTES || c->slot_minutes > MAX_MEETING_MINUTES)
+         return "slot length must be between 5 and 90 minutes";
+     if (c->day_start < 0 || c->day_end > 24 * 60 || c->day_start >= c->day_end)
+         return "the working day must start before it ends";
+     // Slots follow each other from the start of the day, skipping any that touch a break
+     c->slots = 0;
+     for (int t = c->day_start; t + c->slot_minutes <= c->day_end; t += c->slot_minutes) {
+         bool in_break = false;
+         for (int b = 0; b < c->break_count; b++) {
+             if (t < c->break_end[b] && t + c->slot_minutes > c->break_start[b])
+                 in_break = true;
+         }
+         if (in_break)
+             continue;
+         if (c->slots == MAX_DAY_SLOTS)
+             return "too many time slots in one day (at most 64)";
+         c->slot_start[c->slots] = t;
+         snprintf(c->slot_names[c->slots], sizeof(c->slot_names[0]), "%02u:%02u", (unsigned)t / 60 % 100, (unsigned)t % 60);
+         c->slots++;
+     }
+     if (c->slots == 0)
+         return "no time slots left in the working day";
+     c->max_duration = MAX_MEETING_MINUTES / c->slot_minutes;
+     // A meeting fits where its slots follow each other directly (11:30 is followed by
+     // 13:00, not 12:00, so a meeting starting at 11:30 cannot run past 12:00)
+     for (int d = 1; d <= c->max_duration; d++) {
+         c->fits_mask[d] = 0;
+         for (int s = 0; s + d <= c->slots; s++) {
+             if (c->slot_start[s + d - 1] == c->slot_start[s] + (d - 1) * c->slot_minutes)
+                 c->fits_mask[d] |= slot_window(s, 1);
+         }
+     }
+     return NULL;
+ }
+ 
+ // Checks if a meeting of duration_slots can start at start_idx on a day with the given booked slots
+ bool window_free(SlotMask busy, int start_idx, int duration_slots) {
+     if (start_idx < 0 || start_idx >= calendar.slots || duration_slots < 1 || duration_slots > calendar.max_duration)
+         return false;
+     if (!(calendar.fits_mask[duration_slots] & slot_window(start_idx, 1)))
+         return false; // Too late in the day or runs into a break
+     return !(busy & slot_window(start_idx, duration_slots)); // All slots free?
+ }
+ 
+ // Returns the start slots where a meeting of duration_slots fits on a day with the given
+ // booked slots, one bit per slot (window_free for every start at once). Slot s is
+ // usable if slots s .. s+duration-1 are all free: bit s of ~busy, ~busy >> 1, and so on.
+ SlotMask free_starts(SlotMask busy, int duration_slots) {
+     if (duration_slots < 1 || duration_slots > calendar.max_duration)
+         return 0;
+     SlotMask run = ~busy;
+     for (int k = 1; k < duration_slots; k++)
+         run &= ~busy >> k;
+     return run & calendar.fits_mask[duration_slots];
  }
  
- // Converts a slot index to hours (e.g., slot 2=10:00 -> 10.0, slot 3=10:30 -> 10.5)
- double slot_to_hour(int slot_idx) {
-     int hour = slot_idx / 2 + 9; // Each slot is 30 min, starting at 9:00
-     int minute = (slot_idx % 2) * 30; // Odd slots add 30 min
-     if (slot_idx >= 6) // After 12:00 (slot 6), skip break hour
-         hour++;
-     return hour + minute / 60.0; // Convert to decimal (e.g., 10:30 = 10.5)
+ // Index of the lowest set bit (mask must not be 0), e.g., 0b10100 -> 2
+ int lowest_slot(SlotMask mask) {
+     return __builtin_ctzll(mask); // Counts trailing zero bits in one instruction
+ }
+ 
+ // Turns a length in minutes into slots (e.g., 60 -> 2 with 30-minute slots);
+ // -1 if it is not a whole number of slots or longer than MAX_MEETING_MINUTES
+ int duration_from_minutes(int minutes) {
+     if (minutes < calendar.slot_minutes || minutes > MAX_MEETING_MINUTES || minutes % calendar.slot_minutes != 0)
+         return -1;
+     return minutes / calendar.slot_minutes;
+ }
+ 
+ // Converts a number of slots to hours (e.g., 3 slots of 30 min -> 1.5)
+ double slots_to_hours(int slots) {
+     return slots * calendar.slot_minutes / 60.0;
+ }
+ 
+ // Position of a week/day in the per-week/day arrays of the scheduler
+ int day_cell(int week, int day) {
+     return week * calendar.days + day;
+ }
+ 
+ // Number of weeks a meeting meets in, for a frequency and phase (see FREQ_PERIOD)
+ int frequency_occurrences(Frequency frequency, int phase) {
+     int period = FREQ_PERIOD[frequency];
+     if (phase >= calendar.weeks)
+         return 0;
+     return (calendar.weeks - phase + period - 1) / period;
+ }
+ 
+ // Number of phases worth trying for a frequency (a 4-weekly meeting in a 2-week plan has only 2)
+ int frequency_phases(Frequency frequency) {
+     int period = FREQ_PERIOD[frequency];
+     return (period < calendar.weeks) ? period : calendar.weeks;
  }
  
  // Calculates end time from start slot and duration (e.g., start=2, duration=2 -> "11:00")
  void compute_end_time(int start_idx, int duration_slots, char *end_time) {
-     double start_hour = slot_to_hour(start_idx); // Get start time in hours
-     double end_hour = start_hour + duration_slots * 0.5; // Add duration (0.5 hr/slot)
-     int end_h = (int) end_hour; // Whole hours
-     int end_m = (int)((end_hour - end_h) * 60); // Minutes
-     snprintf(end_time, 8, "%02d:%02d", end_h, end_m); // Format as "HH:MM"
+     unsigned end = calendar.slot_start[start_idx] + duration_slots * calendar.slot_minutes; // Minutes after midnight
+     snprintf(end_time, 8, "%02u:%02u", end / 60 % 100, end % 60); // Format as "HH:MM"
+ }
+ 
+ // Copies text into a fixed-size field, always ending it with '\0'
+ void copy_field(char *dest, const char *src) {
+     strncpy(dest, src, MAX_STR - 1);
+     dest[MAX_STR - 1] = '\0';
+ }
+ 
+ // Reads a list of times like "09:30,10:00" (',' or ';' between times) into preferred_hours.
+ // Unknown times are skipped; at most 8 are kept.
+ void parse_preferred_times(Meeting *meeting, const char *list) {
+     int idx = 0;
+     const char *p = list;
+     while (*p && idx < 8) {
+         while (*p == ' ') p++; // Allow "09:30, 10:00"
+         size_t len = strcspn(p, ",;"); // Length up to the next separator
+         char token[8];
+         if (len < sizeof(token)) {
+             memcpy(token, p, len);
+             token[len] = '\0';
+             int slot = find_slot_index(token);
+             if (slot != -1)
+                 meeting->preferred_hours[idx++] = slot;
+         }
+         p += len;
+         if (*p) p++; // Skip the separator
+     }
+     if (idx < 8) meeting->preferred_hours[idx] = -1;
+ }
+ 
+ int count_attendee_names(const char *list); // Defined in ATTENDEES
+ 
+ // Fills a meeting from the text fields of a request (any field may be NULL or empty).
+ // Returns NULL if the meeting is usable, otherwise a short reason why it is not.
+ const char *parse_meeting(Meeting *meeting, const char *name, const char *type, const char *duration,
+                           const char *preferred_times, const char *fixed_day, const char *fixed_time,
+                           const char *frequency, const char *attendees) {
+     memset(meeting, 0, sizeof(*meeting)); // Clear meeting struct
+     // Initialize preferred_hours with -1
+     for (int i = 0; i < 8; i++) meeting->preferred_hours[i] = -1;
+     if (name) copy_field(meeting->name, name);
+     if (type) copy_field(meeting->type, type);
+     if (!duration || !*duration)
+         return "missing duration";
+     int dur = atoi(duration); // Convert string to number
+     meeting->duration = duration_from_minutes(dur); // e.g., 60 -> 2 slots of 30 minutes
+     if (meeting->duration < 0)
+         meeting->duration = 1; // One slot (also used for unexpected values)
+     // Parse preferred times (e.g., "09:30,10:00")
+     if (preferred_times && *preferred_times)
+         parse_preferred_times(meeting, preferred_times);
+     // Unknown days/times count as "not fixed", like an empty field
+     meeting->fixed_day = (fixed_day && *fixed_day) ? find_day_index(fixed_day) : -1;
+     meeting->fixed_time = (fixed_time && *fixed_time) ? find_slot_index(fixed_time) : -1;
+     int freq_idx = frequency ? find_frequency_index(frequency) : -1;
+     if (freq_idx < 0)
+         return "unknown frequency";
+     meeting->frequency = (Frequency)freq_idx;
+     // Attendees (e.g., "Ann, Bob"), looked up by name when the meeting is placed
+     if (attendees && *attendees) {
+         if (strlen(attendees) >= sizeof(meeting->attendees))
+             return "attendee list too long";
+         strcpy(meeting->attendees, attendees);
+         if (count_attendee_names(attendees) > MAX_MEETING_ATTENDEES)
+             return "too many attendees";
+     }
+     return NULL;
+ }
+ 
+ // Growable text buffer that remembers its length, so appending never rescans the text
+ typedef struct {
+     char *data;      // Text so far ('\0'-terminated), NULL until something is added
+     size_t len;      // Bytes of text
+     size_t capacity; // Bytes allocated
+     bool failed;     // Set if memory ran out (the text is then incomplete)
+ } TextBuffer;
+ 
+ // Makes room for extra more bytes (plus the ending '\0'); false if out of memory
+ bool text_reserve(TextBuffer *buffer, size_t extra) {
+     if (buffer->failed)
+         return false;
+     if (buffer->len + extra + 1 <= buffer->capacity)
+         return true;
+     size_t capacity = buffer->capacity ? buffer->capacity : 1024;
+     while (capacity < buffer->len + extra + 1)
+         capacity *= 2; // Doubling keeps appends linear overall
+     char *data = realloc(buffer->data, capacity);
+     if (!data) {
+         buffer->failed = true;
+         return false;
+     }
+     buffer->data = data;
+     buffer->capacity = capacity;
+     return true;
+ }
+ 
+ // Adds len bytes of data to the end
+ void text_append(TextBuffer *buffer, const char *data, size_t len) {
+     if (!text_reserve(buffer, len))
+         return;
+     memcpy(buffer->data + buffer->len, data, len);
+     buffer->len += len;
+     buffer->data[buffer->len] = '\0';
+ }
+ 
+ // Adds formatted text to the end (like printf)
+ void text_printf(TextBuffer *buffer, const char *format, ...) {
+     va_list args;
+     va_start(args, format);
+     int n = vsnprintf(NULL, 0, format, args); // Measure first
+     va_end(args);
+     if (n < 0 || !text_reserve(buffer, (size_t)n))
+         return;
+     va_start(args, format);
+     vsnprintf(buffer->data + buffer->len, (size_t)n + 1, format, args);
+     va_end(args);
+     buffer->len += (size_t)n;
+ }
+ 
+ // -------------------------
+ // RANDOM NUMBERS
+ // -------------------------
+ 
+ // Each scheduler has its own random number generator instead of sharing rand(): rand()
+ // keeps one hidden state for the whole program, which threads would fight over, and its
+ // results depend on everything that ran before. The state is part of the scheduler, so
+ // it is copied, saved and restored with the schedule (see PERSISTENCE), and the same
+ // seed (--seed) always gives the same placements.
+ // The generator is xorshift64*: three shifts and a multiply per number.
+ uint64_t random_seed = 0; // Set at startup (from --seed, or the clock)
+ 
+ // Starts a generator from a seed (any value, 0 included)
+ void seed_random(MeetingScheduler *scheduler, uint64_t seed) {
+     // Mix the seed (splitmix64) so similar seeds give unrelated sequences; never 0
+     uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+     z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+     z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+     z ^= z >> 31;
+     scheduler->random_state = z ? z : 1;
+ }
+ 
+ // Returns the next random number of a scheduler
+ uint32_t next_random(MeetingScheduler *scheduler) {
+     uint64_t x = scheduler->random_state;
+     x ^= x >> 12;
+     x ^= x << 25;
+     x ^= x >> 27;
+     scheduler->random_state = x;
+     return (uint32_t)((x * 0x2545F4914F6CDD1DULL) >> 32); // The high bits are the best ones
+ }
+ 
+ // Returns a random number from 0 to limit - 1
+ int random_below(MeetingScheduler *scheduler, int limit) {
+     return (int)(((uint64_t)next_random(scheduler) * (uint32_t)limit) >> 32); // No modulo bias
  }
  
  // -------------------------
  // SCHEDULER FUNCTIONS
  // -------------------------
  
- // Initializes the scheduler to a clean state
- void init_scheduler(MeetingScheduler *scheduler) {
-     scheduler->schedule_count = 0; // No meetings yet
-     scheduler->reservation_count = 0; // No reservations yet
-     memset(scheduler->total_hours, 0, sizeof(scheduler->total_hours)); // Clear hours
-     memset(scheduler->meeting_hours, 0, sizeof(scheduler->meeting_hours)); // Clear meeting hours
-     memset(scheduler->blocked_slots, 0, sizeof(scheduler->blocked_slots)); // Clear booked slots
+ // -------------------------
+ // DAY LOAD
+ // -------------------------
+ 
+ // Placing a meeting wants the least busy days first. Instead of sorting the days again
+ // for every meeting, the scheduler keeps them in a binary min-heap keyed by the hours
+ // booked on each day: heap[0] is the least busy day, and the children of heap[i] are
+ // heap[2i+1] and heap[2i+2], which are never less busy than heap[i]. When the hours of
+ // one day change, only that day moves up or down the heap (day_load_changed).
+ // Days with the same hours are ordered by index, so Monday comes before Tuesday.
+ // pos (if not NULL) is kept up to date with where each day sits in the heap.
+ // The load of one week/day needs no extra bookkeeping: it is the number of bits set
+ // in its blocked_slots.
+ 
+ // Checks if day a should come before day b
+ bool day_less_busy(const double *load, int a, int b) {
+     return load[a] < load[b] || (load[a] == load[b] && a < b);
  }
  
- // Reserves a time slot across all weeks (e.g., for external commitments)
- bool reserve_slot(MeetingScheduler *scheduler, const char *day, const char *start_time, int duration_minutes) {
-     // Get day and time indices
-     int day_idx = find_day_index(day);
-     int start_idx = find_slot_index(start_time);
-     
-     // Check if inputs are valid
-     if (day_idx == -1 || start_idx == -1 ||
-         (duration_minutes % 30 != 0) || duration_minutes < 30 || duration_minutes > 90) {
-         return false; // Invalid day, time, or duration (must be 30, 60, or 90 min)
+ // Swaps two heap positions
+ void heap_swap(int *heap, int *pos, int i, int j) {
+     int temp = heap[i];
+     heap[i] = heap[j];
+     heap[j] = temp;
+     if (pos) {
+         pos[heap[i]] = i;
+         pos[heap[j]] = j;
      }
-     
-     int duration_slots = duration_minutes / 30; // Convert minutes to slots
-     double start_hour = slot_to_hour(start_idx); // Start time in hours
-     double end_hour = start_hour + duration_slots * 0.5; // End time in hours
-     
-     // Check if slot is after 5:00 PM or during break
-     if (end_hour > 17.0 || is_break_slot(start_time))
-         return false;
-     
-     // Check if any slot in duration is invalid or a break
-     for (int i = 0; i < duration_slots; i++) {
-         int slot_idx = start_idx + i;
-         if (slot_idx >= MAX_SLOTS || is_break_slot(TIME_SLOTS[slot_idx]))
-             return false;
+ }
+ 
+ // Moves the day at position i up while it is less busy than its parent
+ void heap_sift_up(int *heap, int *pos, const double *load, int i) {
+     while (i > 0 && day_less_busy(load, heap[i], heap[(i - 1) / 2])) {
+         heap_swap(heap, pos, i, (i - 1) / 2);
+         i = (i - 1) / 2;
      }
-     
-     // Check if slots are free in all weeks
-     for (int week = 0; week < MAX_WEEKS; week++) {
-         for (int i = 0; i < duration_slots; i++) {
-             int slot_idx = start_idx + i;
-             if (scheduler->blocked_slots[week][day_idx][slot_idx])
-                 return false; // Slot already booked
-             scheduler->blocked_slots[week][day_idx][slot_idx] = true; // Book slot
-         }
+ }
+ 
+ // Moves the day at position i down while a child is less busy than it
+ void heap_sift_down(int *heap, int *pos, int count, const double *load, int i) {
+     for (;;) {
+         int smallest = i;
+         int left = 2 * i + 1, right = 2 * i + 2;
+         if (left < count && day_less_busy(load, heap[left], heap[smallest]))
+             smallest = left;
+         if (right < count && day_less_busy(load, heap[right], heap[smallest]))
+             smallest = right;
+         if (smallest == i)
+             return;
+         heap_swap(heap, pos, i, smallest);
+         i = smallest;
      }
-     
-     // Add reservation to the list
-     Reservation *res = &scheduler->reservations[scheduler->reservation_count++];
-     strncpy(res->day, day, MAX_STR); // Copy day
-     strncpy(res->start_time, start_time, MAX_STR); // Copy time
-     res->duration = duration_slots; // Set duration
-     scheduler->total_hours[day_idx] += duration_slots * 0.5 * MAX_WEEKS; // Update hours
-     return true; // Success
  }
  
- // Checks if a time slot is free for a given week, day, and duration
- bool is_valid_slot(MeetingScheduler *scheduler, int week, int day_idx, int start_idx, int duration_slots) {
-     // Check if start time is valid
-     if (start_idx < 0 || start_idx >= MAX_SLOTS || is_break_slot(TIME_SLOTS[start_idx]))
+ // Puts all days into a heap from scratch
+ void heap_build(int *heap, int *pos, int count, const double *load) {
+     for (int i = 0; i < count; i++) {
+         heap[i] = i;
+         if (pos)
+             pos[i] = i;
+     }
+     for (int i = count / 2 - 1; i >= 0; i--)
+         heap_sift_down(heap, pos, count, load, i);
+ }
+ 
+ // Restores the heap after the load of day changed
+ void day_load_changed(int *heap, int *pos, int count, const double *load, int day) {
+     heap_sift_up(heap, pos, load, pos[day]);
+     heap_sift_down(heap, pos, count, load, pos[day]);
+ }
+ 
+ // Removes and returns the least busy day (*count goes down by one)
+ int heap_pop(int *heap, int *pos, int *count, const double *load) {
+     int day = heap[0];
+     (*count)--;
+     heap_swap(heap, pos, 0, *count);
+     heap_sift_down(heap, pos, *count, load, 0);
+     return day;
+ }
+ 
+ // Size of the calendar-sized arrays of a scheduler (see MeetingScheduler)
+ size_t grid_size(void) {
+     size_t cells = (size_t)calendar.weeks * calendar.days;
+     return cells * (2 + calendar.max_duration) * sizeof(SlotMask) + 2 * calendar.days * sizeof(double) +
+            2 * cells * sizeof(int) + 4 * calendar.days * sizeof(int);
+ }
+ 
+ // Points the calendar-sized arrays into the scheduler's grid block
+ void point_into_grid(MeetingScheduler *scheduler) {
+     size_t cells = (size_t)calendar.weeks * calendar.days;
+     char *p = scheduler->grid;
+     scheduler->blocked_slots = (SlotMask *)p;   p += cells * sizeof(SlotMask);
+     scheduler->attendee_busy = (SlotMask *)p;   p += cells * sizeof(SlotMask);
+     scheduler->start_masks = (SlotMask *)p;     p += cells * calendar.max_duration * sizeof(SlotMask);
+     scheduler->total_hours = (double *)p;       p += calendar.days * sizeof(double);
+     scheduler->meeting_hours = (double *)p;     p += calendar.days * sizeof(double);
+     scheduler->day_heap = (int *)p;             p += calendar.days * sizeof(int);
+     scheduler->day_heap_pos = (int *)p;         p += calendar.days * sizeof(int);
+     scheduler->day_first = (int *)p;            p += cells * sizeof(int);
+     scheduler->day_last = (int *)p;             p += cells * sizeof(int);
+     scheduler->reservation_first = (int *)p;    p += calendar.days * sizeof(int);
+     scheduler->reservation_last = (int *)p;
+ }
+ 
+ // Works out start_masks of one week/day again from its booked slots
+ void update_start_masks(MeetingScheduler *scheduler, int cell) {
+     SlotMask *masks = scheduler->start_masks + (size_t)cell * calendar.max_duration;
+     SlotMask free_slots = ~(scheduler->blocked_slots[cell] | scheduler->attendee_busy[cell]);
+     SlotMask run = free_slots; // Starts of free runs of d slots (same as in free_starts)
+     for (int d = 1; d <= calendar.max_duration; d++) {
+         if (d > 1)
+             run &= free_slots >> (d - 1);
+         masks[d - 1] = run & calendar.fits_mask[d];
+     }
+ }
+ 
+ // Books slots on one week/day (cell = day_cell(week, day))
+ void block_slots(MeetingScheduler *scheduler, int cell, SlotMask window) {
+     scheduler->blocked_slots[cell] |= window;
+     update_start_masks(scheduler, cell);
+ }
+ 
+ // Start slots still free for duration_slots on a week/day (0 if the duration is invalid)
+ SlotMask start_mask(const MeetingScheduler *scheduler, int week, int day_idx, int duration_slots) {
+     if (duration_slots < 1 || duration_slots > calendar.max_duration)
+         return 0;
+     return scheduler->start_masks[(size_t)day_cell(week, day_idx) * calendar.max_duration + duration_slots - 1];
+ }
+ 
+ // Initializes the scheduler to a clean state; returns false if out of memory
+ // (free it with free_scheduler either way)
+ bool init_scheduler(MeetingScheduler *scheduler) {
+     memset(scheduler, 0, sizeof(*scheduler)); // No meetings or reservations yet
+     seed_random(scheduler, random_seed); // Every empty schedule starts the same way
+     scheduler->grid = calloc(1, grid_size()); // Clear hours and booked slots
+     if (!scheduler->grid)
          return false;
-     
-     double start_hour = slot_to_hour(start_idx); // Start time in hours
-     double end_hour = start_hour + duration_slots * 0.5; // End time
-     
-     // Check if meeting ends after 5:00 PM
-     if (end_hour > 17.0)
+     point_into_grid(scheduler);
+     // Empty the per-day lists
+     for (int day = 0; day < calendar.days; day++) {
+         for (int week = 0; week < calendar.weeks; week++)
+             scheduler->day_first[day_cell(week, day)] = scheduler->day_last[day_cell(week, day)] = -1;
+         scheduler->reservation_first[day] = scheduler->reservation_last[day] = -1;
+     }
+     for (int cell = 0; cell < calendar.weeks * calendar.days; cell++)
+         update_start_masks(scheduler, cell); // Everything free
+     heap_build(scheduler->day_heap, scheduler->day_heap_pos, calendar.days, scheduler->total_hours);
+     return true;
+ }
+ 
+ // Frees the arrays of a scheduler (it can then only be freed again or initialized)
+ void free_scheduler(MeetingScheduler *scheduler) {
+     free(scheduler->schedule);
+     free(scheduler->meetings);
+     free(scheduler->placements);
+     free(scheduler->strings);
+     free(scheduler->string_index);
+     free(scheduler->attendee_slots);
+     free(scheduler->grid);
+     memset(scheduler, 0, sizeof(*scheduler));
+ }
+ 
+ #define ARRAY_CHUNK 64 // Arrays grow by this many items at a time
+ 
+ // Makes room for at least needed items in a growable array; false if out of memory
+ bool grow_array(void **array, int *capacity, int needed, size_t item_size) {
+     if (needed <= *capacity)
+         return true;
+     int new_capacity = (needed + ARRAY_CHUNK - 1) / ARRAY_CHUNK * ARRAY_CHUNK; // Round up to a chunk
+     void *bigger = realloc(*array, (size_t)new_capacity * item_size);
+     if (!bigger)
+         return false;
+     *array = bigger;
+     *capacity = new_capacity;
+     return true;
+ }
+ 
+ // Copies a whole scheduler, arrays included (dest must not own any arrays yet).
+ // Returns false if out of memory; dest is then left empty.
+ bool copy_scheduler(MeetingScheduler *dest, const MeetingScheduler *src) {
+     *dest = *src;
+     dest->schedule = NULL;
+     dest->meetings = NULL;
+     dest->placements = NULL;
+     dest->strings = NULL;
+     dest->string_index = NULL;
+     dest->attendee_slots = NULL;
+     dest->schedule_capacity = dest->meeting_capacity = dest->placement_capacity = 0;
+     dest->strings_capacity = 0;
+     dest->attendee_capacity = 0;
+     dest->grid = malloc(grid_size());
+     size_t attendee_bytes = (size_t)src->attendee_count * calendar.weeks * calendar.days * sizeof(SlotMask);
+     // Only the used part is copied; the copy grows again if it needs to
+     bool ok = dest->grid != NULL &&
+               grow_array((void **)&dest->schedule, &dest->schedule_capacity, src->schedule_count, sizeof(ScheduleEntry)) &&
+               grow_array((void **)&dest->meetings, &dest->meeting_capacity, src->meeting_count, sizeof(MeetingRecord)) &&
+               grow_array((void **)&dest->placements, &dest->placement_capacity, src->meeting_count, sizeof(Placement));
+     if (ok && src->strings_len > 0) {
+         dest->strings = malloc(src->strings_len);
+         dest->strings_capacity = src->strings_len;
+         ok = dest->strings != NULL;
+     }
+     if (ok && src->string_index_size > 0) {
+         dest->string_index = malloc(src->string_index_size * sizeof(uint32_t));
+         ok = dest->string_index != NULL;
+     }
+     if (ok && src->attendee_count > 0) {
+         dest->attendee_slots = malloc(attendee_bytes);
+         dest->attendee_capacity = src->attendee_count;
+         ok = dest->attendee_slots != NULL;
+     }
+     if (!ok) {
+         free_scheduler(dest);
          return false;
-     
-     // Check each slot in duration
-     for (int i = 0; i < duration_slots; i++) {
-         int slot_idx = start_idx + i;
-         if (slot_idx >= MAX_SLOTS || is_break_slot(TIME_SLOTS[slot_idx]) ||
-             scheduler->blocked_slots[week][day_idx][slot_idx])
-             return false; // Slot is booked or invalid
      }
-     return true; // Slot is free
+     if (src->schedule_count > 0)
+         memcpy(dest->schedule, src->schedule, src->schedule_count * sizeof(ScheduleEntry));
+     if (src->meeting_count > 0) {
+         memcpy(dest->meetings, src->meetings, src->meeting_count * sizeof(MeetingRecord));
+         memcpy(dest->placements, src->placements, src->meeting_count * sizeof(Placement));
+     }
+     if (src->strings_len > 0)
+         memcpy(dest->strings, src->strings, src->strings_len);
+     if (src->string_index_size > 0)
+         memcpy(dest->string_index, src->string_index, src->string_index_size * sizeof(uint32_t));
+     if (src->attendee_count > 0)
+         memcpy(dest->attendee_slots, src->attendee_slots, attendee_bytes);
+     memcpy(dest->grid, src->grid, grid_size());
+     point_into_grid(dest);
+     return true;
  }
  
- // Adds a meeting to the schedule, respecting constraints
-// Adds a meeting to the schedule, respecting constraints
-bool add_meeting(MeetingScheduler *scheduler, Meeting *meeting) {
-    // Get duration and number of occurrences
-    int duration_slots = meeting->duration; // Number of 30-min slots
-    int occurrences = (strcmp(meeting->frequency, "weekly") == 0) ? 4 : // Every week
-                     (strcmp(meeting->frequency, "fortnightly") == 0) ? 2 : // Every 2 weeks
-                     (strcmp(meeting->frequency, "third_week") == 0) ? 1 : 1; // Monthly or third_week
-    int fixed_day_idx = meeting->fixed_day[0] ? find_day_index(meeting->fixed_day) : -1; // Fixed day or -1
-    int fixed_time_idx = meeting->fixed_time[0] ? find_slot_index(meeting->fixed_time) : -1; // Fixed time or -1
-    int assigned_weeks[MAX_WEEKS] = {0}; // Tracks used weeks
-    int chosen_day = -1, chosen_time = -1; // Best day/time found
-
-    // Sort days by total_hours (less busy first)
-    int day_order[MAX_DAYS];
-    for (int i = 0; i < MAX_DAYS; i++) day_order[i] = i; // Initialize: 0,1,2,3
-    for (int i = 0; i < MAX_DAYS - 1; i++) {
-        for (int j = 0; j < MAX_DAYS - i - 1; j++) {
-            if (scheduler->total_hours[day_order[j]] > scheduler->total_hours[day_order[j + 1]]) {
-                // Swap to sort least busy days first
-                int temp = day_order[j];
-                day_order[j] = day_order[j + 1];
-                day_order[j + 1] = temp;
-            }
-        }
-    }
+ // -------------------------
+ // STRINGS
+ // -------------------------
 
-    // Define valid fortnight pairs (Week 1 & 3, Week 2 & 4; 0-based: 0=Week 1)
-    int fortnight_pairs[2][2] = {{0, 2}, {1, 3}};
-    // Limit loop to 2 pairs for fortnightly, 1 for others
-    int max_pairs = (strcmp(meeting->frequency, "fortnightly") == 0) ? 2 : 1;
-
-    double min_hours = 1e9; // Track least busy day (big number to start)
-    // Loop over fortnight pairs (or once for non-fortnightly)
-    for (int p = 0; p < max_pairs; p++) {
-        // Set day range: fixed day or all days
-        int day_start = (fixed_day_idx >= 0) ? fixed_day_idx : 0;
-        int day_end = (fixed_day_idx >= 0) ? fixed_day_idx + 1 : MAX_DAYS;
-        for (int d = day_start; d < day_end; d++) {
-            int day_idx = (fixed_day_idx >= 0) ? fixed_day_idx : day_order[d];
-            // Skip days with too many meetings (>2.5 hr/week average)
-            if (scheduler->meeting_hours[day_idx] / 4 > 2.5)
-                continue;
-            // Set time range: fixed time, preferred times, or all slots
-            int time_start = (fixed_time_idx >= 0) ? fixed_time_idx : 0;
-            int time_end = (fixed_time_idx >= 0) ? fixed_time_idx + 1 : MAX_SLOTS;
-            if (meeting->preferred_hours[0] >= 0 && fixed_time_idx < 0) {
-                time_end = 0;
-                while (meeting->preferred_hours[time_end] >= 0 && time_end < 8)
-                    time_end++; // Use preferred times
-            }
-            for (int t = time_start; t < time_end && t < MAX_SLOTS; t++) {
-                // Pick time: fixed, preferred, or sequential
-                int time_idx = (fixed_time_idx >= 0) ? fixed_time_idx :
-                              (meeting->preferred_hours[0] >= 0 ? meeting->preferred_hours[t] : t);
-                if (time_idx < 0 || time_idx >= MAX_SLOTS)
-                    continue;
-                int valid_weeks = 0;
-                double avg_hours = 0;
-                if (strcmp(meeting->frequency, "fortnightly") == 0) {
-                    // Check fortnight pair (e.g., Week 1 & 3)
-                    int week1 = fortnight_pairs[p][0];
-                    int week2 = fortnight_pairs[p][1];
-                    if (is_valid_slot(scheduler, week1, day_idx, time_idx, duration_slots) &&
-                        is_valid_slot(scheduler, week2, day_idx, time_idx, duration_slots)) {
-                        valid_weeks = 2; // Both weeks free
-                        avg_hours = scheduler->total_hours[day_idx] + duration_slots * 0.5;
-                    }
-                } else {
-                    // Check all weeks for other frequencies
-                    for (int w = 0; w < MAX_WEEKS; w++) {
-                        if (assigned_weeks[w])
-                            continue;
-                        if (is_valid_slot(scheduler, w, day_idx, time_idx, duration_slots)) {
-                            valid_weeks++;
-                            avg_hours += scheduler->total_hours[day_idx] + duration_slots * 0.5;
-                        }
-                        if (valid_weeks >= occurrences)
-                            break;
-                    }
-                }
-                // Pick least busy day/time
-                if (valid_weeks >= occurrences && avg_hours / valid_weeks < min_hours) {
-                    min_hours = avg_hours / valid_weeks;
-                    chosen_day = day_idx;
-                    chosen_time = time_idx;
-                }
-            }
-        }
-    }
+ // Names and types are stored once each in the string arena and referred to by offset.
+ // string_index is a hash table (open addressing: a string that finds its slot taken goes
+ // in the next free one) of the offset of every string, so storing a name costs the same
+ // however many names there are. UINT32_MAX marks an empty slot; it is never more than
+ // half full.
+ #define STRING_SLOT_EMPTY UINT32_MAX
 
-    // If no valid slot found, fail
-    if (chosen_day == -1 || chosen_time == -1)
-        return false;
+ // FNV-1a hash of a string
+ uint32_t string_hash(const char *text) {
+     uint32_t hash = 2166136261u;
+     for (const unsigned char *p = (const unsigned char *)text; *p; p++)
+         hash = (hash ^ *p) * 16777619u;
+     return hash;
+ }
 
-    // Schedule the meeting
-    if (strcmp(meeting->frequency, "fortnightly") == 0) {
-        // Find first valid fortnight pair
-        int chosen_pair = -1;
-        for (int p = 0; p < 2; p++) {
-            int week1 = fortnight_pairs[p][0];
-            int week2 = fortnight_pairs[p][1];
-            if (is_valid_slot(scheduler, week1, chosen_day, chosen_time, duration_slots) &&
-                is_valid_slot(scheduler, week2, chosen_day, chosen_time, duration_slots)) {
-                chosen_pair = p;
-                break;
-            }
-        }
-        if (chosen_pair == -1)
-            return false;
-
-        // Add meeting to both weeks in the pair
-        for (int i = 0; i < 2; i++) {
-            int week = fortnight_pairs[chosen_pair][i];
-            ScheduleEntry *entry = &scheduler->schedule[scheduler->schedule_count++]; // Next slot
-            entry->week = week;
-            entry->day = chosen_day;
-            entry->start_time = chosen_time;
-            strncpy(entry->name, meeting->name, MAX_STR); // Copy name
-            strncpy(entry->type, meeting->type, MAX_STR); // Copy type
-            entry->duration = duration_slots;
-            strncpy(entry->frequency, meeting->frequency, MAX_STR); // Copy frequency
-            scheduler->total_hours[chosen_day] += duration_slots * 0.5; // Add hours
-            scheduler->meeting_hours[chosen_day] += duration_slots * 0.5; // Add meeting hours
-            // Mark slots as booked
-            for (int j = 0; j < duration_slots; j++) {
-                scheduler->blocked_slots[week][chosen_day][chosen_time + j] = true;
-            }
-        }
-    } else {
-        // For weekly/monthly: pick random weeks
-        int weeks[MAX_WEEKS] = {0, 1, 2, 3};
-        // Shuffle weeks for variety
-        for (int i = MAX_WEEKS - 1; i > 0; i--) {
-            int j = rand() % (i + 1);
-            int temp = weeks[i];
-            weeks[i] = weeks[j];
-            weeks[j] = temp;
-        }
-        // Schedule each occurrence
-        for (int occ = 0; occ < occurrences; occ++) {
-            int week = -1;
-            bool found = false;
-            for (int w = 0; w < MAX_WEEKS; w++) {
-                week = weeks[w];
-                if (assigned_weeks[week])
-                    continue;
-                if (is_valid_slot(scheduler, week, chosen_day, chosen_time, duration_slots)) {
-                    found = true;
-                    break;
-                }
-            }
-            if (!found)
-                return false; // No free week
-            ScheduleEntry *entry = &scheduler->schedule[scheduler->schedule_count++]; // Next slot
-            entry->week = week;
-            entry->day = chosen_day;
-            entry->start_time = chosen_time;
-            strncpy(entry->name, meeting->name, MAX_STR);
-            strncpy(entry->type, meeting->type, MAX_STR);
-            entry->duration = duration_slots;
-            strncpy(entry->frequency, meeting->frequency, MAX_STR);
-            assigned_weeks[week] = 1; // Mark week used
-            scheduler->total_hours[chosen_day] += duration_slots * 0.5;
-            scheduler->meeting_hours[chosen_day] += duration_slots * 0.5;
-            // Mark slots as booked
-            for (int i = 0; i < duration_slots; i++) {
-                scheduler->blocked_slots[week][chosen_day][chosen_time + i] = true;
-            }
-        }
-    }
-    return true; // Success
-}
- 
- // -------------------------
- // OUTPUT GENERATION
- // -------------------------
- 
- // Generates an HTML page showing the schedule as tables
- char *generate_schedule_html(MeetingScheduler *scheduler) {
-     // Allocate memory for HTML (big enough for our page)
-     char *buffer = malloc(16384);
-     if (!buffer)
-         return NULL; // Out of memory
-     buffer[0] = '\0'; // Start with empty string
- 
-     // Add HTML header with Bootstrap for styling
-     strcat(buffer, "<!DOCTYPE html><html><head><meta charset='utf-8'><title>Schedule</title>");
-     strcat(buffer, "<link rel='stylesheet' href='https://stackpath.bootstrapcdn.com/bootstrap/4.5.2/css/bootstrap.min.css'>");
-     strcat(buffer, "<style>@media print { .no-print { display: none; } }</style>");
-     strcat(buffer, "</head><body><div class='container'><h1>Weekly Meeting Schedule</h1>");
- 
-     char temp[512]; // Temporary buffer for building table rows
- 
-     // Loop through each week
-     for (int week = 0; week < MAX_WEEKS; week++) {
-         snprintf(temp, sizeof(temp), "<h3>Week %d</h3>", week + 1); // Week header
-         strcat(buffer, temp);
-         // Start table
-         strcat(buffer, "<table class='table table-bordered'><thead><tr>");
-         strcat(buffer, "<th>Day</th><th>Start Time</th><th>End Time</th><th>Name</th><th>Type</th><th>Duration (min)</th><th>Frequency</th>");
-         strcat(buffer, "</tr></thead><tbody>");
- 
-         // Loop through each day
-         for (int day = 0; day < MAX_DAYS; day++) {
-             // Alternate colors for readability
-             const char *day_color = (day % 2 == 0) ? "#ffffff" : "#f2f2f2";
-             // Add meetings for this week/day
-             for (int i = 0; i < scheduler->schedule_count; i++) {
-                 if (scheduler->schedule[i].week == week && scheduler->schedule[i].day == day) {
-                     char end_time[8];
-                     compute_end_time(scheduler->schedule[i].start_time, scheduler->schedule[i].duration, end_time);
-                     // Build table row
-                     snprintf(temp, sizeof(temp),
-                              "<tr style='background-color:%s;'><td>%s</td><td>%s</td><td>%s</td><td>%s</td><td>%s</td>"
-                              "<td>%d</td><td>%s</td></tr>",
-                              day_color, DAYS[day], TIME_SLOTS[scheduler->schedule[i].start_time],
-                              end_time, scheduler->schedule[i].name, scheduler->schedule[i].type,
-                              scheduler->schedule[i].duration * 30, scheduler->schedule[i].frequency);
-                     strcat(buffer, temp);
-                 }
-             }
-             // Add reservations for this day
-             for (int i = 0; i < scheduler->reservation_count; i++) {
-                 if (strcmp(scheduler->reservations[i].day, DAYS[day]) == 0) {
-                     int start_idx = find_slot_index(scheduler->reservations[i].start_time);
-                     char end_time[8];
-                     compute_end_time(start_idx, scheduler->reservations[i].duration, end_time);
-                     // Build reservation row
-                     snprintf(temp, sizeof(temp),
-                              "<tr style='background-color:%s;'><td>%s</td><td>%s</td><td>%s</td><td>Reserved (External)</td>"
-                              "<td>Reserved</td><td>%d</td><td>Weekly</td></tr>",
-                              day_color, DAYS[day], scheduler->reservations[i].start_time,
-                              end_time, scheduler->reservations[i].duration * 30);
-                     strcat(buffer, temp);
-                 }
-             }
+ // Returns the slot of string_index that holds text, or the empty slot where it would go
+ uint32_t string_slot(const MeetingScheduler *scheduler, const char *text) {
+     uint32_t mask = scheduler->string_index_size - 1;
+     for (uint32_t slot = string_hash(text) & mask;; slot = (slot + 1) & mask) {
+         uint32_t offset = scheduler->string_index[slot];
+         if (offset == STRING_SLOT_EMPTY || strcmp(scheduler->strings + offset, text) == 0)
+             return slot;
+     }
+ }
+
+ // Builds string_index again from the strings in the arena, in the order they were stored
+ // (forget_strings relies on that order), with room for at least count strings.
+ // Returns false if out of memory; the old index is then kept.
+ bool index_strings(MeetingScheduler *scheduler, uint32_t count) {
+     uint32_t stored = 0;
+     for (uint32_t offset = 0; offset < scheduler->strings_len; offset += strlen(scheduler->strings + offset) + 1)
+         stored++;
+     if (count < stored)
+         count = stored;
+     uint32_t size = 16;
+     while (size < count * 2)
+         size *= 2;
+     uint32_t *index = malloc(size * sizeof(uint32_t));
+     if (!index)
+         return false;
+     memset(index, 0xff, size * sizeof(uint32_t)); // Every slot STRING_SLOT_EMPTY
+     free(scheduler->string_index);
+     scheduler->string_index = index;
+     scheduler->string_index_size = size;
+     scheduler->string_count = 0;
+     for (uint32_t offset = 0; offset < scheduler->strings_len;
+          offset += strlen(scheduler->strings + offset) + 1) {
+         uint32_t slot = string_slot(scheduler, scheduler->strings + offset);
+         if (index[slot] == STRING_SLOT_EMPTY) { // Old snapshots may hold a string twice
+             index[slot] = offset;
+             scheduler->string_count++;
          }
-         strcat(buffer, "</tbody></table>"); // End table
-     }
-     // Add print button and link
-     strcat(buffer, "<div class='no-print mt-4'><button class='btn btn-info' onclick='window.print()'>Print to PDF</button></div>");
-     strcat(buffer, "<p class='mt-2'><a href='/'>Return to Main Page</a></p>");
-     strcat(buffer, "</div></body></html>");
-     return buffer; // Return HTML string
- }
- 
- // Generates an ICS file for calendar apps
- char *generate_ics(MeetingScheduler *scheduler) {
-     // Allocate memory for ICS content
-     char *ics = malloc(16384);
-     if (!ics) return NULL;
-     ics[0] = '\0'; // Start empty
- 
-     // ICS header
-     strcat(ics, "BEGIN:VCALENDAR\r\n");
-     strcat(ics, "PRODID:-//Meeting Scheduler//xAI//EN\r\n");
-     strcat(ics, "VERSION:2.0\r\n");
- 
-     // Set base date (Monday, April 14, 2025)
-     struct tm base_date = {0};
-     base_date.tm_year = 2025 - 1900; // Years since 1900
-     base_date.tm_mon = 3; // April (0=Jan)
-     base_date.tm_mday = 14;
-     base_date.tm_hour = 0;
-     base_date.tm_min = 0;
-     base_date.tm_sec = 0;
-     mktime(&base_date); // Normalize date
- 
-     char event[512]; // Buffer for each event
-     // Add meetings
-     for (int i = 0; i < scheduler->schedule_count; i++) {
-         ScheduleEntry *s = &scheduler->schedule[i];
-         struct tm dtstart = base_date;
-         dtstart.tm_mday += s->day + s->week * 7; // Add day and week offset
-         int hour = s->start_time / 2 + 9; // Convert slot to hour
-         if (s->start_time >= 6)
-             hour++; // Skip break
-         dtstart.tm_hour = hour;
-         dtstart.tm_min = (s->start_time % 2) * 30; // Set minutes
-         mktime(&dtstart); // Normalize
-         char dtstart_str[32];
-         strftime(dtstart_str, sizeof(dtstart_str), "%Y%m%dT%H%M%S", &dtstart); // Format date
-         // Build event
-         snprintf(event, sizeof(event),
-                  "BEGIN:VEVENT\r\nSUMMARY:%s (%s)\r\nDTSTART:%s\r\nDURATION:PT%dM\r\nRRULE:FREQ=WEEKLY\r\n"
-                  "DESCRIPTION:Type: %s, Duration: %d min, Frequency: %s\r\nEND:VEVENT\r\n",
-                  s->name, s->type, dtstart_str, s->duration * 30, s->type, s->duration * 30, s->frequency);
-         strcat(ics, event);
-     }
- 
-     // Add reservations
-     for (int i = 0; i < scheduler->reservation_count; i++) {
-         Reservation *r = &scheduler->reservations[i];
-         struct tm dtstart = base_date;
-         int day_idx = find_day_index(r->day);
-         dtstart.tm_mday += day_idx;
-         int start_idx = find_slot_index(r->start_time);
-         dtstart.tm_hour = start_idx / 2 + 9;
-         if (start_idx >= 6)
-             dtstart.tm_hour++;
-         dtstart.tm_min = (start_idx % 2) * 30;
-         mktime(&dtstart);
-         char dtstart_str[32];
-         strftime(dtstart_str, sizeof(dtstart_str), "%Y%m%dT%H%M%S", &dtstart);
-         // Build reservation event
-         snprintf(event, sizeof(event),
-                  "BEGIN:VEVENT\r\nSUMMARY:Reserved (External)\r\nDTSTART:%s\r\nDURATION:PT%dM\r\nRRULE:FREQ=WEEKLY\r\n"
-                  "DESCRIPTION:External commitment, Duration: %d min\r\nEND:VEVENT\r\n",
-                  dtstart_str, r->duration * 30, r->duration * 30);
-         strcat(ics, event);
-     }
- 
-     strcat(ics, "END:VCALENDAR\r\n"); // End ICS
-     return ics;
+     }
+     return true;
+ }
+
+ // Returns the offset of text in the string arena, adding it if it is not there yet.
+ // Returns UINT32_MAX if out of memory.
+ uint32_t intern_string(MeetingScheduler *scheduler, const char *text) {
+     if (scheduler->string_count + 1 > scheduler->string_index_size / 2 &&
+         !index_strings(scheduler, scheduler->string_count + 1))
+         return UINT32_MAX;
+     uint32_t slot = string_slot(scheduler, text);
+     if (scheduler->string_index[slot] != STRING_SLOT_EMPTY)
+         return scheduler->string_index[slot]; // Already stored
+     uint32_t len = strlen(text) + 1; // Include the '\0'
+     if (scheduler->strings_len + len > scheduler->strings_capacity) {
+         uint32_t new_capacity = scheduler->strings_capacity ? scheduler->strings_capacity * 2 : 1024;
+         while (new_capacity < scheduler->strings_len + len)
+             new_capacity *= 2;
+         char *bigger = realloc(scheduler->strings, new_capacity);
+         if (!bigger)
+             return UINT32_MAX;
+         scheduler->strings = bigger;
+         scheduler->strings_capacity = new_capacity;
+     }
+     uint32_t offset = scheduler->strings_len;
+     memcpy(scheduler->strings + offset, text, len);
+     scheduler->strings_len += len;
+     scheduler->string_index[slot] = offset;
+     scheduler->string_count++;
+     return offset;
+ }
+
+ // Forgets the strings stored after the first strings_len bytes (the ones a change that
+ // failed added). They were the last ones to go into string_index, after every string
+ // kept, so emptying their slots leaves the index as if they had never been added.
+ void forget_strings(MeetingScheduler *scheduler, uint32_t strings_len) {
+     for (uint32_t offset = strings_len; offset < scheduler->strings_len;
+          offset += strlen(scheduler->strings + offset) + 1) {
+         scheduler->string_index[string_slot(scheduler, scheduler->strings + offset)] = STRING_SLOT_EMPTY;
+         scheduler->string_count--;
+     }
+     scheduler->strings_len = strings_len;
+ }
+
+ // Returns a string stored by intern_string
+ const char *scheduler_string(const MeetingScheduler *scheduler, uint32_t offset) {
+     return scheduler->strings + offset;
+ }
+
+ // Stores again only the strings still in use (attendee names, and names and types of
+ // meetings that were not deleted), so the arena does not keep every name ever used.
+ // Offsets change. Returns false if out of memory; the scheduler is then unchanged.
+ bool compact_strings(MeetingScheduler *scheduler) {
+     MeetingScheduler fresh; // Only its arena is used
+     memset(&fresh, 0, sizeof(fresh));
+     int attendees = scheduler->attendee_count;
+     int meetings = scheduler->meeting_count;
+     // New offsets: one per attendee, then name and type of each meeting
+     uint32_t *offsets = malloc(((size_t)attendees + 2 * (size_t)meetings + 1) * sizeof(uint32_t));
+     bool ok = offsets != NULL;
+     for (int a = 0; ok && a < attendees; a++) {
+         offsets[a] = intern_string(&fresh, scheduler_string(scheduler, scheduler->attendee_names[a]));
+         ok = offsets[a] != UINT32_MAX;
+     }
+     for (int i = 0; ok && i < meetings; i++) {
+         const MeetingRecord *m = &scheduler->meetings[i];
+         bool deleted = m->duration == 0; // Never shown again (see meeting_deleted): name not kept
+         uint32_t *pair = offsets + attendees + 2 * i;
+         pair[0] = intern_string(&fresh, deleted ? "" : scheduler_string(scheduler, m->name));
+         pair[1] = intern_string(&fresh, deleted ? "" : scheduler_string(scheduler, m->type));
+         ok = pair[0] != UINT32_MAX && pair[1] != UINT32_MAX;
+     }
+     if (ok) {
+         for (int a = 0; a < attendees; a++)
+             scheduler->attendee_names[a] = offsets[a];
+         for (int i = 0; i < meetings; i++) {
+             scheduler->meetings[i].name = offsets[attendees + 2 * i];
+             scheduler->meetings[i].type = offsets[attendees + 2 * i + 1];
+         }
+         free(scheduler->strings);
+         free(scheduler->string_index);
+         scheduler->strings = fresh.strings;
+         scheduler->strings_len = fresh.strings_len;
+         scheduler->strings_capacity = fresh.strings_capacity;
+         scheduler->string_index = fresh.string_index;
+         scheduler->string_index_size = fresh.string_index_size;
+         scheduler->string_count = fresh.string_count;
+     } else {
+         free(fresh.strings);
+         free(fresh.string_index);
+     }
+     free(offsets);
+     return ok;
  }
  
  // -------------------------
- // WEB SERVER
+ // ATTENDEES
  // -------------------------
  
- // Handles web requests (like clicking a link or submitting a form)
- static enum MHD_Result answer_to_connection(void *cls, struct MHD_Connection *connection,
-     const char *url, const char *method, const char *version, const char *upload_data,
-     size_t *upload_data_size, void **con_cls) {
-     (void)version; (void)upload_data; (void)con_cls; // Unused parameters
-     struct MHD_Response *response; // HTTP response object
-     int ret; // Return code
-     char *page = NULL; // HTML content to send
+ // A meeting can list the people who attend it. Every attendee has booked slots of their
+ // own (attendee_slots), and a meeting with attendees books only theirs, so two meetings
+ // with nobody in common can be at the same time. A meeting without attendees is for
+ // everyone: like a reservation, it books blocked_slots, which every meeting keeps clear of.
+ // attendee_busy is the OR of all the attendees' slots, so that meetings for everyone and
+ // reservations (start_masks) keep clear of every attendee's meetings in turn.
+ // Attendees are named the first time a meeting lists them and keep their number (their bit
+ // in an AttendeeSet) from then on; only clearing the schedule forgets them.
+ // To place a meeting with attendees, their booked slots are first ORed together into one
+ // SlotMask per week/day (attendee_starts): one attendee at a time, over every week/day in
+ // a straight loop of whole words that the compiler turns into vector instructions. After
+ // that, each day and phase choose_placement checks costs the same as for a meeting for
+ // everyone (one AND per week), however many people attend.
+ 
+ // Number of the lowest attendee in a set (set must not be 0)
+ int first_attendee(AttendeeSet set) {
+     return __builtin_ctzll(set);
+ }
  
-     MeetingScheduler *scheduler = (MeetingScheduler *)cls; // Get scheduler from cls
+ // Booked slots of attendee a, one SlotMask per week/day (indexed by day_cell)
+ SlotMask *attendee_row(const MeetingScheduler *scheduler, int a) {
+     return scheduler->attendee_slots + (size_t)a * calendar.weeks * calendar.days;
+ }
  
-     // Main page: shows forms
-     if (strcmp(url, "/") == 0) {
-         // Allocate and copy HTML for main page
-         page = strdup(
-             "<!DOCTYPE html>"
-             "<html lang='en'><head><meta charset='utf-8'><meta name='viewport' content='width=device-width, initial-scale=1'>"
-             "<title>Meeting Scheduler</title>"
-             "<link rel='stylesheet' href='https://stackpath.bootstrapcdn.com/bootstrap/4.5.2/css/bootstrap.min.css'>"
-             "</head><body><div class='container mt-4'>"
-             "<h1>Meeting Scheduler</h1><hr>"
-             "<h3>Add Reservation</h3>"
-             "<form action='/addReservation' method='get'>"
-               "<div class='form-group'><label>Day</label>"
-               "<select name='day' class='form-control'>"
-                 "<option>Monday</option><option>Tuesday</option><option>Wednesday</option><option>Thursday</option>"
-               "</select></div>"
-               "<div class='form-group'><label>Start Time</label>"
-               "<input type='time' name='start_time' class='form-control' value='09:00'></div>"
-               "<div class='form-group'><label>Duration (minutes)</label>"
-               "<select name='duration' class='form-control'>"
-                 "<option value='30'>30</option><option value='60'>60</option><option value='90'>90</option>"
-               "</select></div>"
-               "<button type='submit' class='btn btn-primary'>Add Reservation</button>"
-             "</form><hr>"
-             "<h3>Add Meeting</h3>"
-             "<form action='/addMeeting' method='get'>"
-               "<div class='form-group'><label>Meeting Name</label>"
-               "<input type='text' name='name' class='form-control' required></div>"
-               "<div class='form-group'><label>Meeting Type</label>"
-               "<select name='type' class='form-control' required>"
-                 "<option value='One-to-one'>One-to-one</option>"
-                 "<option value='Design'>Design</option>"
-                 "<option value='Management'>Management</option>"
-                 "<option value='Contractor'>Contractor</option>"
-                 "<option value='Client'>Client</option>"
-               "</select></div>"
-               "<div class='form-group'><label>Duration (minutes)</label>"
-               "<select name='duration' class='form-control'>"
-                 "<option value='30'>30</option><option value='60'>60</option><option value='90'>90</option>"
-               "</select></div>"
-               "<div class='form-group'><label>Preferred Times (comma separated e.g., 09:30,10:00)</label>"
-               "<input type='text' name='preferred_times' class='form-control'></div>"
-               "<div class='form-group'><label>Fixed Day (optional)</label>"
-               "<select name='fixed_day' class='form-control'>"
-                 "<option value=''>None</option>"
-                 "<option>Monday</option><option>Tuesday</option><option>Wednesday</option><option>Thursday</option>"
-               "</select></div>"
-               "<div class='form-group'><label>Fixed Time (optional)</label>"
-               "<input type='time' name='fixed_time' class='form-control'></div>"
-               "<div class='form-group'><label>Frequency</label>"
-               "<select name='frequency' class='form-control'>"
-                 "<option value='weekly'>Weekly</option><option value='fortnightly'>Fortnightly</option>"
-                 "<option value='third_week'>Third Week</option><option value='monthly'>Monthly</option>"
-               "</select></div>"
-               "<button type='submit' class='btn btn-primary'>Add Meeting</button>"
-             "</form><hr>"
-             "<h3>Schedule</h3>"
-             "<p><a class='btn btn-secondary' href='/displaySchedule'>View Schedule</a></p><hr>"
-             "<h3>Export ICS</h3>"
-             "<form action='/exportICS' method='get'>"
-               "<div class='form-group'><label>Filename</label>"
-               "<input type='text' name='filename' class='form-control' placeholder='schedule.ics' required></div>"
-               "<button type='submit' class='btn btn-primary'>Export ICS</button>"
-             "</form><hr>"
-             "<h3>Clear Session</h3>"
-             "<p><a class='btn btn-danger' href='/clearSession'>Clear All Meetings & Reservations</a></p>"
-             "</div></body></html>"
-         );
+ // Reads the next name of an attendee list (',' or ';' between names) into name, with the
+ // spaces around it trimmed and cut to MAX_STR - 1 bytes, and returns where the rest of the
+ // list starts. name is "" for an empty entry (e.g., the middle one of "Ann,,Bob").
+ const char *next_attendee_name(const char *list, char *name) {
+     while (*list == ' ') list++;
+     size_t len = strcspn(list, ",;"); // Length up to the next separator
+     size_t keep = len;
+     while (keep > 0 && list[keep - 1] == ' ')
+         keep--;
+     if (keep > MAX_STR - 1)
+         keep = MAX_STR - 1;
+     memcpy(name, list, keep);
+     name[keep] = '\0';
+     list += len;
+     return *list ? list + 1 : list; // Skip the separator
+ }
+ 
+ // Counts the names in an attendee list (a name given twice counts twice)
+ int count_attendee_names(const char *list) {
+     char name[MAX_STR];
+     int count = 0;
+     while (*list) {
+         list = next_attendee_name(list, name);
+         count += *name != '\0';
      }
-     // Add reservation
-     else if (strcmp(url, "/addReservation") == 0) {
-         // Get form data
-         const char *day = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "day");
-         const char *start_time = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "start_time");
-         const char *duration_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "duration");
-         bool success = false;
-         if (day && start_time && duration_str)
-             success = reserve_slot(scheduler, day, start_time, atoi(duration_str)); // Try to reserve
-         // Allocate response page
-         page = malloc(1024);
-         if (success)
-             snprintf(page, 1024, "<html><body><div class='container'><h3>Reservation added successfully.</h3>"
-                                  "<p><a href='/'>Return to Main Page</a></p></div></body></html>");
-         else
-             snprintf(page, 1024, "<html><body><div class='container'><h3>Failed to add reservation.</h3>"
-                                  "<p><a href='/'>Return to Main Page</a></p></div></body></html>");
+     return count;
+ }
+ 
+ // Finds an attendee by name; -1 if there is no such attendee yet
+ int find_attendee(const MeetingScheduler *scheduler, const char *name) {
+     for (int a = 0; a < scheduler->attendee_count; a++) {
+         if (strcmp(scheduler_string(scheduler, scheduler->attendee_names[a]), name) == 0)
+             return a;
      }
-     // Add meeting
-     else if (strcmp(url, "/addMeeting") == 0) {
-         Meeting meeting;
-         memset(&meeting, 0, sizeof(meeting)); // Clear meeting struct
-         // Initialize preferred_hours with -1
-         for (int i = 0; i < 8; i++) meeting.preferred_hours[i] = -1;
-         // Get form data
-         const char *name = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "name");
-         const char *type = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "type");
-         const char *duration_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "duration");
-         const char *pref_times = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "preferred_times");
-         const char *fixed_day = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "fixed_day");
-         const char *fixed_time = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "fixed_time");
-         const char *frequency = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "frequency");
-         // Fill meeting struct
-         if (name) strncpy(meeting.name, name, MAX_STR);
-         if (type) strncpy(meeting.type, type, MAX_STR);
-         if (duration_str) {
-             int dur = atoi(duration_str); // Convert string to number
-             if (dur == 30) meeting.duration = 1;
-             else if (dur == 60) meeting.duration = 2;
-             else if (dur == 90) meeting.duration = 3;
-             else meeting.duration = 1;
-         }
-         // Parse preferred times (e.g., "09:30,10:00")
-         if (pref_times && strlen(pref_times) > 0) {
-             char temp[256];
-             strncpy(temp, pref_times, 256);
-             char *token = strtok(temp, ","); // Split by comma
-             int idx = 0;
-             while (token && idx < 8) {
-                 int slot = find_slot_index(token);
-                 if (slot != -1)
-                     meeting.preferred_hours[idx++] = slot;
-                 token = strtok(NULL, ",");
-             }
-             if (idx < 8) meeting.preferred_hours[idx] = -1;
-         }
-         if (fixed_day && strlen(fixed_day) > 0)
-             strncpy(meeting.fixed_day, fixed_day, MAX_STR);
-         if (fixed_time && strlen(fixed_time) > 0)
-             strncpy(meeting.fixed_time, fixed_time, MAX_STR);
-         if (frequency) strncpy(meeting.frequency, frequency, MAX_STR);
-         // Try to add meeting
-         bool success = add_meeting(scheduler, &meeting);
-         page = malloc(1024);
-         if (success)
-             snprintf(page, 1024, "<html><body><div class='container'><h3>Meeting added successfully.</h3>"
-                                  "<p><a href='/'>Return to Main Page</a></p></div></body></html>");
-         else
-             snprintf(page, 1024, "<html><body><div class='container'><h3>Failed to add meeting.</h3>"
-                                  "<p><a href='/'>Return to Main Page</a></p></div></body></html>");
+     return -1;
+ }
+ 
+ // Names a new attendee, with nothing booked. Returns their number, or -1 if there is no
+ // room for more (MAX_ATTENDEES) or out of memory.
+ int add_attendee(MeetingScheduler *scheduler, const char *name) {
+     size_t cells = (size_t)calendar.weeks * calendar.days;
+     if (scheduler->attendee_count == MAX_ATTENDEES ||
+         !grow_array((void **)&scheduler->attendee_slots, &scheduler->attendee_capacity,
+                     scheduler->attendee_count + 1, cells * sizeof(SlotMask)))
+         return -1;
+     uint32_t offset = intern_string(scheduler, name);
+     if (offset == UINT32_MAX)
+         return -1;
+     int a = scheduler->attendee_count++;
+     scheduler->attendee_names[a] = offset;
+     memset(attendee_row(scheduler, a), 0, cells * sizeof(SlotMask));
+     return a;
+ }
+ 
+ // Works out the set of attendees in a list, naming the ones the scheduler does not know
+ // yet. Returns false if there is no room for them or out of memory (some of them may have
+ // been named by then; add_meeting forgets them again); *no_room (if not NULL) says which.
+ bool attendee_set(MeetingScheduler *scheduler, const char *list, AttendeeSet *set, bool *no_room) {
+     char name[MAX_STR];
+     *set = 0;
+     while (*list) {
+         list = next_attendee_name(list, name);
+         if (!*name)
+             continue;
+         int a = find_attendee(scheduler, name);
+         if (a < 0)
+             a = add_attendee(scheduler, name);
+         if (a < 0) {
+             if (no_room)
+                 *no_room = scheduler->attendee_count == MAX_ATTENDEES; // Otherwise out of memory
+             return false;
+         }
+         *set |= (AttendeeSet)1 << a;
      }
-     // Show schedule
-     else if (strcmp(url, "/displaySchedule") == 0) {
-         page = generate_schedule_html(scheduler); // Generate HTML
+     return true;
+ }
+ 
+ // attendee_set without changing scheduler (see dry_run): a name it does not know gets the
+ // next number after its attendees, the first time it turns up, and is kept in extra
+ // (*extra_count names so far). Returns false if there would be more than MAX_ATTENDEES.
+ bool fork_attendee_set(const MeetingScheduler *scheduler, const char *list, char (*extra)[MAX_STR],
+                        int *extra_count, AttendeeSet *set) {
+     char name[MAX_STR];
+     *set = 0;
+     while (*list) {
+         list = next_attendee_name(list, name);
+         if (!*name)
+             continue;
+         int a = find_attendee(scheduler, name);
+         for (int k = 0; a < 0 && k < *extra_count; k++) {
+             if (strcmp(extra[k], name) == 0)
+                 a = scheduler->attendee_count + k;
+         }
+         if (a < 0) {
+             if (scheduler->attendee_count + *extra_count == MAX_ATTENDEES)
+                 return false;
+             memcpy(extra[*extra_count], name, MAX_STR);
+             a = scheduler->attendee_count + (*extra_count)++;
+         }
+         *set |= (AttendeeSet)1 << a;
      }
-     // Export ICS
-     else if (strcmp(url, "/exportICS") == 0) {
-         char *ics = generate_ics(scheduler); // Generate ICS
-         // Create response for download
-         struct MHD_Response *ics_resp = MHD_create_response_from_buffer(strlen(ics), (void*)ics, MHD_RESPMEM_MUST_FREE);
-         MHD_add_response_header(ics_resp, "Content-Type", "text/calendar");
-         MHD_add_response_header(ics_resp, "Content-Disposition", "attachment; filename=\"schedule.ics\"");
-         ret = MHD_queue_response(connection, MHD_HTTP_OK, ics_resp);
-         MHD_destroy_response(ics_resp);
-         return ret; // Send file directly
+     return true;
+ }
+ 
+ // The attendees of a list the scheduler knows (the others have nothing booked anyway)
+ AttendeeSet known_attendee_set(const MeetingScheduler *scheduler, const char *list) {
+     char name[MAX_STR];
+     AttendeeSet set = 0;
+     while (*list) {
+         list = next_attendee_name(list, name);
+         int a = *name ? find_attendee(scheduler, name) : -1;
+         if (a >= 0)
+             set |= (AttendeeSet)1 << a;
      }
-     // Clear schedule
-     else if (strcmp(url, "/clearSession") == 0) {
-         init_scheduler(scheduler); // Reset everything
-         page = strdup("<html><body><div class='container'><h3>Session Cleared.</h3>"
-                       "<p><a href='/'>Return to Main Page</a></p></div></body></html>");
+     return set;
+ }
+ 
+ // Writes the names of a set of attendees into out (size bytes) with separator between
+ // them; "" for an empty set. Names that do not fit are left out.
+ void format_attendee_names(const MeetingScheduler *scheduler, AttendeeSet set, const char *separator,
+                            char *out, size_t size) {
+     size_t len = 0;
+     out[0] = '\0';
+     for (AttendeeSet left = set; left; left &= left - 1) {
+         const char *name = scheduler_string(scheduler, scheduler->attendee_names[first_attendee(left)]);
+         size_t need = (len ? strlen(separator) : 0) + strlen(name);
+         if (len + need >= size)
+             return;
+         len += (size_t)snprintf(out + len, size - len, "%s%s", len ? separator : "", name);
      }
-     // Unknown URL
-     else {
-         page = strdup("<html><body><h3>404 Not Found</h3></body></html>");
+ }
+ 
+ // Books window on one week/day for each of attendees
+ void book_attendees(MeetingScheduler *scheduler, AttendeeSet attendees, int cell, SlotMask window) {
+     for (AttendeeSet left = attendees; left; left &= left - 1) // One attendee at a time
+         attendee_row(scheduler, first_attendee(left))[cell] |= window;
+     scheduler->attendee_busy[cell] |= window;
+     update_start_masks(scheduler, cell);
+ }
+ 
+ // Frees window on one week/day for each of attendees
+ void free_attendees(MeetingScheduler *scheduler, AttendeeSet attendees, int cell, SlotMask window) {
+     for (AttendeeSet left = attendees; left; left &= left - 1)
+         attendee_row(scheduler, first_attendee(left))[cell] &= ~window;
+     // Other attendees may have meetings in those slots too: OR everyone's again
+     SlotMask busy = 0;
+     for (int a = 0; a < scheduler->attendee_count; a++)
+         busy |= attendee_row(scheduler, a)[cell];
+     scheduler->attendee_busy[cell] = busy;
+     update_start_masks(scheduler, cell);
+ }
+ 
+ // Fills starts (one SlotMask per week/day, by day_cell) with the slots where a meeting of
+ // duration_slots for attendees could start: free for every one of them, and clear of
+ // reservations and meetings for everyone
+ void attendee_starts(const MeetingScheduler *scheduler, AttendeeSet attendees, int duration_slots, SlotMask *starts) {
+     int cells = calendar.weeks * calendar.days;
+     memcpy(starts, scheduler->blocked_slots, cells * sizeof(SlotMask));
+     for (AttendeeSet left = attendees; left; left &= left - 1) {
+         const SlotMask *row = attendee_row(scheduler, first_attendee(left));
+         for (int c = 0; c < cells; c++)
+             starts[c] |= row[c];
      }
+     for (int c = 0; c < cells; c++)
+         starts[c] = free_starts(starts[c], duration_slots);
+ }
  
-     // Create and send response
-     response = MHD_create_response_from_buffer(strlen(page), (void *)page, MHD_RESPMEM_MUST_FREE);
-     ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
-     MHD_destroy_response(response);
-     return ret;
+ // Start slots free for a meeting of duration_slots for attendees (0 = everyone) on one week/day
+ SlotMask meeting_start_mask(const MeetingScheduler *scheduler, AttendeeSet attendees, int week, int day_idx,
+                             int duration_slots) {
+     if (!attendees)
+         return start_mask(scheduler, week, day_idx, duration_slots);
+     int cell = day_cell(week, day_idx);
+     SlotMask busy = scheduler->blocked_slots[cell];
+     for (AttendeeSet left = attendees; left; left &= left - 1)
+         busy |= attendee_row(scheduler, first_attendee(left))[cell];
+     return free_starts(busy, duration_slots);
  }
  
  // -------------------------
- // MAIN PROGRAM
+ // MEETINGS AND RESERVATIONS
  // -------------------------
  
- int main(void) {
-     srand(time(NULL)); // Seed random numbers for week shuffling
-     MeetingScheduler scheduler; // Create scheduler
-     init_scheduler(&scheduler); // Initialize it
+ // Packs a meeting into the record at index meeting_count (making room for it), without
+ // counting it yet: add_meeting only does that once the meeting has been placed. Attendees
+ // it names for the first time are named here (see attendee_set).
+ // Returns false if out of memory or there is no room for its attendees; *no_room (if not
+ // NULL) says which.
+ bool prepare_meeting_record(MeetingScheduler *scheduler, const Meeting *meeting, bool *no_room) {
+     if (no_room)
+         *no_room = false;
+     if (!grow_array((void **)&scheduler->meetings, &scheduler->meeting_capacity,
+                     scheduler->meeting_count + 1, sizeof(MeetingRecord)) ||
+         !grow_array((void **)&scheduler->placements, &scheduler->placement_capacity,
+                     scheduler->meeting_count + 1, sizeof(Placement)))
+         return false;
+     scheduler->placements[scheduler->meeting_count].phase = -1; // Not placed yet
+     MeetingRecord *record = &scheduler->meetings[scheduler->meeting_count];
+     memset(record, 0, sizeof(*record)); // Padding too, as snapshots store records as they are
+     record->name = intern_string(scheduler, meeting->name);
+     record->type = intern_string(scheduler, meeting->type);
+     if (record->name == UINT32_MAX || record->type == UINT32_MAX ||
+         !attendee_set(scheduler, meeting->attendees, &record->attendees, no_room))
+         return false;
+     record->duration = (uint8_t)meeting->duration;
+     record->frequency = (uint8_t)meeting->frequency;
+     record->fixed_day = (int8_t)meeting->fixed_day;
+     record->fixed_time = (int8_t)meeting->fixed_time;
+     for (int i = 0; i < 8; i++)
+         record->preferred_hours[i] = (int8_t)meeting->preferred_hours[i];
+     return true;
+ }
+ 
+ // Checks if a meeting was deleted (see delete_meeting)
+ bool meeting_deleted(const MeetingScheduler *scheduler, int meeting_id) {
+     return scheduler->meetings[meeting_id].duration == 0;
+ }
+ 
+ // Unpacks a stored meeting back into a Meeting
+ void load_meeting(const MeetingScheduler *scheduler, int meeting_id, Meeting *meeting) {
+     const MeetingRecord *record = &scheduler->meetings[meeting_id];
+     copy_field(meeting->name, scheduler_string(scheduler, record->name));
+     copy_field(meeting->type, scheduler_string(scheduler, record->type));
+     meeting->duration = record->duration;
+     meeting->frequency = (Frequency)record->frequency;
+     meeting->fixed_day = record->fixed_day;
+     meeting->fixed_time = record->fixed_time;
+     for (int i = 0; i < 8; i++)
+         meeting->preferred_hours[i] = record->preferred_hours[i];
+     format_attendee_names(scheduler, record->attendees, ";", meeting->attendees, sizeof(meeting->attendees));
+ }
+ 
+ // Books the slots of one meeting occurrence (for everyone, or just for its attendees) and
+ // adds its hours to its day. This is all of add_schedule_entry that placing decisions
+ // look at (see dry_run).
+ void occupy_slots(MeetingScheduler *scheduler, int week, int day_idx, int start_idx, int duration_slots,
+                   AttendeeSet attendees) {
+     scheduler->total_hours[day_idx] += slots_to_hours(duration_slots); // Add hours
+     scheduler->meeting_hours[day_idx] += slots_to_hours(duration_slots); // Add meeting hours
+     day_load_changed(scheduler->day_heap, scheduler->day_heap_pos, calendar.days, scheduler->total_hours, day_idx);
+     // Mark slots as booked
+     if (attendees)
+         book_attendees(scheduler, attendees, day_cell(week, day_idx), slot_window(start_idx, duration_slots));
+     else
+         block_slots(scheduler, day_cell(week, day_idx), slot_window(start_idx, duration_slots));
+ }
+ 
+ // Adds one occurrence of meeting meeting_id to the schedule: stores the entry, books its
+ // slots, updates the hour totals and links it into its week/day list.
+ // There must be room for it: every caller first grows schedule (see grow_array) for all
+ // the entries it is about to add.
+ void add_schedule_entry(MeetingScheduler *scheduler, int meeting_id, int week, int day_idx, int start_idx) {
+     MeetingRecord *meeting = &scheduler->meetings[meeting_id];
+     int idx = scheduler->schedule_count++; // Next free slot
+     ScheduleEntry *entry = &scheduler->schedule[idx];
+     entry->week = (uint8_t)week;
+     entry->day = (uint8_t)day_idx;
+     entry->start_time = (uint8_t)start_idx;
+     entry->meeting_id = (uint32_t)meeting_id;
+     entry->next_in_day = -1;
+     // Each day's list is in meeting order (the order meetings were added in), so a moved
+     // meeting goes back in between; a new meeting simply goes at the end
+     int cell = day_cell(week, day_idx);
+     int last = scheduler->day_last[cell];
+     if (last < 0) {
+         scheduler->day_first[cell] = scheduler->day_last[cell] = idx;
+     } else if (scheduler->schedule[last].meeting_id < (uint32_t)meeting_id) {
+         scheduler->schedule[last].next_in_day = idx;
+         scheduler->day_last[cell] = idx;
+     } else {
+         int *link = &scheduler->day_first[cell];
+         while (scheduler->schedule[*link].meeting_id < (uint32_t)meeting_id)
+             link = &scheduler->schedule[*link].next_in_day;
+         entry->next_in_day = *link;
+         *link = idx;
+     }
+     // The first week it meets in gives its placement
+     Placement *p = &scheduler->placements[meeting_id];
+     if (p->phase < 0 || week < p->phase) {
+         p->day = (int8_t)day_idx;
+         p->start = (int8_t)start_idx;
+         p->phase = (int8_t)week;
+     }
+     occupy_slots(scheduler, week, day_idx, start_idx, meeting->duration, meeting->attendees);
+ }
+ 
+ // Takes entry idx off the schedule: frees exactly its slots, takes its hours off its day
+ // and unlinks it. The last entry moves into its place, so the array stays packed.
+ void remove_schedule_entry(MeetingScheduler *scheduler, int idx) {
+     ScheduleEntry *entry = &scheduler->schedule[idx];
+     int duration = scheduler->meetings[entry->meeting_id].duration;
+     AttendeeSet attendees = scheduler->meetings[entry->meeting_id].attendees;
+     int cell = day_cell(entry->week, entry->day);
+     int prev = -1;
+     for (int i = scheduler->day_first[cell]; i != idx; i = scheduler->schedule[i].next_in_day)
+         prev = i;
+     if (prev >= 0)
+         scheduler->schedule[prev].next_in_day = entry->next_in_day;
+     else
+         scheduler->day_first[cell] = entry->next_in_day;
+     if (scheduler->day_last[cell] == idx)
+         scheduler->day_last[cell] = prev;
+     if (attendees) {
+         free_attendees(scheduler, attendees, cell, slot_window(entry->start_time, duration));
+     } else {
+         scheduler->blocked_slots[cell] &= ~slot_window(entry->start_time, duration);
+         update_start_masks(scheduler, cell);
+     }
+     scheduler->total_hours[entry->day] -= slots_to_hours(duration);
+     scheduler->meeting_hours[entry->day] -= slots_to_hours(duration);
+     day_load_changed(scheduler->day_heap, scheduler->day_heap_pos, calendar.days, scheduler->total_hours, entry->day);
+     // Move the last entry into the hole: whatever pointed at it now points at idx
+     int last = --scheduler->schedule_count;
+     if (idx == last)
+         return;
+     ScheduleEntry *moved = &scheduler->schedule[last];
+     int moved_cell = day_cell(moved->week, moved->day);
+     int *link = &scheduler->day_first[moved_cell];
+     while (*link != last)
+         link = &scheduler->schedule[*link].next_in_day;
+     *link = idx;
+     if (scheduler->day_last[moved_cell] == last)
+         scheduler->day_last[moved_cell] = idx;
+     *entry = *moved;
+ }
+ 
+ // Takes every occurrence of a meeting off the schedule (its record stays)
+ void unplace_meeting(MeetingScheduler *scheduler, int meeting_id) {
+     Placement *p = &scheduler->placements[meeting_id];
+     int period = FREQ_PERIOD[scheduler->meetings[meeting_id].frequency];
+     // Its entries are found through the placement, in the lists of just the days it is on
+     for (int week = p->phase; week >= 0 && week < calendar.weeks; week += period) {
+         int i = scheduler->day_first[day_cell(week, p->day)];
+         while (i >= 0 && scheduler->schedule[i].meeting_id != (uint32_t)meeting_id)
+             i = scheduler->schedule[i].next_in_day;
+         if (i >= 0)
+             remove_schedule_entry(scheduler, i);
+     }
+     p->phase = -1;
+ }
+ 
+ // Removes every scheduled meeting occurrence but keeps the meetings list and reservations,
+ // so the meetings can be placed again from scratch
+ void clear_placements(MeetingScheduler *scheduler) {
+     scheduler->schedule_count = 0;
+     for (int i = 0; i < scheduler->meeting_count; i++)
+         scheduler->placements[i].phase = -1;
+     for (int day = 0; day < calendar.days; day++) {
+         scheduler->total_hours[day] = scheduler->meeting_hours[day] = 0;
+         for (int week = 0; week < calendar.weeks; week++) {
+             int cell = day_cell(week, day);
+             scheduler->blocked_slots[cell] = scheduler->attendee_busy[cell] = 0;
+             scheduler->day_first[cell] = scheduler->day_last[cell] = -1;
+         }
+     }
+     if (scheduler->attendee_count > 0)
+         memset(scheduler->attendee_slots, 0,
+                (size_t)scheduler->attendee_count * calendar.weeks * calendar.days * sizeof(SlotMask));
+     // Reservations stay where they are (deleted ones have no slots or hours)
+     for (int i = 0; i < scheduler->reservation_count; i++) {
+         Reservation *r = &scheduler->reservations[i];
+         for (int week = 0; week < calendar.weeks; week++)
+             scheduler->blocked_slots[day_cell(week, r->day)] |= slot_window(r->start_time, r->duration);
+         scheduler->total_hours[r->day] += slots_to_hours(r->duration) * calendar.weeks;
+     }
+     for (int cell = 0; cell < calendar.weeks * calendar.days; cell++)
+         update_start_masks(scheduler, cell);
+     heap_build(scheduler->day_heap, scheduler->day_heap_pos, calendar.days, scheduler->total_hours);
+ }
+ 
+ // Index a new reservation gets: the first deleted one, or else the next one at the end
+ // (-1 if there is no room left)
+ int free_reservation_index(const MeetingScheduler *scheduler) {
+     for (int i = 0; i < scheduler->reservation_count; i++) {
+         if (scheduler->reservations[i].duration == 0)
+             return i;
+     }
+     return scheduler->reservation_count < MAX_RESERVATIONS ? scheduler->reservation_count : -1;
+ }
+ 
+ // Reserves a time slot across all weeks (e.g., for external commitments)
+ // (day_idx and start_idx as found by find_day_index / find_slot_index)
+ // Says why a reservation cannot be made, or returns NULL if it can
+ const char *reservation_problem(MeetingScheduler *scheduler, int day_idx, int start_idx, int duration_slots) {
+     // Check if inputs are valid
+     if (day_idx < 0 || day_idx >= calendar.days)
+         return "unknown day";
+     if (free_reservation_index(scheduler) < 0)
+         return "there is no room for more reservations";
+     if (start_idx < 0 || start_idx >= calendar.slots)
+         return "unknown start time";
+     if (duration_slots < 1 || duration_slots > calendar.max_duration)
+         return "invalid duration";
+     if (!(calendar.fits_mask[duration_slots] & slot_window(start_idx, 1)))
+         return "it would run past the end of the day or into a break";
+     // Check if slots are free in all weeks
+     SlotMask starts = ~(SlotMask)0;
+     for (int week = 0; week < calendar.weeks; week++)
+         starts &= start_mask(scheduler, week, day_idx, duration_slots);
+     if (!(starts & slot_window(start_idx, 1)))
+         return "it clashes with a meeting or reservation in at least one week";
+     return NULL;
+ }
+ 
+ // Puts a reservation at index idx (a deleted one, or reservation_count to add one at the
+ // end) and books it. The caller has checked it fits (see reservation_problem).
+ void book_reservation(MeetingScheduler *scheduler, int idx, int day_idx, int start_idx, int duration_slots) {
+     // Book the slots in every week
+     SlotMask window = slot_window(start_idx, duration_slots);
+     for (int week = 0; week < calendar.weeks; week++)
+         block_slots(scheduler, day_cell(week, day_idx), window);
+     
+     if (idx == scheduler->reservation_count)
+         scheduler->reservation_count++;
+     Reservation *res = &scheduler->reservations[idx];
+     res->day = day_idx;
+     res->start_time = start_idx;
+     res->duration = duration_slots; // Set duration
+     res->next_in_day = -1;
+     // Link it into the day's list, which is in index order
+     int last = scheduler->reservation_last[day_idx];
+     if (last < 0) {
+         scheduler->reservation_first[day_idx] = scheduler->reservation_last[day_idx] = idx;
+     } else if (last < idx) {
+         scheduler->reservations[last].next_in_day = idx;
+         scheduler->reservation_last[day_idx] = idx;
+     } else {
+         int *link = &scheduler->reservation_first[day_idx];
+         while (*link < idx)
+             link = &scheduler->reservations[*link].next_in_day;
+         res->next_in_day = *link;
+         *link = idx;
+     }
+     scheduler->total_hours[day_idx] += slots_to_hours(duration_slots) * calendar.weeks; // Update hours
+     day_load_changed(scheduler->day_heap, scheduler->day_heap_pos, calendar.days, scheduler->total_hours, day_idx);
+ }
+ 
+ bool reserve_slot(MeetingScheduler *scheduler, int day_idx, int start_idx, int duration_slots) {
+     count_event(COUNT_RESERVATION_ATTEMPTS, 1);
+     if (reservation_problem(scheduler, day_idx, start_idx, duration_slots))
+         return false;
+     book_reservation(scheduler, free_reservation_index(scheduler), day_idx, start_idx, duration_slots);
+     count_event(COUNT_RESERVATIONS, 1);
+     return true; // Success
+ }
+ 
+ // Takes reservation idx off the calendar: frees its slots in every week and its hours.
+ // Its index stays, marked deleted, so the other reservations keep theirs.
+ // Returns false if there is no such reservation.
+ bool unreserve(MeetingScheduler *scheduler, int idx) {
+     if (idx < 0 || idx >= scheduler->reservation_count || scheduler->reservations[idx].duration == 0)
+         return false;
+     Reservation *res = &scheduler->reservations[idx];
+     SlotMask window = slot_window(res->start_time, res->duration);
+     for (int week = 0; week < calendar.weeks; week++) {
+         int cell = day_cell(week, res->day);
+         scheduler->blocked_slots[cell] &= ~window;
+         update_start_masks(scheduler, cell);
+     }
+     scheduler->total_hours[res->day] -= slots_to_hours(res->duration) * calendar.weeks;
+     day_load_changed(scheduler->day_heap, scheduler->day_heap_pos, calendar.days, scheduler->total_hours, res->day);
+     // Unlink it from its day's list
+     int prev = -1;
+     for (int i = scheduler->reservation_first[res->day]; i != idx; i = scheduler->reservations[i].next_in_day)
+         prev = i;
+     if (prev >= 0)
+         scheduler->reservations[prev].next_in_day = res->next_in_day;
+     else
+         scheduler->reservation_first[res->day] = res->next_in_day;
+     if (scheduler->reservation_last[res->day] == idx)
+         scheduler->reservation_last[res->day] = prev;
+     *res = (Reservation){0, 0, 0, -1}; // Deleted
+     return true;
+ }
+ 
+ // Moves reservation idx to another day and start (same duration). Returns NULL if it
+ // moved, otherwise why not (it then stays where it was).
+ const char *move_reservation(MeetingScheduler *scheduler, int idx, int day_idx, int start_idx) {
+     if (idx < 0 || idx >= scheduler->reservation_count || scheduler->reservations[idx].duration == 0)
+         return "unknown reservation";
+     Reservation old = scheduler->reservations[idx];
+     unreserve(scheduler, idx); // So it does not clash with itself
+     const char *problem = reservation_problem(scheduler, day_idx, start_idx, old.duration);
+     if (problem)
+         book_reservation(scheduler, idx, old.day, old.start_time, old.duration);
+     else
+         book_reservation(scheduler, idx, day_idx, start_idx, old.duration);
+     return problem;
+ }
+ 
+ // Checks if a time slot is free for a given week, day, and duration (and attendees, 0 = everyone)
+ bool is_valid_slot(MeetingScheduler *scheduler, int week, int day_idx, int start_idx, int duration_slots,
+                    AttendeeSet attendees) {
+     if (start_idx < 0 || start_idx >= calendar.slots)
+         return false;
+     return (meeting_start_mask(scheduler, attendees, week, day_idx, duration_slots) & slot_window(start_idx, 1)) != 0;
+ }
+ 
+ // Start slots free in every week a meeting with this period and phase meets in
+ SlotMask phase_starts(MeetingScheduler *scheduler, int period, int phase, int day_idx, int duration_slots) {
+     SlotMask starts = ~(SlotMask)0;
+     for (int week = phase; week < calendar.weeks && starts; week += period)
+         starts &= start_mask(scheduler, week, day_idx, duration_slots);
+     return starts;
+ }
+ 
+ // The same from a table of starts by day_cell (see attendee_starts)
+ SlotMask phase_starts_in(const SlotMask *starts_by_cell, int period, int phase, int day_idx) {
+     SlotMask starts = ~(SlotMask)0;
+     for (int week = phase; week < calendar.weeks && starts; week += period)
+         starts &= starts_by_cell[day_cell(week, day_idx)];
+     return starts;
+ }
+ 
+ // The same for a meeting with attendees (0 = everyone), for one phase and day
+ SlotMask attendee_phase_starts(MeetingScheduler *scheduler, AttendeeSet attendees, int period, int phase, int day_idx,
+                                int duration_slots) {
+     if (!attendees)
+         return phase_starts(scheduler, period, phase, day_idx, duration_slots);
+     SlotMask starts = ~(SlotMask)0;
+     for (int week = phase; week < calendar.weeks && starts; week += period)
+         starts &= meeting_start_mask(scheduler, attendees, week, day_idx, duration_slots);
+     return starts;
+ }
+ 
+ // What choose_placement looks for, worked out once per meeting (see check_day)
+ typedef struct {
+     const Meeting *meeting;
+     const SlotMask *starts;      // Free starts by day_cell for its attendees (see attendee_starts),
+                                  // NULL for a meeting for everyone (start_masks has those)
+     int phase_order[MAX_PERIOD]; // Phases to try, in this order
+     int phases;
+     int times[8];                // Start times to try, in this order (none = earliest free)
+     int time_count;
+ } PlacementQuery;
+ 
+ // What check_day found on one day
+ typedef struct {
+     int tried;  // Phases checked (0 = the day already has too many meetings)
+     int start;  // Start slot found, -1 = none
+     int phase;  // Phase it was found in
+ } DayChoice;
+ 
+ // Looks for a start on one day: the first phase (in the query's order) with a free
+ // time, and in it the first time that will do. Only reads the scheduler.
+ void check_day(MeetingScheduler *scheduler, const PlacementQuery *query, int day_idx, DayChoice *found) {
+     found->tried = 0;
+     found->start = -1;
+     // Skip days with too many meetings (>2.5 hr/week average)
+     if (scheduler->meeting_hours[day_idx] / calendar.weeks > 2.5)
+         return;
+     int period = FREQ_PERIOD[query->meeting->frequency];
+     for (int p = 0; p < query->phases && found->start == -1; p++) {
+         // Starts free in every week of the phase
+         found->tried++;
+         SlotMask starts = query->starts ? phase_starts_in(query->starts, period, query->phase_order[p], day_idx)
+                                         : phase_starts(scheduler, period, query->phase_order[p], day_idx,
+                                                        query->meeting->duration);
+         if (!starts)
+             continue;
+         if (query->time_count == 0) {
+             found->start = lowest_slot(starts); // Any time will do: take the earliest
+         } else {
+             for (int t = 0; t < query->time_count && found->start == -1; t++) {
+                 if (query->times[t] < calendar.slots && (starts & slot_window(query->times[t], 1)))
+                     found->start = query->times[t];
+             }
+         }
+         if (found->start != -1)
+             found->phase = query->phase_order[p];
+     }
+ }
+ 
+// Finds a day, time and weeks for a meeting with the given attendees (0 = everyone; see
+// ATTENDEES), respecting constraints. Looks only at the booked slots and hours (and draws
+// random numbers), so it also works on a fork_occupancy.
+// Returns COUNT_PLACEMENTS with the choice in *out, or the COUNT_FAILED_ reason;
+// *candidates is set to the day and phase pairs it checked.
+Counter choose_placement(MeetingScheduler *scheduler, const Meeting *meeting, AttendeeSet attendees, Placement *out,
+                         int *candidates) {
+    int fixed_day_idx = meeting->fixed_day; // Fixed day or -1
+    int fixed_time_idx = meeting->fixed_time; // Fixed time or -1
+    PlacementQuery query = {.meeting = meeting};
+
+    // With attendees, OR their booked slots together once, so checking a day below costs
+    // the same however many of them there are
+    SlotMask attendee_free[MAX_HORIZON_WEEKS * MAX_WEEK_DAYS];
+    if (attendees) {
+        attendee_starts(scheduler, attendees, meeting->duration, attendee_free);
+        query.starts = attendee_free;
+    }
+
+    // Phases to try (e.g., a fortnightly meeting in weeks 1, 3, ... or in weeks 2, 4, ...),
+    // shuffled for variety
+    query.phases = frequency_phases(meeting->frequency);
+    for (int i = 0; i < query.phases; i++) query.phase_order[i] = i;
+    for (int i = query.phases - 1; i > 0; i--) {
+        int j = random_below(scheduler, i + 1);
+        int temp = query.phase_order[i];
+        query.phase_order[i] = query.phase_order[j];
+        query.phase_order[j] = temp;
+    }
+
+    // Times to try, in order: the fixed time or the preferred times (none = any time,
+    // earliest first)
+    if (fixed_time_idx >= 0) {
+        query.times[query.time_count++] = fixed_time_idx;
+    } else {
+        for (int i = 0; i < 8 && meeting->preferred_hours[i] >= 0; i++)
+            query.times[query.time_count++] = meeting->preferred_hours[i];
+    }
+
+    // The allowed days, least busy first (from a copy of the day heap, so the scheduler's
+    // heap stays as it is)
+    int frontier[MAX_WEEK_DAYS];
+    int left = calendar.days;
+    int days[MAX_WEEK_DAYS];
+    int day_count = 0;
+    memcpy(frontier, scheduler->day_heap, calendar.days * sizeof(int));
+    while (left > 0) {
+        int day_idx = heap_pop(frontier, NULL, &left, scheduler->total_hours);
+        if (fixed_day_idx < 0 || day_idx == fixed_day_idx)
+            days[day_count++] = day_idx; // Otherwise only the fixed day will do
+    }
+
+    // Take the first day with room: no later day can be less busy. The days are checked
+    // here, one by one: even the longest calendar (104 weeks x 7 days) checks all its days
+    // in a few hundred nanoseconds (see "--bench scheduler"), less than it takes to wake
+    // another thread, so handing them to helper threads would only make it slower.
+    *candidates = 0;
+    bool day_open = false; // Was any allowed day below the daily meeting limit?
+    for (int i = 0; i < day_count; i++) {
+        DayChoice found;
+        check_day(scheduler, &query, days[i], &found);
+        *candidates += found.tried;
+        day_open |= found.tried > 0;
+        if (found.start >= 0) {
+            *out = (Placement){(int8_t)days[i], (int8_t)found.start, (int8_t)found.phase};
+            return COUNT_PLACEMENTS;
+        }
+    }
+
+    // No valid slot found
+    if (fixed_time_idx >= 0 && !(calendar.fits_mask[meeting->duration] & slot_window(fixed_time_idx, 1)))
+        return COUNT_FAILED_FIXED_TIME;
+    return day_open ? COUNT_FAILED_NO_SLOT : COUNT_FAILED_DAY_FULL;
+}
+
+// Places a meeting (see choose_placement) and adds its entries
+// (the meeting must already be stored as meeting_id; see add_meeting)
+bool place_meeting(MeetingScheduler *scheduler, Meeting *meeting, int meeting_id) {
+    Placement p;
+    int candidates;
+    Counter outcome = choose_placement(scheduler, meeting, scheduler->meetings[meeting_id].attendees, &p, &candidates);
+    count_event(COUNT_PLACEMENT_CANDIDATES, candidates);
+    if (outcome != COUNT_PLACEMENTS) {
+        count_event(outcome, 1); // Why it failed
+        return false;
+    }
+    // Schedule the meeting in every week of its phase
+    for (int week = p.phase; week < calendar.weeks; week += FREQ_PERIOD[meeting->frequency])
+        add_schedule_entry(scheduler, meeting_id, week, p.day, p.start);
+    return true; // Success
+}
+
+// Adds a meeting to the schedule, respecting constraints
+bool add_meeting(MeetingScheduler *scheduler, Meeting *meeting) {
+    // The most weeks it can meet in
+    int occurrences = frequency_occurrences(meeting->frequency, 0); // Phase 0 has the most weeks
+
+    // Store the meeting (uncounted until it is placed) and make room for its entries
+    count_event(COUNT_PLACEMENT_ATTEMPTS, 1);
+    int meeting_id = scheduler->meeting_count; // Id it gets if it can be placed
+    uint32_t strings_before = scheduler->strings_len; // To forget its strings if it fails
+    int attendees_before = scheduler->attendee_count; // ... and the attendees it named
+    bool no_room;
+    if (!prepare_meeting_record(scheduler, meeting, &no_room) ||
+        !grow_array((void **)&scheduler->schedule, &scheduler->schedule_capacity,
+                    scheduler->schedule_count + occurrences, sizeof(ScheduleEntry))) {
+        forget_strings(scheduler, strings_before);
+        scheduler->attendee_count = attendees_before;
+        count_event(no_room ? COUNT_FAILED_ATTENDEES : COUNT_FAILED_NO_MEMORY, 1);
+        return false; // Out of memory, or no room for its attendees
+    }
+    if (!place_meeting(scheduler, meeting, meeting_id)) {
+        forget_strings(scheduler, strings_before);
+        scheduler->attendee_count = attendees_before;
+        return false; // place_meeting counted why
+    }
+    scheduler->meeting_count++; // Keep the meeting
+    count_event(COUNT_PLACEMENTS, 1);
+    return true; // Success
+}
+
+// Says why a meeting for attendees (0 = everyone) found no placement, once there was room
+// for its attendees (see meeting_problem)
+const char *placement_problem(const MeetingScheduler *scheduler, const Meeting *meeting, AttendeeSet attendees) {
+    if (meeting->fixed_time >= 0 &&
+        !(calendar.fits_mask[meeting->duration] & slot_window(meeting->fixed_time, 1)))
+        return "at the fixed time it would run past the end of the day or into a break";
+    bool day_open = false; // Is any allowed day below the daily meeting limit?
+    for (int day = 0; day < calendar.days; day++) {
+        if ((meeting->fixed_day < 0 || day == meeting->fixed_day) &&
+            scheduler->meeting_hours[day] / calendar.weeks <= 2.5)
+            day_open = true;
+    }
+    if (!day_open)
+        return meeting->fixed_day >= 0 ? "the fixed day already has 2.5 hours of meetings per week"
+                                       : "every day already has 2.5 hours of meetings per week";
+    return attendees ? "no time slot is free for all its attendees in every week it would meet in"
+                     : "no time slot is free in every week it would meet in";
+}
+
+// Says why add_meeting could not place a meeting (call it after add_meeting failed)
+const char *meeting_problem(MeetingScheduler *scheduler, const Meeting *meeting) {
+    char new_names[MAX_ATTENDEES][MAX_STR];
+    int new_count = 0;
+    AttendeeSet attendees;
+    if (!fork_attendee_set(scheduler, meeting->attendees, new_names, &new_count, &attendees))
+        return "there is no room for more attendees";
+    return placement_problem(scheduler, meeting, attendees);
+}
+ 
+ // Deletes a meeting: its occurrences come off the calendar (freeing just their slots and
+ // hours) and its record is kept, marked deleted, so no other meeting's id changes.
+ // Returns false if there is no such meeting.
+ bool delete_meeting(MeetingScheduler *scheduler, int meeting_id) {
+     if (meeting_id < 0 || meeting_id >= scheduler->meeting_count || meeting_deleted(scheduler, meeting_id))
+         return false;
+     unplace_meeting(scheduler, meeting_id);
+     scheduler->meetings[meeting_id].duration = 0;
+     return true;
+ }
+ 
+ // Moves every occurrence of a meeting to another day and start, and to the weeks starting
+ // with week first_week (counted from 0; -1 keeps its weeks). Its fixed day and time still
+ // apply, and so does the daily meeting limit; its preferred times do not (this is an
+ // explicit choice). Returns NULL if it moved, otherwise why not (it then stays where it was),
+ // which is "out of memory" if there was no room for its entries.
+ const char *move_meeting(MeetingScheduler *scheduler, int meeting_id, int day_idx, int start_idx, int first_week) {
+     if (meeting_id < 0 || meeting_id >= scheduler->meeting_count || meeting_deleted(scheduler, meeting_id))
+         return "unknown meeting";
+     const MeetingRecord *m = &scheduler->meetings[meeting_id];
+     Placement old = scheduler->placements[meeting_id];
+     if (first_week < 0)
+         first_week = old.phase;
+     if (day_idx < 0 || day_idx >= calendar.days)
+         return "unknown day";
+     if (start_idx < 0 || start_idx >= calendar.slots)
+         return "unknown start time";
+     if (first_week >= frequency_phases((Frequency)m->frequency))
+         return "its frequency does not allow that first week";
+     if (m->fixed_day >= 0 && day_idx != m->fixed_day)
+         return "it has a fixed day";
+     if (m->fixed_time >= 0 && start_idx != m->fixed_time)
+         return "it has a fixed time";
+     if (!(calendar.fits_mask[m->duration] & slot_window(start_idx, 1)))
+         return "it would run past the end of the day or into a break";
+
+     // The new weeks may be more than the old ones (e.g., fortnightly in 5 weeks: 3 in the
+     // first phase, 2 in the second), so make room for the most it can have first
+     if (!grow_array((void **)&scheduler->schedule, &scheduler->schedule_capacity,
+                     scheduler->schedule_count + frequency_occurrences((Frequency)m->frequency, 0),
+                     sizeof(ScheduleEntry)))
+         return "out of memory";
+     // Take it off the calendar first, so it does not clash with itself, then put it
+     // back: at the new place if that is free, otherwise where it was
+     unplace_meeting(scheduler, meeting_id);
+     int period = FREQ_PERIOD[m->frequency];
+     const char *problem = NULL;
+     if (scheduler->meeting_hours[day_idx] / calendar.weeks > 2.5)
+         problem = "that day already has 2.5 hours of meetings per week";
+     else if (!(attendee_phase_starts(scheduler, m->attendees, period, first_week, day_idx, m->duration) &
+                slot_window(start_idx, 1)))
+         problem = m->attendees ? "it clashes with a meeting of one of its attendees or a reservation in at least one week"
+                                : "it clashes with a meeting or reservation in at least one week";
+     Placement to = problem ? old : (Placement){(int8_t)day_idx, (int8_t)start_idx, (int8_t)first_week};
+     for (int week = to.phase; week < calendar.weeks; week += period)
+         add_schedule_entry(scheduler, meeting_id, week, to.day, to.start);
+     return problem;
+ }
+ 
+ // A what-if copy of a scheduler: fork gets its own booked slots, hours and day heap (the
+ // grid block, a few hundred bytes), its own random number generator, and booked slots for
+ // attendees attendees (src's, then free ones for attendees only the fork knows about; see
+ // dry_run), and shares everything else with src, read-only. Only choose_placement,
+ // occupy_slots and the other grid-only functions may be used on it, and it is freed with
+ // free_occupancy. Returns false if out of memory.
+ bool fork_occupancy(MeetingScheduler *fork, const MeetingScheduler *src, int attendees) {
+     *fork = *src;
+     size_t row = (size_t)calendar.weeks * calendar.days * sizeof(SlotMask);
+     fork->grid = malloc(grid_size());
+     fork->attendee_slots = attendees > 0 ? calloc(attendees, row) : NULL;
+     fork->attendee_capacity = attendees; // attendee_count stays src's: the others have no names
+     if (!fork->grid || (attendees > 0 && !fork->attendee_slots)) {
+         free(fork->grid);
+         free(fork->attendee_slots);
+         return false;
+     }
+     memcpy(fork->grid, src->grid, grid_size());
+     if (src->attendee_count > 0)
+         memcpy(fork->attendee_slots, src->attendee_slots, src->attendee_count * row);
+     point_into_grid(fork);
+     return true;
+ }
+ 
+ // Frees what fork_occupancy allocated
+ void free_occupancy(MeetingScheduler *fork) {
+     free(fork->grid);
+     free(fork->attendee_slots);
+     fork->grid = NULL;
+     fork->attendee_slots = NULL;
+ }
+ 
+ // Places meetings one after the other, in the given order, the way add_meeting would,
+ // without changing scheduler: they go onto a fork of its occupancy instead. out[i] is
+ // where meeting i would go (phase -1 if it would not fit, with why[i] saying why).
+ // The answer is exactly what add_meeting would do from the same snapshot.
+ // Returns how many would be placed, or -1 if out of memory.
+ int dry_run(const MeetingScheduler *scheduler, const Meeting *meetings, int count, Placement *out, const char **why) {
+     // Attendees the scheduler does not know yet get numbers in the fork only, in the order
+     // add_meeting would name them, and lose them again if their meeting does not fit. The
+     // fork gets rows for as many as the batch could name.
+     int most = 0;
+     for (int i = 0; i < count && most < MAX_ATTENDEES; i++)
+         most += count_attendee_names(meetings[i].attendees);
+     if (most > MAX_ATTENDEES - scheduler->attendee_count)
+         most = MAX_ATTENDEES - scheduler->attendee_count;
+     char (*new_names)[MAX_STR] = malloc(MAX_ATTENDEES * MAX_STR);
+     int new_count = 0;
+     MeetingScheduler fork;
+     if (!new_names || !fork_occupancy(&fork, scheduler, scheduler->attendee_count + most)) {
+         free(new_names);
+         return -1;
+     }
+     int placed = 0;
+     for (int i = 0; i < count; i++) {
+         int candidates, before = new_count;
+         AttendeeSet attendees;
+         why[i] = NULL;
+         if (!fork_attendee_set(scheduler, meetings[i].attendees, new_names, &new_count, &attendees)) {
+             new_count = before; // add_meeting forgets them too
+             out[i].phase = -1;
+             why[i] = "there is no room for more attendees";
+             continue;
+         }
+         if (choose_placement(&fork, &meetings[i], attendees, &out[i], &candidates) != COUNT_PLACEMENTS) {
+             new_count = before; // Nothing was booked for them, so their rows are still free
+             out[i].phase = -1;
+             why[i] = placement_problem(&fork, &meetings[i], attendees); // The fork does not know the new names
+             continue;
+         }
+         for (int week = out[i].phase; week < calendar.weeks; week += FREQ_PERIOD[meetings[i].frequency])
+             occupy_slots(&fork, week, out[i].day, out[i].start, meetings[i].duration, attendees);
+         placed++;
+     }
+     free_occupancy(&fork);
+     free(new_names);
+     return placed;
+ }
+ 
+ // -------------------------
+ // CONSTRAINT SOLVER
+ // -------------------------
+ 
+ // add_meeting is greedy: it picks the best slot for the new meeting and never moves the
+ // meetings placed before it. When that fails, solve_schedule can try again from scratch.
+ // It looks for positions for ALL meetings at once (the existing ones plus the new ones)
+ // by backtracking:
+ //   1. Every meeting gets a list of candidate placements (day, start, phase) that fit the
+ //      working day, its fixed/preferred times, and do not clash with reservations.
+ //   2. Pick the meeting with the fewest candidates still free ("most constrained first"),
+ //      try its candidates one by one (its old position first) and go one level deeper.
+ //   3. Before going deeper, check that every meeting left still has a free candidate
+ //      (forward checking). If not, undo the last choice and try the next one.
+ // The search gives up when its time budget runs out, so a request never hangs.
+ // It books slots the way the scheduler does (see ATTENDEES): meetings for everyone in
+ // blocked, meetings with attendees in their attendees' rows only, so two meetings with
+ // nobody in common may share a time, as add_meeting allows.
+ #define SOLVER_BUDGET_MS 200 // Longest one request may search (milliseconds)
+ 
+ // A meeting and its possible placements
+ typedef struct {
+     const Meeting *meeting;  // Meeting to place
+     AttendeeSet attendees;   // Who attends it (0 = everyone)
+     Placement *candidates;   // Placements allowed by its own constraints, grouped by day
+     int candidate_count;
+     int day_begin[MAX_WEEK_DAYS + 1]; // Candidates of day d are day_begin[d] .. day_begin[d + 1] - 1
+     int current;             // Candidate it used before solving (-1 = new meeting)
+     int chosen;              // Candidate picked by the search, -1 = not yet
+ } SolverItem;
+ 
+ // Search state
+ typedef struct {
+     SolverItem *items;       // Meetings to place
+     int count;
+     int max_candidates;      // Most candidates any meeting can have
+     SlotMask *blocked;       // Reservations plus the meetings for everyone chosen so far (by day_cell)
+     SlotMask *attendee_slots; // Meetings chosen so far of each attendee (rows as in MeetingScheduler)
+     SlotMask *attendee_busy; // Slots any attendee has booked (by day_cell)
+     int attendee_count;      // Rows in attendee_slots
+     double *total_hours;     // Same meaning as in MeetingScheduler
+     double *meeting_hours;
+     int *day_heap;           // Days by total_hours (see DAY LOAD)
+     int *day_heap_pos;
+     struct timespec deadline; // When to give up
+     long steps;              // Search steps taken (the clock is checked now and then)
+     bool timed_out;
+ } Solver;
+ 
+ // Booked slots of attendee a in the search (see attendee_row)
+ SlotMask *solver_row(const Solver *solver, int a) {
+     return solver->attendee_slots + (size_t)a * calendar.weeks * calendar.days;
+ }
+ 
+ // Slots a meeting for attendees (0 = everyone) must keep clear of on one week/day,
+ // the same as meeting_start_mask looks at
+ SlotMask solver_busy(const Solver *solver, AttendeeSet attendees, int cell) {
+     SlotMask busy = solver->blocked[cell];
+     if (!attendees)
+         return busy | solver->attendee_busy[cell];
+     for (AttendeeSet left = attendees; left; left &= left - 1)
+         busy |= solver_row(solver, first_attendee(left))[cell];
+     return busy;
+ }
+ 
+ // Checks if a placement is still free (and its day not already full of meetings)
+ bool placement_free(Solver *solver, const SolverItem *item, const Placement *p) {
+     if (solver->meeting_hours[p->day] / calendar.weeks > 2.5)
+         return false; // Same daily limit as add_meeting
+     int period = FREQ_PERIOD[item->meeting->frequency];
+     for (int w = p->phase; w < calendar.weeks; w += period) {
+         if (!window_free(solver_busy(solver, item->attendees, day_cell(w, p->day)), p->start,
+                          item->meeting->duration))
+             return false;
+     }
+     return true;
+ }
+ 
+ // Books (sign = 1) or un-books (sign = -1) a placement
+ void apply_placement(Solver *solver, const SolverItem *item, const Placement *p, int sign) {
+     SlotMask window = slot_window(p->start, item->meeting->duration);
+     int period = FREQ_PERIOD[item->meeting->frequency];
+     double hours = slots_to_hours(item->meeting->duration);
+     for (int w = p->phase; w < calendar.weeks; w += period) {
+         int cell = day_cell(w, p->day);
+         if (!item->attendees) {
+             if (sign > 0)
+                 solver->blocked[cell] |= window;
+             else
+                 solver->blocked[cell] &= ~window;
+         } else if (sign > 0) {
+             for (AttendeeSet left = item->attendees; left; left &= left - 1)
+                 solver_row(solver, first_attendee(left))[cell] |= window;
+             solver->attendee_busy[cell] |= window;
+         } else {
+             for (AttendeeSet left = item->attendees; left; left &= left - 1)
+                 solver_row(solver, first_attendee(left))[cell] &= ~window;
+             SlotMask busy = 0; // Others may have meetings there too (as in free_attendees)
+             for (int a = 0; a < solver->attendee_count; a++)
+                 busy |= solver_row(solver, a)[cell];
+             solver->attendee_busy[cell] = busy;
+         }
+         solver->total_hours[p->day] += sign * hours;
+         solver->meeting_hours[p->day] += sign * hours;
+     }
+     day_load_changed(solver->day_heap, solver->day_heap_pos, calendar.days, solver->total_hours, p->day);
+ }
+ 
+ bool solver_search(Solver *solver, int remaining); // Below; the two call each other
+ 
+ // Tries one candidate of item and goes one level deeper; true if everything got placed
+ bool solver_try(Solver *solver, SolverItem *item, int c, int remaining) {
+     Placement *p = &item->candidates[c];
+     apply_placement(solver, item, p, 1);
+     item->chosen = c;
+     if (solver_search(solver, remaining - 1))
+         return true;
+     item->chosen = -1; // Undo so the caller can try the next candidate
+     apply_placement(solver, item, p, -1);
+     return false;
+ }
+ 
+ // Places the remaining meetings; true if all of them fit
+ bool solver_search(Solver *solver, int remaining) {
+     if (remaining == 0)
+         return true; // Everything placed
+     // Look at the clock every 256 steps
+     if ((++solver->steps & 255) == 0) {
+         struct timespec now;
+         clock_gettime(CLOCK_MONOTONIC, &now);
+         if (now.tv_sec > solver->deadline.tv_sec ||
+             (now.tv_sec == solver->deadline.tv_sec && now.tv_nsec >= solver->deadline.tv_nsec))
+             solver->timed_out = true;
+     }
+     if (solver->timed_out)
+         return false;
+ 
+     // Forward checking: find the unplaced meeting with the fewest free candidates
+     int best = -1, best_free = solver->max_candidates + 1;
+     for (int i = 0; i < solver->count; i++) {
+         SolverItem *item = &solver->items[i];
+         if (item->chosen >= 0)
+             continue;
+         int free_count = 0;
+         for (int c = 0; c < item->candidate_count && free_count < best_free; c++) {
+             if (placement_free(solver, item, &item->candidates[c]))
+                 free_count++;
+         }
+         if (free_count == 0)
+             return false; // This meeting can no longer be placed: dead end
+         if (free_count < best_free) {
+             best = i;
+             best_free = free_count;
+         }
+     }
+ 
+     // Try its free candidates: old position first, then least busy days first.
+     // The day order is taken from the heap now, before deeper levels move hours around.
+     SolverItem *item = &solver->items[best];
+     if (item->current >= 0 && placement_free(solver, item, &item->candidates[item->current])) {
+         if (solver_try(solver, item, item->current, remaining))
+             return true;
+         if (solver->timed_out)
+             return false;
+     }
+     int days[MAX_WEEK_DAYS];
+     int left = calendar.days;
+     memcpy(days, solver->day_heap, calendar.days * sizeof(int));
+     while (left > 0) {
+         int day = heap_pop(days, NULL, &left, solver->total_hours);
+         for (int c = item->day_begin[day]; c < item->day_begin[day + 1]; c++) {
+             if (c == item->current || !placement_free(solver, item, &item->candidates[c]))
+                 continue;
+             if (solver_try(solver, item, c, remaining))
+                 return true;
+             if (solver->timed_out)
+                 return false;
+         }
+     }
+     return false;
+ }
+ 
+ // Fills in the candidate placements of one meeting (candidates has room for max_candidates)
+ void build_candidates(Solver *solver, SolverItem *item) {
+     const Meeting *meeting = item->meeting;
+     int phases = frequency_phases(meeting->frequency);
+     int times[MAX_DAY_SLOTS];
+     int time_count = 0;
+     if (meeting->fixed_time >= 0) {
+         times[time_count++] = meeting->fixed_time;
+     } else if (meeting->preferred_hours[0] >= 0) {
+         for (int i = 0; i < 8 && meeting->preferred_hours[i] >= 0; i++)
+             times[time_count++] = meeting->preferred_hours[i];
+     } else {
+         for (int t = 0; t < calendar.slots; t++)
+             times[time_count++] = t;
+     }
+     item->candidate_count = 0;
+     for (int day = 0; day < calendar.days; day++) {
+         item->day_begin[day] = item->candidate_count;
+         if (meeting->fixed_day >= 0 && day != meeting->fixed_day)
+             continue;
+         // Only keep placements that could ever work (reservations never move):
+         // the starts free in every week of each phase
+         SlotMask starts[MAX_PERIOD];
+         for (int phase = 0; phase < phases; phase++) {
+             starts[phase] = ~(SlotMask)0;
+             for (int w = phase; w < calendar.weeks; w += FREQ_PERIOD[meeting->frequency])
+                 starts[phase] &= free_starts(solver->blocked[day_cell(w, day)], meeting->duration);
+         }
+         for (int t = 0; t < time_count; t++) {
+             if (times[t] < 0 || times[t] >= calendar.slots)
+                 continue;
+             for (int phase = 0; phase < phases; phase++) {
+                 Placement p = {(int8_t)day, (int8_t)times[t], (int8_t)phase};
+                 if (item->candidate_count < solver->max_candidates && (starts[phase] & slot_window(times[t], 1)))
+                     item->candidates[item->candidate_count++] = p;
+             }
+         }
+     }
+     item->day_begin[calendar.days] = item->candidate_count;
+ }
+ 
+ // Frees everything solve_schedule allocated for the search
+ void free_solver(Solver *solver) {
+     for (int i = 0; solver->items && i < solver->count; i++)
+         free(solver->items[i].candidates);
+     free(solver->items);
+     free(solver->blocked);
+     free(solver->attendee_slots);
+     free(solver->attendee_busy);
+     free(solver->total_hours);
+     free(solver->meeting_hours);
+     free(solver->day_heap);
+     free(solver->day_heap_pos);
+     free(solver);
+ }
+ 
+ // Re-plans the whole schedule so that all existing meetings plus the extra_count meetings
+ // in extra fit, moving existing meetings if needed. On success the schedule is rebuilt
+ // (the extra meetings are added) and true is returned; otherwise nothing is changed.
+ bool solve_schedule(MeetingScheduler *scheduler, const Meeting *extra, int extra_count, int budget_ms) {
+     int live = 0; // Meetings that were not deleted
+     for (int i = 0; i < scheduler->meeting_count; i++)
+         live += !meeting_deleted(scheduler, i);
+     int total = live + extra_count;
+     int slots = total > 0 ? total : 1; // Never ask calloc for 0 items
+     Solver *solver = calloc(1, sizeof(Solver));
+     if (!solver)
+         return false;
+     solver->count = total;
+     solver->max_candidates = calendar.days * calendar.slots * MAX_PERIOD;
+     solver->items = calloc(slots, sizeof(SolverItem));
+     solver->blocked = calloc((size_t)calendar.weeks * calendar.days, sizeof(SlotMask));
+     solver->total_hours = calloc(calendar.days, sizeof(double));
+     solver->meeting_hours = calloc(calendar.days, sizeof(double));
+     solver->day_heap = malloc(calendar.days * sizeof(int));
+     solver->day_heap_pos = malloc(calendar.days * sizeof(int));
+     solver->attendee_busy = calloc((size_t)calendar.weeks * calendar.days, sizeof(SlotMask));
+     Meeting *all = malloc(slots * sizeof(Meeting)); // Existing meetings, then extra
+     int *ids = malloc(slots * sizeof(int)); // Meeting id of each of them
+     char (*new_names)[MAX_STR] = malloc(MAX_ATTENDEES * MAX_STR); // Attendees extra names first
+     bool ok = solver->items && solver->blocked && solver->attendee_busy && solver->total_hours &&
+               solver->meeting_hours && solver->day_heap && solver->day_heap_pos && all && ids && new_names;
+     for (int i = 0; ok && i < total; i++) {
+         solver->items[i].candidates = malloc(solver->max_candidates * sizeof(Placement));
+         ok = solver->items[i].candidates != NULL;
+     }
+     int occurrences = 0; // Entries the new schedule will have (at most)
+     int new_count = 0; // Attendees the extra meetings name first (numbered as add_meeting would)
+     for (int i = 0, k = 0; ok && i < scheduler->meeting_count; i++) {
+         if (!meeting_deleted(scheduler, i))
+             ids[k++] = i;
+     }
+     for (int i = 0; ok && i < total; i++) {
+         if (i < live) {
+             load_meeting(scheduler, ids[i], &all[i]);
+             solver->items[i].attendees = scheduler->meetings[ids[i]].attendees;
+         } else {
+             all[i] = extra[i - live];
+             ids[i] = scheduler->meeting_count + i - live; // The id it will get
+             ok = fork_attendee_set(scheduler, all[i].attendees, new_names, &new_count, &solver->items[i].attendees);
+         }
+         occurrences += frequency_occurrences(all[i].frequency, 0);
+     }
+     solver->attendee_count = scheduler->attendee_count + new_count;
+     if (ok && solver->attendee_count > 0) {
+         solver->attendee_slots = calloc((size_t)solver->attendee_count * calendar.weeks * calendar.days,
+                                         sizeof(SlotMask));
+         ok = solver->attendee_slots != NULL;
+     }
+     free(new_names);
+     if (!ok) { // Out of memory, or more attendees than there is room for
+         free_solver(solver);
+         free(all);
+         free(ids);
+         return false;
+     }
+     // Start from the reservations only
+     for (int i = 0; i < scheduler->reservation_count; i++) {
+         Reservation *r = &scheduler->reservations[i];
+         for (int week = 0; week < calendar.weeks; week++)
+             solver->blocked[day_cell(week, r->day)] |= slot_window(r->start_time, r->duration);
+         solver->total_hours[r->day] += slots_to_hours(r->duration) * calendar.weeks;
+     }
+     heap_build(solver->day_heap, solver->day_heap_pos, calendar.days, solver->total_hours);
+     for (int i = 0; i < total; i++) {
+         SolverItem *item = &solver->items[i];
+         item->meeting = &all[i];
+         item->chosen = -1;
+         item->current = -1;
+         build_candidates(solver, item);
+         for (int c = 0; i < live && c < item->candidate_count; c++) {
+             Placement *p = &item->candidates[c], *now = &scheduler->placements[ids[i]];
+             if (p->day == now->day && p->start == now->start && p->phase == now->phase)
+                 item->current = c;
+         }
+     }
+ 
+     clock_gettime(CLOCK_MONOTONIC, &solver->deadline);
+     solver->deadline.tv_sec += budget_ms / 1000;
+     solver->deadline.tv_nsec += (long)(budget_ms % 1000) * 1000000L;
+     if (solver->deadline.tv_nsec >= 1000000000L) {
+         solver->deadline.tv_sec++;
+         solver->deadline.tv_nsec -= 1000000000L;
+     }
+     bool solved = solver_search(solver, total);
+     count_event(COUNT_SOLVER_RUNS, 1);
+     count_event(COUNT_SOLVER_STEPS, solver->steps);
+     if (solver->timed_out)
+         count_event(COUNT_SOLVER_TIMEOUTS, 1);
+ 
+     // Make room for the new meetings and entries before touching anything
+     int old_count = scheduler->meeting_count;
+     uint32_t strings_before = scheduler->strings_len;
+     int attendees_before = scheduler->attendee_count;
+     for (int i = 0; solved && i < extra_count; i++) {
+         if (prepare_meeting_record(scheduler, &extra[i], NULL))
+             scheduler->meeting_count++;
+         else
+             solved = false; // Out of memory, or no room for their attendees
+     }
+     if (solved)
+         solved = grow_array((void **)&scheduler->schedule, &scheduler->schedule_capacity,
+                             occurrences, sizeof(ScheduleEntry));
+     if (!solved) {
+         scheduler->meeting_count = old_count;
+         forget_strings(scheduler, strings_before);
+         scheduler->attendee_count = attendees_before;
+     }
+ 
+     if (solved) {
+         // Rebuild the schedule from the solution
+         clear_placements(scheduler);
+         for (int i = 0; i < total; i++) {
+             Placement *p = &solver->items[i].candidates[solver->items[i].chosen];
+             for (int w = p->phase; w < calendar.weeks; w += FREQ_PERIOD[all[i].frequency])
+                 add_schedule_entry(scheduler, ids[i], w, p->day, p->start);
+         }
+         count_event(COUNT_SOLVER_SOLVED, 1);
+     }
+     free_solver(solver);
+     free(all);
+     free(ids);
+     return solved;
+ }
+ 
+ // -------------------------
+ // PERSISTENCE
+ // -------------------------
+
+ // With --data-dir, every tenant's schedule is kept on disk in two files:
+ //   <id>.log   An append-only log. Every published change adds one "frame" holding
+ //              what changed (reservations and meetings added, moved or deleted,
+ //              attendees named, clear).
+ //   <id>.snap  A snapshot: the whole schedule at one point in the log, in a compact
+ //              binary form (reservations, meeting records, one placement per meeting,
+ //              attendee names, strings). Written every CHECKPOINT_EVERY frames, after
+ //              which the log starts over. Snapshots from before attendees ("CWEBSNP2")
+ //              are still read.
+ // Loading a tenant maps the snapshot into memory and replays the frames written after
+ // it, so loading takes time proportional to the schedule, not to its history. The log
+ // stores results (where each meeting went), not requests, so replaying never depends
+ // on random numbers. The state of the random number generator is saved too, so after a
+ // restart the next placements are the same as they would have been without it.
+ //
+ // Writes are "group committed": a change is added to the pending frames in memory and
+ // the writer then waits until it is on disk. The first waiter writes and fsyncs
+ // everything pending; writers arriving meanwhile queue up behind it and are all
+ // covered by the next single write+fsync.
+ //
+ // The files are in the machine's own byte order; they are not meant to be moved to a
+ // different kind of machine.
+ #define CHECKPOINT_EVERY 1000         // Frames in the log before a new snapshot is written
+ #define SNAPSHOT_MAGIC "CWEBSNP3"     // First bytes of a snapshot file (8 bytes)
+ #define SNAPSHOT_MAGIC_V2 "CWEBSNP2"  // Snapshot from before attendees (MeetingRecordV2, none named)
+
+ const char *data_dir = NULL; // Directory set by --data-dir (NULL = keep everything in memory)
+
+ // What one operation in a frame does
+ typedef enum {
+     LOG_CLEAR = 1,   // Remove everything
+     LOG_RESERVE,     // day, start, duration: add a reservation
+     LOG_MEETING,     // Meeting fields, placement, name and type: add a meeting
+     LOG_MOVE,        // Meeting id and new placement: move an existing meeting
+     LOG_RANDOM,      // New state of the random number generator
+     LOG_DELETE,      // Meeting id: delete a meeting
+     LOG_SET_RESERVATION, // Index, day, start, duration: put a reservation at an index
+                          // (duration 0 = delete it)
+     LOG_ATTENDEE,        // Name: name the next attendee
+     LOG_MEETING_ATTENDEES // Meeting id and AttendeeSet: who attends the meeting just added
+                           // (LOG_MEETING leaves it for everyone)
+ } LogOp;
+
+ // Start of every frame in the log
+ typedef struct {
+     uint32_t size;   // Bytes of operations after this header
+     uint32_t crc;    // crc32 of the operations, to spot a frame cut short by a crash
+     uint64_t lsn;    // Number of the frame (log sequence number), counting up from 1
+ } FrameHeader;
+
+ // Start of a snapshot file
+ typedef struct {
+     char magic[8];              // SNAPSHOT_MAGIC
+     uint32_t calendar_crc;      // Calendar the snapshot was written with (see calendar_crc)
+     uint32_t body_crc;          // crc32 of everything after the header
+     uint64_t lsn;               // Last log frame included
+     uint32_t reservation_count; // Then: reservations (SavedReservation),
+     uint32_t meeting_count;     //       meetings (MeetingRecord), one Placement per meeting,
+     uint32_t strings_len;       //       the offset of each attendee's name (uint32_t),
+     uint32_t attendee_count;    //       and the string arena
+     uint64_t random_state;      // State of the random number generator
+ } SnapshotHeader;
+ 
+ // A meeting record as "CWEBSNP2" snapshots stored it (MeetingRecord without attendees)
+ typedef struct {
+     uint32_t name, type;
+     uint8_t duration, frequency;
+     int8_t fixed_day, fixed_time;
+     int8_t preferred_hours[8];
+ } MeetingRecordV2;
+
+ // A reservation as stored on disk
+ typedef struct {
+     uint8_t day, start, duration;
+ } SavedReservation;
+
+ // Log and snapshot of one tenant
+ typedef struct {
+     char log_path[512];
+     char snapshot_path[512];
+     int log_fd;                 // Opened for appending
+     pthread_mutex_t lock;       // Guards everything below
+     pthread_cond_t flushed;     // Signalled whenever durable_lsn moves or writing fails
+     TextBuffer pending;         // Frames not written yet
+     uint64_t last_lsn;          // Last frame added (written or pending)
+     uint64_t durable_lsn;       // Last frame known to be on disk
+     bool flushing;              // Someone is writing pending frames right now
+     bool failed;                // Writing failed; later changes are refused
+     int frames_since_checkpoint;
+ } Journal;
+
+ // Fingerprint of the calendar settings, so a snapshot is never loaded into a different calendar
+ uint32_t calendar_crc(void) {
+     int settings[5 + 2 * MAX_BREAKS] = {calendar.weeks, calendar.days, calendar.slot_minutes,
+                                          calendar.day_start, calendar.day_end};
+     for (int b = 0; b < calendar.break_count; b++) {
+         settings[5 + 2 * b] = calendar.break_start[b];
+         settings[6 + 2 * b] = calendar.break_end[b];
+     }
+     return (uint32_t)crc32(0L, (const Bytef *)settings, sizeof(settings));
+ }
+
+ // Adds one byte to a frame
+ void put_byte(TextBuffer *frame, int value) {
+     char c = (char)value;
+     text_append(frame, &c, 1);
+ }
+
+ // Writes the operations that turn old into new (both published or about to be).
+ // Returns false if out of memory. Deleted meetings and reservations keep their index,
+ // so everything is compared index by index.
+ bool encode_changes(TextBuffer *frame, const MeetingScheduler *old, const MeetingScheduler *new) {
+     int old_meetings = old->meeting_count;
+     int old_reservations = old->reservation_count;
+     int old_attendees = old->attendee_count;
+     if (new->meeting_count < old_meetings || new->reservation_count < old_reservations ||
+         new->attendee_count < old_attendees) {
+         put_byte(frame, LOG_CLEAR); // The lists only get shorter when everything is cleared
+         old_meetings = old_reservations = old_attendees = 0;
+     }
+     for (int i = 0; i < new->reservation_count; i++) {
+         const Reservation *r = &new->reservations[i];
+         if (i < old_reservations) {
+             const Reservation *was = &old->reservations[i];
+             if (r->day == was->day && r->start_time == was->start_time && r->duration == was->duration)
+                 continue; // Unchanged
+         }
+         if (i >= old_reservations && r->duration > 0) {
+             put_byte(frame, LOG_RESERVE); // Added at the end
+         } else {
+             put_byte(frame, LOG_SET_RESERVATION); // Moved, deleted or put in a deleted one's place
+             put_byte(frame, i);
+         }
+         put_byte(frame, r->day);
+         put_byte(frame, r->start_time);
+         put_byte(frame, r->duration);
+     }
+     for (int a = old_attendees; a < new->attendee_count; a++) { // Before the meetings that list them
+         const char *name = scheduler_string(new, new->attendee_names[a]);
+         put_byte(frame, LOG_ATTENDEE);
+         text_append(frame, name, strlen(name) + 1);
+     }
+     for (int i = 0; i < new->meeting_count; i++) {
+         const Placement *p = &new->placements[i];
+         uint32_t id = (uint32_t)i;
+         if (i >= old_meetings) {
+             const MeetingRecord *m = &new->meetings[i];
+             put_byte(frame, LOG_MEETING);
+             put_byte(frame, m->duration);
+             put_byte(frame, m->frequency);
+             put_byte(frame, m->fixed_day);
+             put_byte(frame, m->fixed_time);
+             for (int k = 0; k < 8; k++)
+                 put_byte(frame, m->preferred_hours[k]);
+             put_byte(frame, p->day);
+             put_byte(frame, p->start);
+             put_byte(frame, p->phase);
+             const char *name = scheduler_string(new, m->name);
+             const char *type = scheduler_string(new, m->type);
+             text_append(frame, name, strlen(name) + 1); // With the '\0'
+             text_append(frame, type, strlen(type) + 1);
+             if (m->attendees) {
+                 put_byte(frame, LOG_MEETING_ATTENDEES);
+                 text_append(frame, (const char *)&id, sizeof(id));
+                 text_append(frame, (const char *)&m->attendees, sizeof(m->attendees));
+             }
+         } else if (meeting_deleted(new, i)) {
+             if (!meeting_deleted(old, i)) {
+                 put_byte(frame, LOG_DELETE);
+                 text_append(frame, (const char *)&id, sizeof(id));
+             }
+         } else if (p->day != old->placements[i].day || p->start != old->placements[i].start ||
+                    p->phase != old->placements[i].phase) {
+             put_byte(frame, LOG_MOVE);
+             text_append(frame, (const char *)&id, sizeof(id));
+             put_byte(frame, p->day);
+             put_byte(frame, p->start);
+             put_byte(frame, p->phase);
+         }
+     }
+     if (new->random_state != old->random_state || frame->len > 0) {
+         put_byte(frame, LOG_RANDOM); // Last, so a clear before it cannot undo it
+         text_append(frame, (const char *)&new->random_state, sizeof(new->random_state));
+     }
+     return !frame->failed;
+ }
+
+ // A schedule being loaded: the scheduler holds reservations and meetings, and the
+ // placements are collected separately and turned into entries at the end (place_all),
+ // in meeting order, just like the schedule was built when it was live
+ typedef struct {
+     MeetingScheduler state;
+     Placement *placements;
+     int placement_capacity;
+ } RestoreState;
+
+ // Reads bytes out of a frame or snapshot without running past its end
+ typedef struct {
+     const unsigned char *p;
+     const unsigned char *end;
+     bool bad;  // Tried to read past the end
+ } ByteReader;
+
+ int read_byte(ByteReader *reader) {
+     if (reader->p >= reader->end) {
+         reader->bad = true;
+         return 0;
+     }
+     return *reader->p++;
+ }
+
+ int read_signed_byte(ByteReader *reader) {
+     return (int8_t)read_byte(reader);
+ }
+
+ // Reads a '\0'-terminated string shorter than MAX_STR (the reader keeps pointing at it)
+ const char *read_string(ByteReader *reader) {
+     const unsigned char *start = reader->p;
+     const unsigned char *zero = memchr(start, '\0', reader->end - start);
+     if (!zero || zero - start >= MAX_STR) {
+         reader->bad = true;
+         return "";
+     }
+     reader->p = zero + 1;
+     return (const char *)start;
+ }
+
+ // Checks that a placement can be used for a meeting (a deleted one cannot have any)
+ bool valid_placement(const MeetingRecord *meeting, const Placement *p) {
+     return meeting->duration > 0 && p->day >= 0 && p->day < calendar.days && p->start >= 0 && p->start < calendar.slots &&
+            p->phase >= 0 && p->phase < frequency_phases((Frequency)meeting->frequency);
+ }
+
+ // Adds a meeting (with its placement) while loading; false if the data is bad or out of memory
+ bool restore_meeting(RestoreState *restore, const Meeting *meeting, Placement placement) {
+     MeetingScheduler *s = &restore->state;
+     if (meeting->duration < 1 || meeting->duration > calendar.max_duration ||
+         meeting->frequency < 0 || meeting->frequency >= FREQ_COUNT ||
+         meeting->fixed_day < -1 || meeting->fixed_day >= calendar.days ||
+         meeting->fixed_time < -1 || meeting->fixed_time >= calendar.slots)
+         return false;
+     if (!grow_array((void **)&restore->placements, &restore->placement_capacity,
+                     s->meeting_count + 1, sizeof(Placement)) ||
+         !prepare_meeting_record(s, meeting, NULL) ||
+         !valid_placement(&s->meetings[s->meeting_count], &placement))
+         return false;
+     restore->placements[s->meeting_count++] = placement;
+     return true;
+ }
+
+ // Puts a reservation at index idx while loading, like book_reservation (duration 0 leaves
+ // a deleted one there); false if it does not fit
+ bool restore_reservation(MeetingScheduler *s, int idx, int day, int start, int duration) {
+     if (idx > s->reservation_count || idx >= MAX_RESERVATIONS)
+         return false;
+     unreserve(s, idx); // Whatever was there before (nothing if idx is new or deleted)
+     if (duration == 0) {
+         if (idx == s->reservation_count)
+             s->reservations[s->reservation_count++] = (Reservation){0, 0, 0, -1};
+         return true;
+     }
+     if (reservation_problem(s, day, start, duration))
+         return false;
+     book_reservation(s, idx, day, start, duration);
+     return true;
+ }
+
+ // Checks that a set holds only named attendees, and no more than a meeting can have
+ bool valid_attendee_set(const MeetingScheduler *s, AttendeeSet set) {
+     AttendeeSet named = s->attendee_count == MAX_ATTENDEES ? ~(AttendeeSet)0
+                                                            : ((AttendeeSet)1 << s->attendee_count) - 1;
+     return (set & ~named) == 0 && __builtin_popcountll(set) <= MAX_MEETING_ATTENDEES;
+ }
+ 
+ // Applies the operations of one frame; false if they do not make sense
+ bool apply_frame(RestoreState *restore, const unsigned char *ops, size_t size) {
+     ByteReader reader = {ops, ops + size, false};
+     MeetingScheduler *s = &restore->state;
+     while (reader.p < reader.end && !reader.bad) {
+         int op = read_byte(&reader);
+         if (op == LOG_CLEAR) {
+             free_scheduler(s);
+             if (!init_scheduler(s))
+                 return false;
+         } else if (op == LOG_RESERVE) {
+             int day = read_byte(&reader);
+             int start = read_byte(&reader);
+             int duration = read_byte(&reader);
+             if (reader.bad || duration == 0 || !restore_reservation(s, s->reservation_count, day, start, duration))
+                 return false;
+         } else if (op == LOG_SET_RESERVATION) {
+             int idx = read_byte(&reader);
+             int day = read_byte(&reader);
+             int start = read_byte(&reader);
+             int duration = read_byte(&reader);
+             if (reader.bad || !restore_reservation(s, idx, day, start, duration))
+                 return false;
+         } else if (op == LOG_MEETING) {
+             Meeting meeting;
+             meeting.duration = read_byte(&reader);
+             meeting.frequency = (Frequency)read_byte(&reader);
+             meeting.fixed_day = read_signed_byte(&reader);
+             meeting.fixed_time = read_signed_byte(&reader);
+             for (int k = 0; k < 8; k++)
+                 meeting.preferred_hours[k] = read_signed_byte(&reader);
+             Placement p;
+             p.day = (int8_t)read_byte(&reader);
+             p.start = (int8_t)read_byte(&reader);
+             p.phase = (int8_t)read_byte(&reader);
+             copy_field(meeting.name, read_string(&reader));
+             copy_field(meeting.type, read_string(&reader));
+             meeting.attendees[0] = '\0'; // Set by LOG_MEETING_ATTENDEES, if any
+             if (reader.bad || !restore_meeting(restore, &meeting, p))
+                 return false;
+         } else if (op == LOG_ATTENDEE) {
+             const char *name = read_string(&reader);
+             if (reader.bad || !*name || find_attendee(s, name) >= 0 || add_attendee(s, name) < 0)
+                 return false;
+         } else if (op == LOG_MEETING_ATTENDEES) {
+             uint32_t id;
+             AttendeeSet set;
+             if (reader.end - reader.p < (long)(sizeof(id) + sizeof(set)))
+                 return false;
+             memcpy(&id, reader.p, sizeof(id));
+             memcpy(&set, reader.p + sizeof(id), sizeof(set));
+             reader.p += sizeof(id) + sizeof(set);
+             if (id >= (uint32_t)s->meeting_count || meeting_deleted(s, (int)id) || !valid_attendee_set(s, set))
+                 return false;
+             s->meetings[id].attendees = set;
+         } else if (op == LOG_MOVE) {
+             uint32_t id;
+             if (reader.end - reader.p < (long)sizeof(id))
+                 return false;
+             memcpy(&id, reader.p, sizeof(id));
+             reader.p += sizeof(id);
+             Placement p;
+             p.day = (int8_t)read_byte(&reader);
+             p.start = (int8_t)read_byte(&reader);
+             p.phase = (int8_t)read_byte(&reader);
+             if (reader.bad || id >= (uint32_t)s->meeting_count || !valid_placement(&s->meetings[id], &p))
+                 return false;
+             restore->placements[id] = p;
+         } else if (op == LOG_DELETE) {
+             uint32_t id;
+             if (reader.end - reader.p < (long)sizeof(id))
+                 return false;
+             memcpy(&id, reader.p, sizeof(id));
+             reader.p += sizeof(id);
+             if (id >= (uint32_t)s->meeting_count || meeting_deleted(s, (int)id))
+                 return false;
+             s->meetings[id].duration = 0;
+             restore->placements[id].phase = -1;
+         } else if (op == LOG_RANDOM) {
+             if (reader.end - reader.p < (long)sizeof(s->random_state))
+                 return false;
+             memcpy(&s->random_state, reader.p, sizeof(s->random_state));
+             reader.p += sizeof(s->random_state);
+         } else {
+             return false; // Unknown operation
+         }
+     }
+     return !reader.bad;
+ }
+
+ // Turns the collected placements into schedule entries; false if two of them clash
+ bool place_all(RestoreState *restore) {
+     MeetingScheduler *s = &restore->state;
+     int occurrences = 0;
+     for (int i = 0; i < s->meeting_count; i++) {
+         if (!meeting_deleted(s, i))
+             occurrences += frequency_occurrences((Frequency)s->meetings[i].frequency, restore->placements[i].phase);
+     }
+     if (!grow_array((void **)&s->schedule, &s->schedule_capacity, occurrences, sizeof(ScheduleEntry)) ||
+         !grow_array((void **)&s->placements, &s->placement_capacity, s->meeting_count, sizeof(Placement)))
+         return false;
+     clear_placements(s);
+     for (int i = 0; i < s->meeting_count; i++) {
+         const Placement *p = &restore->placements[i];
+         if (meeting_deleted(s, i))
+             continue;
+         int period = FREQ_PERIOD[s->meetings[i].frequency];
+         for (int week = p->phase; week < calendar.weeks; week += period) {
+             if (!is_valid_slot(s, week, p->day, p->start, s->meetings[i].duration, s->meetings[i].attendees))
+                 return false;
+             add_schedule_entry(s, i, week, p->day, p->start);
+         }
+     }
+     return true;
+ }
+
+ // Writes all of data to a file; false on error
+ bool write_all(int fd, const void *data, size_t len) {
+     const char *p = data;
+     while (len > 0) {
+         ssize_t n = write(fd, p, len);
+         if (n < 0 && errno == EINTR)
+             continue;
+         if (n <= 0)
+             return false;
+         p += n;
+         len -= (size_t)n;
+     }
+     return true;
+ }
+
+ // Writes a snapshot of state (which includes the log up to lsn). The file is written
+ // under a temporary name and renamed, so a crash leaves either the old or the new one.
+ bool write_snapshot(Journal *journal, const MeetingScheduler *state, uint64_t lsn) {
+     SnapshotHeader header;
+     memset(&header, 0, sizeof(header));
+     memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+     header.calendar_crc = calendar_crc();
+     header.lsn = lsn;
+     header.reservation_count = (uint32_t)state->reservation_count;
+     header.meeting_count = (uint32_t)state->meeting_count;
+     header.strings_len = state->strings_len;
+     header.attendee_count = (uint32_t)state->attendee_count;
+     header.random_state = state->random_state;
+     // Body: reservations, meetings, placements, attendee names, strings
+     TextBuffer body = {0};
+     for (int i = 0; i < state->reservation_count; i++) {
+         const Reservation *r = &state->reservations[i];
+         SavedReservation saved = {(uint8_t)r->day, (uint8_t)r->start_time, (uint8_t)r->duration};
+         text_append(&body, (const char *)&saved, sizeof(saved));
+     }
+     if (state->meeting_count > 0) {
+         text_append(&body, (const char *)state->meetings, state->meeting_count * sizeof(MeetingRecord));
+         text_append(&body, (const char *)state->placements, state->meeting_count * sizeof(Placement));
+     }
+     text_append(&body, (const char *)state->attendee_names, state->attendee_count * sizeof(uint32_t));
+     if (state->strings_len > 0)
+         text_append(&body, state->strings, state->strings_len);
+     if (body.failed) {
+         free(body.data);
+         return false;
+     }
+     header.body_crc = (uint32_t)crc32(0L, (const Bytef *)body.data, (uInt)body.len);
+
+     char temp_path[sizeof(journal->snapshot_path) + 4];
+     snprintf(temp_path, sizeof(temp_path), "%s.tmp", journal->snapshot_path);
+     int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+     bool ok = fd >= 0 && write_all(fd, &header, sizeof(header)) &&
+               write_all(fd, body.data, body.len) && fsync(fd) == 0;
+     if (fd >= 0)
+         close(fd);
+     free(body.data);
+     ok = ok && rename(temp_path, journal->snapshot_path) == 0;
+     if (ok && data_dir) {
+         int dir_fd = open(data_dir, O_RDONLY); // Make the rename itself durable
+         if (dir_fd >= 0) {
+             fsync(dir_fd);
+             close(dir_fd);
+         }
+     } else if (!ok) {
+         unlink(temp_path);
+     }
+     return ok;
+ }
+
+ // Loads the snapshot file, if there is one, into restore. Sets *lsn to the last frame it
+ // includes (0 without a snapshot). Returns NULL if fine, otherwise what is wrong.
+ const char *load_snapshot(Journal *journal, RestoreState *restore, uint64_t *lsn) {
+     *lsn = 0;
+     int fd = open(journal->snapshot_path, O_RDONLY);
+     if (fd < 0)
+         return errno == ENOENT ? NULL : "cannot open the snapshot";
+     struct stat info;
+     if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(SnapshotHeader)) {
+         close(fd);
+         return "the snapshot is too short";
+     }
+     size_t size = (size_t)info.st_size;
+     // Map the file instead of reading it: the arrays are copied straight out of it
+     const unsigned char *file = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+     close(fd);
+     if (file == MAP_FAILED)
+         return "cannot map the snapshot";
+     SnapshotHeader header;
+     memcpy(&header, file, sizeof(header));
+     const unsigned char *body = file + sizeof(header);
+     size_t body_len = size - sizeof(header);
+     bool v2 = memcmp(header.magic, SNAPSHOT_MAGIC_V2, sizeof(header.magic)) == 0;
+     if (v2)
+         header.attendee_count = 0;
+     size_t record_size = v2 ? sizeof(MeetingRecordV2) : sizeof(MeetingRecord);
+     size_t expected = (size_t)header.reservation_count * sizeof(SavedReservation) +
+                       (size_t)header.meeting_count * (record_size + sizeof(Placement)) +
+                       (size_t)header.attendee_count * sizeof(uint32_t) + header.strings_len;
+     const char *error = NULL;
+     if (!v2 && memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0)
+         error = "not a snapshot file";
+     else if (header.calendar_crc != calendar_crc())
+         error = "the snapshot was written with different calendar settings";
+     else if (body_len != expected || header.reservation_count > MAX_RESERVATIONS ||
+              header.attendee_count > MAX_ATTENDEES || header.body_crc != (uint32_t)crc32(0L, (const Bytef *)body, (uInt)body_len))
+         error = "the snapshot is damaged";
+     if (error) {
+         munmap((void *)file, size);
+         return error;
+     }
+     MeetingScheduler *s = &restore->state;
+     const SavedReservation *reservations = (const SavedReservation *)body;
+     const unsigned char *meetings = body + header.reservation_count * sizeof(SavedReservation);
+     const unsigned char *placements = meetings + header.meeting_count * record_size;
+     const unsigned char *names = placements + header.meeting_count * sizeof(Placement);
+     const char *strings = (const char *)names + header.attendee_count * sizeof(uint32_t);
+     for (uint32_t i = 0; !error && i < header.reservation_count; i++) {
+         if (!restore_reservation(s, (int)i, reservations[i].day, reservations[i].start, reservations[i].duration))
+             error = "the snapshot has clashing reservations";
+     }
+     // Records and strings are copied as they are (strings must end with '\0')
+     int count = (int)header.meeting_count;
+     int attendees = (int)header.attendee_count;
+     size_t cells = (size_t)calendar.weeks * calendar.days;
+     if (!error && count + attendees > 0) {
+         if (header.strings_len == 0 || strings[header.strings_len - 1] != '\0')
+             error = "the snapshot is damaged";
+         else if (!grow_array((void **)&s->meetings, &s->meeting_capacity, count, sizeof(MeetingRecord)) ||
+                  !grow_array((void **)&restore->placements, &restore->placement_capacity, count, sizeof(Placement)) ||
+                  !grow_array((void **)&s->attendee_slots, &s->attendee_capacity, attendees, cells * sizeof(SlotMask)) ||
+                  !(s->strings = malloc(header.strings_len)))
+             error = "out of memory";
+     }
+     if (!error && count + attendees > 0) {
+         if (v2) {
+             for (int i = 0; i < count; i++) { // Field by field: the old records are smaller
+                 MeetingRecordV2 old;
+                 memcpy(&old, meetings + i * sizeof(old), sizeof(old));
+                 MeetingRecord *m = &s->meetings[i];
+                 m->name = old.name;
+                 m->type = old.type;
+                 m->duration = old.duration;
+                 m->frequency = old.frequency;
+                 m->fixed_day = old.fixed_day;
+                 m->fixed_time = old.fixed_time;
+                 memcpy(m->preferred_hours, old.preferred_hours, sizeof(m->preferred_hours));
+                 m->attendees = 0; // For everyone
+             }
+         } else {
+             memcpy(s->meetings, meetings, count * sizeof(MeetingRecord));
+         }
+         memcpy(restore->placements, placements, count * sizeof(Placement));
+         memcpy(s->attendee_names, names, attendees * sizeof(uint32_t));
+         memcpy(s->strings, strings, header.strings_len);
+         s->strings_len = s->strings_capacity = header.strings_len;
+         if (!index_strings(s, 0))
+             error = "out of memory";
+         s->meeting_count = count;
+         s->attendee_count = attendees; // Their slots are booked again by place_all
+         for (int a = 0; !error && a < attendees; a++) {
+             if (s->attendee_names[a] >= s->strings_len)
+                 error = "the snapshot is damaged";
+         }
+         for (int i = 0; !error && i < count; i++) {
+             const MeetingRecord *m = &s->meetings[i];
+             // A deleted meeting has duration 0 and no placement
+             bool placed = m->duration == 0 ? restore->placements[i].phase == -1
+                                            : valid_placement(m, &restore->placements[i]);
+             if (m->name >= s->strings_len || m->type >= s->strings_len ||
+                 m->duration > calendar.max_duration || m->frequency >= FREQ_COUNT || !placed ||
+                 !valid_attendee_set(s, m->attendees))
+                 error = "the snapshot is damaged";
+         }
+     }
+     munmap((void *)file, size);
+     if (!error) {
+         *lsn = header.lsn;
+         s->random_state = header.random_state;
+     }
+     return error;
+ }
+
+ // Replays the log frames after snapshot_lsn into restore. A frame cut short by a crash
+ // ends the log: it is cut off so new frames follow the last good one.
+ // Returns NULL if fine, otherwise what is wrong.
+ const char *replay_log(Journal *journal, RestoreState *restore, uint64_t snapshot_lsn) {
+     journal->last_lsn = snapshot_lsn;
+     struct stat info;
+     if (fstat(journal->log_fd, &info) != 0)
+         return "cannot read the log";
+     size_t size = (size_t)info.st_size;
+     if (size == 0)
+         return NULL;
+     const unsigned char *log = mmap(NULL, size, PROT_READ, MAP_PRIVATE, journal->log_fd, 0);
+     if (log == MAP_FAILED)
+         return "cannot map the log";
+     size_t offset = 0;
+     const char *error = NULL;
+     while (!error && size - offset >= sizeof(FrameHeader)) {
+         FrameHeader header;
+         memcpy(&header, log + offset, sizeof(header));
+         const unsigned char *ops = log + offset + sizeof(header);
+         if (header.size > size - offset - sizeof(header) ||
+             header.crc != (uint32_t)crc32(0L, (const Bytef *)ops, header.size))
+             break; // Torn frame
+         if (header.lsn > snapshot_lsn) { // Older frames are already in the snapshot
+             if (!apply_frame(restore, ops, header.size))
+                 error = "the log has a change that does not fit";
+             journal->last_lsn = header.lsn;
+             journal->frames_since_checkpoint++;
+         }
+         offset += sizeof(header) + header.size;
+     }
+     munmap((void *)log, size);
+     if (!error && offset < size && ftruncate(journal->log_fd, (off_t)offset) != 0)
+         error = "cannot cut off the end of the log";
+     return error;
+ }
+
+ // Frees a journal (everything added to it must have been waited for)
+ void journal_close(Journal *journal) {
+     if (!journal)
+         return;
+     if (journal->log_fd >= 0)
+         close(journal->log_fd);
+     free(journal->pending.data);
+     pthread_mutex_destroy(&journal->lock);
+     pthread_cond_destroy(&journal->flushed);
+     free(journal);
+ }
+
+ // Opens the files of tenant id in data_dir and loads its schedule into state (which
+ // must be empty and initialized). On success *out is the journal to log changes to.
+ // Returns NULL if fine, otherwise what is wrong.
+ const char *journal_open(const char *id, MeetingScheduler *state, Journal **out, uint64_t *lsn) {
+     Journal *journal = calloc(1, sizeof(Journal));
+     if (!journal)
+         return "out of memory";
+     pthread_mutex_init(&journal->lock, NULL);
+     pthread_cond_init(&journal->flushed, NULL);
+     snprintf(journal->log_path, sizeof(journal->log_path), "%s/%s.log", data_dir, id);
+     snprintf(journal->snapshot_path, sizeof(journal->snapshot_path), "%s/%s.snap", data_dir, id);
+     journal->log_fd = open(journal->log_path, O_RDWR | O_CREAT | O_APPEND, 0644);
+     if (journal->log_fd < 0) {
+         journal_close(journal);
+         return "cannot open the log";
+     }
+     RestoreState restore = {.state = *state, .placements = NULL, .placement_capacity = 0};
+     uint64_t snapshot_lsn;
+     const char *error = load_snapshot(journal, &restore, &snapshot_lsn);
+     if (!error)
+         error = replay_log(journal, &restore, snapshot_lsn);
+     if (!error && !place_all(&restore))
+         error = "the saved meetings clash";
+     free(restore.placements);
+     *state = restore.state; // The caller frees it, also on failure
+     if (error) {
+         journal_close(journal);
+         return error;
+     }
+     journal->durable_lsn = journal->last_lsn; // Everything loaded came from the disk
+     *lsn = journal->last_lsn;
+     *out = journal;
+     return NULL;
+ }
+
+ // Adds a frame with the operations in ops; returns its number (0 if out of memory).
+ // The frame is not on disk until journal_wait returns.
+ uint64_t journal_append(Journal *journal, const TextBuffer *ops) {
+     pthread_mutex_lock(&journal->lock);
+     FrameHeader header;
+     header.size = (uint32_t)ops->len;
+     header.crc = (uint32_t)crc32(0L, (const Bytef *)ops->data, (uInt)ops->len);
+     header.lsn = journal->last_lsn + 1;
+     size_t before = journal->pending.len;
+     text_append(&journal->pending, (const char *)&header, sizeof(header));
+     text_append(&journal->pending, ops->data, ops->len);
+     uint64_t lsn = 0;
+     if (journal->pending.failed) {
+         journal->pending.failed = false; // Forget the half-added frame
+         journal->pending.len = before;
+     } else {
+         lsn = journal->last_lsn = header.lsn;
+         journal->frames_since_checkpoint++;
+     }
+     pthread_mutex_unlock(&journal->lock);
+     return lsn;
+ }
+
+ // Waits until frame lsn is on disk, writing the pending frames if nobody else is.
+ // Returns false if writing failed.
+ bool journal_wait(Journal *journal, uint64_t lsn) {
+     pthread_mutex_lock(&journal->lock);
+     while (journal->durable_lsn < lsn && !journal->failed) {
+         if (journal->flushing) {
+             pthread_cond_wait(&journal->flushed, &journal->lock); // Someone else is writing
+             continue;
+         }
+         // Take everything pending and write it with one write+fsync, without the lock
+         journal->flushing = true;
+         TextBuffer batch = journal->pending;
+         uint64_t batch_lsn = journal->last_lsn;
+         memset(&journal->pending, 0, sizeof(journal->pending));
+         pthread_mutex_unlock(&journal->lock);
+         bool ok = write_all(journal->log_fd, batch.data, batch.len) && fdatasync(journal->log_fd) == 0;
+         free(batch.data);
+         pthread_mutex_lock(&journal->lock);
+         journal->flushing = false;
+         if (ok)
+             journal->durable_lsn = batch_lsn;
+         else
+             journal->failed = true;
+         pthread_cond_broadcast(&journal->flushed);
+     }
+     bool ok = journal->durable_lsn >= lsn;
+     pthread_mutex_unlock(&journal->lock);
+     return ok;
+ }
+
+ // Replaces the log with a snapshot of state (which includes every frame up to lsn).
+ // Nothing else may be added to the journal meanwhile (the caller holds the write lock).
+ void journal_checkpoint(Journal *journal, const MeetingScheduler *state, uint64_t lsn) {
+     if (!journal_wait(journal, lsn) || !write_snapshot(journal, state, lsn))
+         return; // Keep the log; it still has everything
+     pthread_mutex_lock(&journal->lock);
+     // The snapshot has it all, so the log can start over (frames it might still hold
+     // are skipped when loading, since their numbers are not above the snapshot's)
+     if (ftruncate(journal->log_fd, 0) == 0)
+         journal->frames_since_checkpoint = 0;
+     pthread_mutex_unlock(&journal->lock);
+ }
+
+ // -------------------------
+ // SHARED STATE (THREAD SAFETY)
+ // -------------------------
+ 
+ // Requests are answered by several threads at once, so the scheduler is never changed
+ // while someone may be reading it. Instead, the current data lives in a "snapshot"
+ // that is read-only once published:
+ //   - Readers (schedule page, ICS export) grab a reference to the current snapshot and
+ //     render from it without holding any lock, for as long as they need.
+ //   - Writers (add meeting/reservation, clear) take write_lock, change a private copy
+ //     and then publish the copy as the new current snapshot. A failed change is simply
+ //     thrown away, so readers never see half-finished updates.
+ // The old snapshot is freed when its last reader lets go of it.
+ // With a journal, a change is only published once it is on disk. Writers build on the
+ // newest change (latest), which may still be on its way there, so the next writer need not
+ // wait for the disk; the changes are then published one after the other, in order.
+ 
+ // One published version of the scheduler data
+ typedef struct {
+     atomic_int refs;          // Number of holders (the store itself counts as one)
+     unsigned long generation; // Goes up by one with every published change
+     uint64_t lsn;             // Last log frame included (see PERSISTENCE), 0 if none
+     MeetingScheduler state;   // Scheduler data; never modified after publishing
+ } SchedulerSnapshot;
+ 
+ // Documents that are rendered once per generation and then reused (see CACHED VIEWS)
+ typedef enum { VIEW_SCHEDULE_HTML, VIEW_ICS, VIEW_SCHEDULE_JSON, VIEW_MEETINGS_JSON, VIEW_RESERVATIONS_JSON,
+                VIEW_ATTENDEES_JSON, VIEW_COUNT } ViewId;
+ 
+ // One encoding of a cached document
+ typedef struct {
+     struct MHD_Response *response;     // Full document (200 OK), NULL if not made
+     struct MHD_Response *not_modified; // Empty 304 reply for clients that already have it
+     char etag[64];                     // Version tag sent to clients (e.g., "\"6613a2f0-1-42\"")
+ } ViewEncoding;
+ 
+ // A rendered document kept for as long as the schedule does not change
+ typedef struct {
+     unsigned long generation; // Generation the responses were rendered from
+     ViewEncoding plain;       // As rendered (plain.response NULL = not rendered yet)
+     ViewEncoding gzip;        // Compressed, made for the first client that accepts gzip
+     bool gzip_tried;          // Compressing was tried (gzip.response NULL = it did not help)
+     const char *body;         // The rendered document, owned by plain.response
+     size_t body_len;
+ } CachedView;
+ 
+ // Lets go of an encoding's responses (clients still receiving one keep it alive inside
+ // libmicrohttpd)
+ void drop_encoding(ViewEncoding *encoding) {
+     if (encoding->response) MHD_destroy_response(encoding->response);
+     if (encoding->not_modified) MHD_destroy_response(encoding->not_modified);
+     encoding->response = encoding->not_modified = NULL;
+ }
+ 
+ // Lets go of both encodings of a view
+ void drop_view(CachedView *view) {
+     drop_encoding(&view->plain);
+     drop_encoding(&view->gzip);
+     view->gzip_tried = false;
+     view->body = NULL;
+ }
+ 
+ // One published change, as /api/changes sends it (see CHANGE FEED)
+ #define CHANGE_HISTORY 128 // Changes kept per store; clients further behind start over
+ typedef struct {
+     unsigned long generation; // Generation the change produced (0 = slot unused)
+     char *json;               // The change as a JSON object; NULL if it could not be described
+     size_t len;
+ } ChangeRecord;
+ 
+ // Owner of the current snapshot, shared by all server threads
+ typedef struct {
+     pthread_mutex_t write_lock;   // Held by the one writer allowed at a time
+     pthread_mutex_t current_lock; // Guards the current pointer while it is read or swapped
+     SchedulerSnapshot *current;   // Latest published snapshot
+     SchedulerSnapshot *latest;    // Newest change, which writers build on (guarded by write_lock);
+                                   // ahead of current while it is being saved
+     pthread_mutex_t publish_lock; // Guards publishing, so changes are published in order
+     pthread_cond_t published;     // Signalled when a change is published or could not be saved
+     unsigned long failed_generation; // First change that could not be saved (0 = none); it
+                                      // and every change built on it are never published
+     pthread_mutex_t cache_lock;   // Guards views
+     CachedView views[VIEW_COUNT]; // Last rendered copy of each document
+     unsigned long boot_id;        // Start time, so tags from an earlier run never match
+     unsigned long store_id;       // Unique per store, so one tenant's tags never match another's
+     Journal *journal;             // Where changes are saved (NULL = memory only)
+     // The last CHANGE_HISTORY changes, by generation % CHANGE_HISTORY (guarded by feed_lock)
+     ChangeRecord changes[CHANGE_HISTORY];
+     unsigned long feed_generation; // Newest generation in changes
+ } SchedulerStore;
+ 
+ // See CHANGE FEED
+ void feed_record(SchedulerStore *store, const SchedulerSnapshot *old, const SchedulerSnapshot *new);
+ void feed_close(SchedulerStore *store);
+ 
+ atomic_ulong next_store_id = 1; // Numbers handed out by store_init
+ 
+ // Drops one reference to a snapshot, freeing it when nobody uses it anymore
+ void snapshot_release(SchedulerSnapshot *snapshot) {
+     if (atomic_fetch_sub(&snapshot->refs, 1) == 1) {
+         free_scheduler(&snapshot->state);
+         free(snapshot);
+     }
+ }
+ 
+ // Sets up a store holding an empty schedule; returns false if out of memory
+ bool store_init(SchedulerStore *store) {
+     SchedulerSnapshot *snapshot = malloc(sizeof(SchedulerSnapshot));
+     if (!snapshot)
+         return false;
+     atomic_init(&snapshot->refs, 2); // References held by the store (as current and as latest)
+     snapshot->generation = 0;
+     snapshot->lsn = 0;
+     if (!init_scheduler(&snapshot->state)) {
+         free_scheduler(&snapshot->state);
+         free(snapshot);
+         return false;
+     }
+     pthread_mutex_init(&store->write_lock, NULL);
+     pthread_mutex_init(&store->current_lock, NULL);
+     pthread_mutex_init(&store->cache_lock, NULL);
+     pthread_mutex_init(&store->publish_lock, NULL);
+     pthread_cond_init(&store->published, NULL);
+     store->current = store->latest = snapshot;
+     store->failed_generation = 0;
+     memset(store->views, 0, sizeof(store->views)); // Nothing rendered yet
+     store->boot_id = (unsigned long)time(NULL);
+     store->store_id = atomic_fetch_add(&next_store_id, 1);
+     store->journal = NULL;
+     memset(store->changes, 0, sizeof(store->changes));
+     store->feed_generation = 0;
+     return true;
+ }
+ 
+ // Writes generation of store the way clients see it, "<boot_id>-<store_id>-<generation>"
+ // (like the ETags): generations start again from 0 in every new store (after a restart,
+ // or when an evicted tenant is loaded again), and the first two parts tell them apart
+ #define GENERATION_TOKEN_MAX 64
+ void generation_token(const SchedulerStore *store, unsigned long generation, char *out) {
+     snprintf(out, GENERATION_TOKEN_MAX, "%lx-%lx-%lu", store->boot_id, store->store_id, generation);
+ }
+ 
+ // Loads the saved schedule of tenant id into a new store and saves changes from now on
+ // (does nothing without --data-dir). Returns NULL if fine, otherwise what is wrong.
+ const char *store_open(SchedulerStore *store, const char *id) {
+     if (!data_dir)
+         return NULL;
+     return journal_open(id, &store->current->state, &store->journal, &store->current->lsn);
+ }
+ 
+ // Checks if a journal has failed, or (with checkpoint) has enough frames for a new snapshot
+ bool journal_check(Journal *journal, bool checkpoint) {
+     pthread_mutex_lock(&journal->lock);
+     bool result = checkpoint ? journal->frames_since_checkpoint >= CHECKPOINT_EVERY : journal->failed;
+     pthread_mutex_unlock(&journal->lock);
+     return result;
+ }
+ 
+ // Frees everything a store owns (no request may be using it anymore)
+ void store_destroy(SchedulerStore *store) {
+     if (store->journal) {
+         // Everything is on disk already; a fresh snapshot just makes the next load quicker
+         if (store->journal->frames_since_checkpoint > 0)
+             journal_checkpoint(store->journal, &store->latest->state, store->latest->lsn);
+         journal_close(store->journal);
+     }
+     feed_close(store);
+     snapshot_release(store->current);
+     snapshot_release(store->latest);
+     for (int i = 0; i < VIEW_COUNT; i++)
+         drop_view(&store->views[i]); // Clients still receiving it keep it alive inside libmicrohttpd
+     pthread_mutex_destroy(&store->write_lock);
+     pthread_mutex_destroy(&store->current_lock);
+     pthread_mutex_destroy(&store->cache_lock);
+     pthread_mutex_destroy(&store->publish_lock);
+     pthread_cond_destroy(&store->published);
+ }
+ 
+ // Returns the current snapshot for reading; call snapshot_release when done
+ SchedulerSnapshot *store_acquire(SchedulerStore *store) {
+     pthread_mutex_lock(&store->current_lock);
+     SchedulerSnapshot *snapshot = store->current;
+     atomic_fetch_add(&snapshot->refs, 1);
+     pthread_mutex_unlock(&store->current_lock);
+     return snapshot;
+ }
+ 
+ // Starts a change: locks out other writers and returns a private copy of the newest
+ // data. Finish with store_commit (publish) or store_abort (discard). NULL if out of memory.
+ SchedulerSnapshot *store_begin_write(SchedulerStore *store) {
+     pthread_mutex_lock(&store->write_lock);
+     SchedulerSnapshot *copy = malloc(sizeof(SchedulerSnapshot));
+     // latest is only replaced by writers, and we are the writer
+     if (!copy || !copy_scheduler(&copy->state, &store->latest->state)) {
+         free(copy);
+         pthread_mutex_unlock(&store->write_lock);
+         return NULL;
+     }
+     copy->generation = store->latest->generation + 1; // Every change is a new version
+     copy->lsn = store->latest->lsn;
+     atomic_init(&copy->refs, 1);
+     return copy;
+ }
+ 
+ // Throws away the copy without publishing it and ends the change
+ void store_abort(SchedulerStore *store, SchedulerSnapshot *copy) {
+     pthread_mutex_unlock(&store->write_lock);
+     snapshot_release(copy);
+ }
+ 
+ // Writes a new snapshot and empties the log, if the log has grown long enough
+ void store_checkpoint(SchedulerStore *store) {
+     pthread_mutex_lock(&store->write_lock); // No new frames meanwhile
+     if (journal_check(store->journal, true)) { // Another writer may just have done it
+         // The string arena keeps the names of deleted meetings; the new snapshot is the
+         // time to drop them. latest is only read by writers, so a compacted copy of it (the
+         // same schedule, with other string offsets) can take its place.
+         SchedulerSnapshot *compact = malloc(sizeof(SchedulerSnapshot));
+         if (compact && copy_scheduler(&compact->state, &store->latest->state)) {
+             compact_strings(&compact->state); // Stays as it is if out of memory
+             compact->generation = store->latest->generation;
+             compact->lsn = store->latest->lsn;
+             atomic_init(&compact->refs, 1);
+             snapshot_release(store->latest);
+             store->latest = compact;
+         } else {
+             free(compact);
+         }
+         journal_checkpoint(store->journal, &store->latest->state, store->latest->lsn);
+     }
+     pthread_mutex_unlock(&store->write_lock);
+ }
+ 
+ // Publishes the changed copy as the new current snapshot and ends the change. With a
+ // journal, the change is logged first and only published once it is on disk. Returns
+ // false if it could not be saved; it is then never published.
+ bool store_commit(SchedulerStore *store, SchedulerSnapshot *copy) {
+     Journal *journal = store->journal;
+     uint64_t lsn = 0;
+     if (journal) {
+         TextBuffer ops = {0};
+         bool ok = !journal_check(journal, false) && encode_changes(&ops, &store->latest->state, &copy->state);
+         if (ok && ops.len > 0) { // Nothing to log if nothing changed
+             lsn = journal_append(journal, &ops);
+             ok = lsn != 0;
+             copy->lsn = lsn;
+         }
+         free(ops.data);
+         if (!ok) {
+             store_abort(store, copy);
+             return false;
+         }
+     }
+     SchedulerSnapshot *before = store->latest;
+     atomic_fetch_add(&copy->refs, 1); // One reference as latest, one as current (below)
+     store->latest = copy;
+     pthread_mutex_unlock(&store->write_lock);
+     snapshot_release(before);
+     // Other writers can log their changes while this one waits (group commit)
+     bool saved = lsn == 0 || journal_wait(journal, lsn);
+     if (!saved)
+         fprintf(stderr, "Cannot write %s; changes are no longer saved\n", journal->log_path);
+
+     // Publish after the change before it, unless that (or this) one could not be saved.
+     // Once the journal has failed nothing is saved anymore, so every later change fails too.
+     pthread_mutex_lock(&store->publish_lock);
+     if (!saved && (store->failed_generation == 0 || copy->generation < store->failed_generation))
+         store->failed_generation = copy->generation;
+     while (saved && store->current->generation != copy->generation - 1 &&
+            !(store->failed_generation != 0 && store->failed_generation < copy->generation))
+         pthread_cond_wait(&store->published, &store->publish_lock);
+     saved = saved && store->current->generation == copy->generation - 1;
+     SchedulerSnapshot *old = copy; // What to let go of: the copy if it is not published
+     if (saved) {
+         pthread_mutex_lock(&store->current_lock);
+         old = store->current;
+         store->current = copy;
+         pthread_mutex_unlock(&store->current_lock);
+         feed_record(store, old, copy); // In turn, so changes are fed in order
+     }
+     pthread_cond_broadcast(&store->published);
+     pthread_mutex_unlock(&store->publish_lock);
+     snapshot_release(old); // Freed now, or when its last reader finishes
+     if (saved && lsn != 0 && journal_check(journal, true))
+         store_checkpoint(store);
+     return saved;
+ }
+ 
+ // -------------------------
+ // STREAMING OUTPUT
+ // -------------------------
+ 
+ // Big pages are not built with repeated strcat. Instead they are produced one small
+ // "record" at a time (a header, one table row, ...) and each record is copied straight
+ // to the end of the output. Every byte is written once and copied once, so rendering
+ // takes linear time no matter how many meetings are scheduled.
+ #define RECORD_MAX 8192    // Largest single record (a meeting with MAX_MEETING_ATTENDEES fits)
+ #define STREAM_BLOCK 4096  // How many bytes are produced per step
+ 
+ typedef struct OutputStream OutputStream;
+ 
+ // Writes the next record into out->record; returns false once the document is finished
+ typedef bool (*NextRecordFn)(OutputStream *out);
+ 
+ // State of one document being produced
+ struct OutputStream {
+     MeetingScheduler *scheduler; // Data being rendered
+     NextRecordFn next_record;    // Produces the next piece of the document
+     int stage;                   // Which part of the document comes next
+     int week, day, index;        // Position inside the schedule
+     int written;                 // Items written in the current JSON list (for the commas)
+     char record[RECORD_MAX];     // The record currently being sent
+     size_t record_len;           // Bytes stored in record
+     size_t record_pos;           // Bytes of record already copied out
+ };
+ 
+ // Formats text into the current record (like printf, but into out->record)
+ void record_printf(OutputStream *out, const char *format, ...) {
+     va_list args;
+     va_start(args, format);
+     int n = vsnprintf(out->record, RECORD_MAX, format, args);
+     va_end(args);
+     if (n < 0) n = 0;
+     if (n >= RECORD_MAX) n = RECORD_MAX - 1; // Record was cut short to fit
+     out->record_len = (size_t)n;
+ }
+ 
+ // Copies up to max bytes of the document into buf, continuing where the last call stopped.
+ // Returns the number of bytes copied, or MHD_CONTENT_READER_END_OF_STREAM when finished.
+ ssize_t stream_read(OutputStream *out, char *buf, size_t max) {
+     size_t written = 0;
+     while (written < max) {
+         // Current record fully sent? Produce the next one
+         if (out->record_pos == out->record_len) {
+             out->record_len = 0;
+             out->record_pos = 0;
+             if (!out->next_record(out))
+                 break; // Document finished
+         }
+         size_t n = out->record_len - out->record_pos;
+         if (n > max - written)
+             n = max - written; // Only part of the record fits this time
+         memcpy(buf + written, out->record + out->record_pos, n);
+         out->record_pos += n;
+         written += n;
+     }
+     if (written == 0)
+         return MHD_CONTENT_READER_END_OF_STREAM; // Nothing left to send
+     return (ssize_t)written;
+ }
+ 
+ // Renders a whole document into one malloc'd buffer (caller frees), storing its length in *len.
+ // Returns NULL if out of memory.
+ char *render_document(MeetingScheduler *scheduler, NextRecordFn next_record, size_t *len) {
+     OutputStream *out = calloc(1, sizeof(OutputStream));
+     size_t capacity = 4 * STREAM_BLOCK;
+     char *buffer = malloc(capacity);
+     if (!out || !buffer) {
+         free(out);
+         free(buffer);
+         return NULL; // Out of memory
+     }
+     out->scheduler = scheduler;
+     out->next_record = next_record;
+     *len = 0;
+     for (;;) {
+         // Keep at least one block of room at the end, doubling the buffer when needed
+         if (capacity - *len < STREAM_BLOCK) {
+             char *bigger = realloc(buffer, capacity * 2);
+             if (!bigger) {
+                 free(out);
+                 free(buffer);
+                 return NULL;
+             }
+             buffer = bigger;
+             capacity *= 2;
+         }
+         ssize_t n = stream_read(out, buffer + *len, capacity - *len);
+         if (n == MHD_CONTENT_READER_END_OF_STREAM)
+             break; // Document complete
+         *len += (size_t)n;
+     }
+     free(out);
+     return buffer;
+ }
+ 
+ // -------------------------
+ // OUTPUT GENERATION
+ // -------------------------
+ 
+ // Every string a user typed (names, types, attendees) is escaped for the document it goes
+ // into: anyone may write into any tenant's schedule, and others read it.
+ #define JSON_STR_MAX (MAX_STR * 6) // Longest escaped string (every byte as \u00XX)
+ 
+ // Copies text into out as the inside of a JSON string (quotes, backslashes and control
+ // characters escaped)
+ void json_escape(const char *text, char *out) {
+     size_t len = 0;
+     for (const unsigned char *p = (const unsigned char *)text; *p && len < JSON_STR_MAX - 7; p++) {
+         if (*p == '"' || *p == '\\') {
+             out[len++] = '\\';
+             out[len++] = (char)*p;
+         } else if (*p < 0x20) {
+             len += (size_t)snprintf(out + len, 7, "\\u%04x", *p);
+         } else {
+             out[len++] = (char)*p;
+         }
+     }
+     out[len] = '\0';
+ }
+ 
+ #define HTML_STR_MAX (MAX_STR * 6) // Longest escaped string (every byte as &quot;)
+ 
+ // Copies text into out with the characters that mean something in HTML (<, >, &, quotes)
+ // written as entities, so names and types typed by users show up as text and never as markup
+ void html_escape(const char *text, char *out) {
+     size_t len = 0;
+     for (const char *p = text; *p && len < HTML_STR_MAX - 7; p++) {
+         const char *entity = *p == '<' ? "&lt;" : *p == '>' ? "&gt;" : *p == '&' ? "&amp;" :
+                              *p == '"' ? "&quot;" : *p == '\'' ? "&#39;" : NULL;
+         if (entity) {
+             memcpy(out + len, entity, strlen(entity));
+             len += strlen(entity);
+         } else {
+             out[len++] = *p;
+         }
+     }
+     out[len] = '\0';
+ }
+ 
+ #define ICS_STR_MAX (MAX_STR * 2) // Longest escaped string (every byte as "\,")
+ 
+ // Copies text into out as an ICS TEXT value: backslashes, ';' and ',' escaped, line breaks
+ // written as "\n" and other control characters left out, so a name can neither end its
+ // property nor start a new one
+ void ics_escape(const char *text, char *out) {
+     size_t len = 0;
+     for (const unsigned char *p = (const unsigned char *)text; *p && len < ICS_STR_MAX - 3; p++) {
+         if (*p == '\\' || *p == ';' || *p == ',') {
+             out[len++] = '\\';
+             out[len++] = (char)*p;
+         } else if (*p == '\n') {
+             out[len++] = '\\';
+             out[len++] = 'n';
+         } else if (*p >= 0x20 && *p != 0x7f) {
+             out[len++] = (char)*p;
+         }
+     }
+     out[len] = '\0';
+ }
+ 
+ // Writes the names of a set of attendees into out (size bytes), HTML-escaped, with ", "
+ // between them
+ void format_attendees_html(const MeetingScheduler *scheduler, AttendeeSet set, char *out, size_t size) {
+     size_t len = 0;
+     out[0] = '\0';
+     for (AttendeeSet left = set; left; left &= left - 1) {
+         char name[HTML_STR_MAX];
+         html_escape(scheduler_string(scheduler, scheduler->attendee_names[first_attendee(left)]), name);
+         if (len + strlen(name) + 3 > size)
+             return; // Cannot happen for up to MAX_MEETING_ATTENDEES
+         len += (size_t)snprintf(out + len, size - len, "%s%s", len ? ", " : "", name);
+     }
+ }
+ 
+ // Parts of the schedule page, in the order they are sent
+ enum { HTML_HEADER, HTML_WEEK_START, HTML_DAY_START, HTML_MEETING_ROWS, HTML_RESERVATION_ROWS,
+        HTML_WEEK_END, HTML_FOOTER, HTML_DONE };
+ 
+ // Alternate row colors per day for readability
+ const char *day_color(int day) {
+     return (day % 2 == 0) ? "#ffffff" : "#f2f2f2";
+ }
+ 
+ // Produces the schedule page (a table per week) one record at a time
+ bool next_schedule_html_record(OutputStream *out) {
+     MeetingScheduler *scheduler = out->scheduler;
+     switch (out->stage) {
+     case HTML_HEADER:
+         // HTML header with Bootstrap for styling
+         record_printf(out, "<!DOCTYPE html><html><head><meta charset='utf-8'><title>Schedule</title>"
+                            "<link rel='stylesheet' href='https://stackpath.bootstrapcdn.com/bootstrap/4.5.2/css/bootstrap.min.css'>"
+                            "<style>@media print { .no-print { display: none; } }</style>"
+                            "</head><body><div class='container'><h1>Weekly Meeting Schedule</h1>");
+         out->week = 0;
+         out->stage = (calendar.weeks > 0) ? HTML_WEEK_START : HTML_FOOTER;
+         return true;
+     case HTML_WEEK_START:
+         // Week header and start of its table
+         record_printf(out, "<h3>Week %d</h3>"
+                            "<table class='table table-bordered'><thead><tr>"
+                            "<th>Day</th><th>Start Time</th><th>End Time</th><th>Name</th><th>Type</th><th>Duration (min)</th><th>Frequency</th>"
+                            "<th>Attendees</th>"
+                            "</tr></thead><tbody>", out->week + 1);
+         out->day = 0;
+         out->stage = HTML_DAY_START;
+         return true;
+     case HTML_DAY_START:
+         // Jump to the first meeting of this week/day (nothing is written here)
+         if (out->day >= calendar.days) {
+             out->stage = HTML_WEEK_END; // All days done
+             return true;
+         }
+         out->index = scheduler->day_first[day_cell(out->week, out->day)];
+         out->stage = HTML_MEETING_ROWS;
+         return true;
+     case HTML_MEETING_ROWS:
+         // One row per call, following the day's list of meetings
+         if (out->index < 0) {
+             out->index = scheduler->reservation_first[out->day]; // Then the day's reservations
+             out->stage = HTML_RESERVATION_ROWS;
+             return true;
+         } else {
+             ScheduleEntry *s = &scheduler->schedule[out->index];
+             MeetingRecord *m = &scheduler->meetings[s->meeting_id];
+             char end_time[8], name[HTML_STR_MAX], type[HTML_STR_MAX];
+             char attendees[MAX_MEETING_ATTENDEES * (HTML_STR_MAX + 2)];
+             compute_end_time(s->start_time, m->duration, end_time);
+             html_escape(scheduler_string(scheduler, m->name), name);
+             html_escape(scheduler_string(scheduler, m->type), type);
+             format_attendees_html(scheduler, m->attendees, attendees, sizeof(attendees));
+             record_printf(out,
+                           "<tr style='background-color:%s;'><td>%s</td><td>%s</td><td>%s</td><td>%s</td><td>%s</td>"
+                           "<td>%d</td><td>%s</td><td>%s</td></tr>",
+                           day_color(out->day), DAYS[out->day], calendar.slot_names[s->start_time],
+                           end_time, name, type, m->duration * calendar.slot_minutes, FREQUENCIES[m->frequency],
+                           m->attendees ? attendees : "Everyone");
+             out->index = s->next_in_day;
+             return true;
+         }
+     case HTML_RESERVATION_ROWS:
+         if (out->index < 0) {
+             out->day++; // Day finished, move to the next one
+             out->stage = HTML_DAY_START;
+             return true;
+         } else {
+             Reservation *r = &scheduler->reservations[out->index];
+             char end_time[8];
+             compute_end_time(r->start_time, r->duration, end_time);
+             record_printf(out,
+                           "<tr style='background-color:%s;'><td>%s</td><td>%s</td><td>%s</td><td>Reserved (External)</td>"
+                           "<td>Reserved</td><td>%d</td><td>Weekly</td><td>Everyone</td></tr>",
+                           day_color(out->day), DAYS[out->day], calendar.slot_names[r->start_time], end_time,
+                           r->duration * calendar.slot_minutes);
+             out->index = r->next_in_day;
+             return true;
+         }
+     case HTML_WEEK_END:
+         record_printf(out, "</tbody></table>"); // End table
+         out->week++;
+         out->stage = (out->week < calendar.weeks) ? HTML_WEEK_START : HTML_FOOTER;
+         return true;
+     case HTML_FOOTER:
+         // Print button and link
+         record_printf(out, "<div class='no-print mt-4'><button class='btn btn-info' onclick='window.print()'>Print to PDF</button></div>"
+                            "<p class='mt-2'><a href='./'>Return to Main Page</a></p>"
+                            "</div></body></html>");
+         out->stage = HTML_DONE;
+         return true;
+     default:
+         return false; // Page complete
+     }
+ }
+ 
+ // First day of the calendar export: Monday, April 14, 2025
+ #define ICS_BASE_YEAR 2025
+ #define ICS_BASE_MONTH 4
+ #define ICS_BASE_DAY 14
+ 
+ // Counts days since 1970-01-01 for a calendar date (pure arithmetic, no mktime/time zones)
+ long days_from_civil(int year, int month, int day) {
+     year -= month <= 2;                               // Treat Jan/Feb as months 13/14 of the previous year
+     long era = (year >= 0 ? year : year - 399) / 400; // 400-year cycles
+     int yoe = year - (int)(era * 400);                // Year of era [0, 399]
+     int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1; // Day of year (from March 1)
+     int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;  // Day of era
+     return era * 146097 + doe - 719468;
+ }
+ 
+ // Turns a day count from days_from_civil back into year, month and day
+ void civil_from_days(long days, int *year, int *month, int *day) {
+     days += 719468;
+     long era = (days >= 0 ? days : days - 146096) / 146097;
+     int doe = (int)(days - era * 146097);
+     int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+     int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+     int mp = (5 * doy + 2) / 153;
+     *day = doy - (153 * mp + 2) / 5 + 1;
+     *month = mp + (mp < 10 ? 3 : -9);
+     *year = yoe + (int)(era * 400) + (*month <= 2);
+ }
+ 
+ // Formats the local start time of a slot as an ICS date (e.g., "20250415T103000")
+ void format_ics_datetime(int week, int day_idx, int slot_idx, char *out, size_t size) {
+     long base_days = days_from_civil(ICS_BASE_YEAR, ICS_BASE_MONTH, ICS_BASE_DAY);
+     int year, month, day;
+     civil_from_days(base_days + week * 7 + day_idx, &year, &month, &day);
+     int minutes = calendar.slot_start[slot_idx]; // Minutes after midnight
+     snprintf(out, size, "%04d%02d%02dT%02d%02d00", year, month, day, minutes / 60, minutes % 60);
+ }
+ 
+ // Writes the names of a set of attendees into out (size bytes), ICS-escaped, with "\, "
+ // between them (a plain ',' would split the TEXT value)
+ void format_attendees_ics(const MeetingScheduler *scheduler, AttendeeSet set, char *out, size_t size) {
+     size_t len = 0;
+     out[0] = '\0';
+     for (AttendeeSet left = set; left; left &= left - 1) {
+         char name[ICS_STR_MAX];
+         ics_escape(scheduler_string(scheduler, scheduler->attendee_names[first_attendee(left)]), name);
+         if (len + strlen(name) + 4 > size)
+             return; // Cannot happen for up to MAX_MEETING_ATTENDEES
+         len += (size_t)snprintf(out + len, size - len, "%s%s", len ? "\\, " : "", name);
+     }
+ }
+
+ #define ICS_LINE_MAX 75 // Longest content line in octets, without its CRLF (RFC 5545 section 3.1)
+
+ // Folds the lines of the current record that are longer than ICS_LINE_MAX: the rest goes on
+ // the next line, after CRLF and one space. A line is never split inside a UTF-8 character
+ // or between a backslash and the character it escapes.
+ void ics_fold_record(OutputStream *out) {
+     char folded[RECORD_MAX];
+     size_t len = 0;  // Bytes in folded
+     size_t line = 0; // Octets on the current line
+     const unsigned char *text = (const unsigned char *)out->record;
+     for (size_t i = 0; i < out->record_len;) {
+         // The piece that has to stay on one line: an escape, a UTF-8 character or one byte
+         size_t piece = 1;
+         if (text[i] == '\\' && i + 1 < out->record_len)
+             piece = 2;
+         else if (text[i] >= 0xc0)
+             while (piece < 4 && i + piece < out->record_len && (text[i + piece] & 0xc0) == 0x80)
+                 piece++;
+         if (text[i] == '\r' || text[i] == '\n') {
+             line = 0; // Line ends here
+         } else {
+             if (line + piece > ICS_LINE_MAX) {
+                 if (len + 3 >= RECORD_MAX)
+                     break; // Record was cut short to fit
+                 memcpy(folded + len, "\r\n ", 3);
+                 len += 3;
+                 line = 1; // The space counts
+             }
+             line += piece;
+         }
+         if (len + piece >= RECORD_MAX)
+             break;
+         memcpy(folded + len, text + i, piece);
+         len += piece;
+         i += piece;
+     }
+     memcpy(out->record, folded, len);
+     out->record_len = len;
+ }
+
+ // Parts of the ICS file, in the order they are sent
+ enum { ICS_HEADER, ICS_MEETINGS, ICS_RESERVATIONS, ICS_FOOTER, ICS_DONE };
+ 
+ // Produces the ICS file one VEVENT at a time. Every occurrence of a meeting is on the same
+ // day and time, every period weeks from its first week (see Placement), so a meeting is one
+ // series: its first occurrence, repeated every period weeks for as many weeks as it meets
+ // in (RRULE INTERVAL and COUNT). A reservation is one series of every week of the calendar.
+ bool next_ics_record(OutputStream *out) {
+     MeetingScheduler *scheduler = out->scheduler;
+     char dtstart_str[32];
+     switch (out->stage) {
+     case ICS_HEADER:
+         record_printf(out, "BEGIN:VCALENDAR\r\nPRODID:-//Meeting Scheduler//xAI//EN\r\nVERSION:2.0\r\n");
+         out->index = 0;
+         out->stage = ICS_MEETINGS;
+         return true;
+     case ICS_MEETINGS:
+         // Meetings first, in the order they were added
+         if (out->index < scheduler->meeting_count) {
+             int id = out->index++;
+             MeetingRecord *m = &scheduler->meetings[id];
+             const Placement *p = &scheduler->placements[id];
+             if (m->duration == 0 || p->phase < 0)
+                 return true; // Deleted
+             char name[ICS_STR_MAX], type[ICS_STR_MAX];
+             char attendees[MAX_MEETING_ATTENDEES * (ICS_STR_MAX + 3)];
+             ics_escape(scheduler_string(scheduler, m->name), name);
+             ics_escape(scheduler_string(scheduler, m->type), type);
+             format_attendees_ics(scheduler, m->attendees, attendees, sizeof(attendees));
+             int period = FREQ_PERIOD[m->frequency];
+             char interval[24] = ""; // Left out for weekly meetings: 1 is the default
+             if (period > 1)
+                 snprintf(interval, sizeof(interval), ";INTERVAL=%d", period);
+             format_ics_datetime(p->phase, p->day, p->start, dtstart_str, sizeof(dtstart_str));
+             record_printf(out,
+                           "BEGIN:VEVENT\r\nSUMMARY:%s (%s)\r\nDTSTART:%s\r\nDURATION:PT%dM\r\nRRULE:FREQ=WEEKLY%s;COUNT=%d\r\n"
+                           "DESCRIPTION:Type: %s\\, Duration: %d min\\, Frequency: %s\\, Attendees: %s\r\nEND:VEVENT\r\n",
+                           name, type, dtstart_str, m->duration * calendar.slot_minutes,
+                           interval, frequency_occurrences(m->frequency, p->phase),
+                           type, m->duration * calendar.slot_minutes, FREQUENCIES[m->frequency],
+                           m->attendees ? attendees : "everyone");
+             ics_fold_record(out); // Names and attendees make long lines
+             return true;
+         }
+         out->index = 0;
+         out->stage = ICS_RESERVATIONS;
+         return true;
+     case ICS_RESERVATIONS:
+         // Then reservations, from the first week
+         if (out->index < scheduler->reservation_count) {
+             Reservation *r = &scheduler->reservations[out->index++];
+             if (r->duration == 0)
+                 return true; // Deleted
+             format_ics_datetime(0, r->day, r->start_time, dtstart_str, sizeof(dtstart_str));
+             record_printf(out,
+                           "BEGIN:VEVENT\r\nSUMMARY:Reserved (External)\r\nDTSTART:%s\r\nDURATION:PT%dM\r\nRRULE:FREQ=WEEKLY;COUNT=%d\r\n"
+                           "DESCRIPTION:External commitment\\, Duration: %d min\r\nEND:VEVENT\r\n",
+                           dtstart_str, r->duration * calendar.slot_minutes, calendar.weeks,
+                           r->duration * calendar.slot_minutes);
+             return true;
+         }
+         out->stage = ICS_FOOTER;
+         return true;
+     case ICS_FOOTER:
+         record_printf(out, "END:VCALENDAR\r\n"); // End ICS
+         out->stage = ICS_DONE;
+         return true;
+     default:
+         return false; // File complete
+     }
+ }
+ 
+ // The JSON documents of the API (see JSON API) are streamed the same way, one object per
+ // record, straight from the schedule arrays.
+ 
+ // Writes a set of attendees into out (size bytes) as the inside of a JSON list of their names
+ void format_attendees_json(const MeetingScheduler *scheduler, AttendeeSet set, char *out, size_t size) {
+     size_t len = 0;
+     out[0] = '\0';
+     for (AttendeeSet left = set; left; left &= left - 1) {
+         char name[JSON_STR_MAX];
+         json_escape(scheduler_string(scheduler, scheduler->attendee_names[first_attendee(left)]), name);
+         if (len + strlen(name) + 4 > size)
+             return; // Cannot happen for up to MAX_MEETING_ATTENDEES
+         len += (size_t)snprintf(out + len, size - len, "%s\"%s\"", len ? "," : "", name);
+     }
+ }
+ 
+ // Writes one meeting as a JSON object into out (size bytes); returns its length
+ int format_meeting_json(const MeetingScheduler *scheduler, int meeting_id, char *out, size_t size) {
+     const MeetingRecord *m = &scheduler->meetings[meeting_id];
+     char name[JSON_STR_MAX], type[JSON_STR_MAX], fixed_day[16] = "null", fixed_time[16] = "null";
+     char preferred[8 * 8 + 1] = "";
+     char attendees[MAX_MEETING_ATTENDEES * (JSON_STR_MAX + 3)];
+     format_attendees_json(scheduler, m->attendees, attendees, sizeof(attendees));
+     json_escape(scheduler_string(scheduler, m->name), name);
+     json_escape(scheduler_string(scheduler, m->type), type);
+     if (m->fixed_day >= 0)
+         snprintf(fixed_day, sizeof(fixed_day), "\"%s\"", DAYS[m->fixed_day]);
+     if (m->fixed_time >= 0)
+         snprintf(fixed_time, sizeof(fixed_time), "\"%s\"", calendar.slot_names[m->fixed_time]);
+     size_t len = 0;
+     for (int i = 0; i < 8 && m->preferred_hours[i] >= 0; i++)
+         len += (size_t)snprintf(preferred + len, sizeof(preferred) - len, "%s\"%s\"", i ? "," : "",
+                                 calendar.slot_names[m->preferred_hours[i]]);
+     int n = snprintf(out, size,
+                      "{\"id\":%d,\"name\":\"%s\",\"type\":\"%s\",\"duration\":%d,\"frequency\":\"%s\","
+                      "\"fixed_day\":%s,\"fixed_time\":%s,\"preferred_times\":[%s],\"attendees\":[%s]}",
+                      meeting_id, name, type, m->duration * calendar.slot_minutes, FREQUENCIES[m->frequency],
+                      fixed_day, fixed_time, preferred, attendees);
+     return (n < 0 || (size_t)n >= size) ? (int)size - 1 : n;
+ }
+ 
+ // Writes one reservation as a JSON object into out (size bytes); returns its length
+ int format_reservation_json(const MeetingScheduler *scheduler, int index, char *out, size_t size) {
+     const Reservation *r = &scheduler->reservations[index];
+     char end_time[8];
+     compute_end_time(r->start_time, r->duration, end_time);
+     int n = snprintf(out, size, "{\"id\":%d,\"day\":\"%s\",\"start\":\"%s\",\"end\":\"%s\",\"duration\":%d}",
+                      index, DAYS[r->day], calendar.slot_names[r->start_time], end_time,
+                      r->duration * calendar.slot_minutes);
+     return (n < 0 || (size_t)n >= size) ? (int)size - 1 : n;
+ }
+ 
+ // Writes one schedule entry as a JSON object (week counted from 1, like on the pages)
+ int format_entry_json(const MeetingScheduler *scheduler, const ScheduleEntry *s, char *out, size_t size) {
+     const MeetingRecord *m = &scheduler->meetings[s->meeting_id];
+     char name[JSON_STR_MAX], type[JSON_STR_MAX], end_time[8];
+     json_escape(scheduler_string(scheduler, m->name), name);
+     json_escape(scheduler_string(scheduler, m->type), type);
+     compute_end_time(s->start_time, m->duration, end_time);
+     int n = snprintf(out, size,
+                      "{\"week\":%d,\"day\":\"%s\",\"start\":\"%s\",\"end\":\"%s\",\"meeting_id\":%u,"
+                      "\"name\":\"%s\",\"type\":\"%s\",\"duration\":%d,\"frequency\":\"%s\"}",
+                      s->week + 1, DAYS[s->day], calendar.slot_names[s->start_time], end_time, s->meeting_id,
+                      name, type, m->duration * calendar.slot_minutes, FREQUENCIES[m->frequency]);
+     return (n < 0 || (size_t)n >= size) ? (int)size - 1 : n;
+ }
+ 
+ // Parts of the JSON documents, in the order they are sent
+ enum { JSON_HEADER, JSON_DAY_START, JSON_ENTRIES, JSON_RESERVATIONS_START, JSON_RESERVATIONS,
+        JSON_MEETINGS, JSON_ATTENDEES, JSON_FOOTER, JSON_DONE };
+ 
+ // Starts the current record with a comma unless it is the first item of its list
+ int json_separator(OutputStream *out) {
+     if (out->written++ == 0)
+         return 0;
+     out->record[0] = ',';
+     return 1;
+ }
+ 
+ // Produces /api/schedule: every scheduled occurrence in calendar order, then the reservations
+ bool next_schedule_json_record(OutputStream *out) {
+     MeetingScheduler *scheduler = out->scheduler;
+     switch (out->stage) {
+     case JSON_HEADER:
+         record_printf(out, "{\"weeks\":%d,\"days\":%d,\"slot_minutes\":%d,\"entries\":[",
+                       calendar.weeks, calendar.days, calendar.slot_minutes);
+         out->week = out->day = out->written = 0;
+         out->stage = JSON_DAY_START;
+         return true;
+     case JSON_DAY_START:
+         // Visit each week/day list in turn (nothing is written here)
+         if (out->day >= calendar.days) {
+             out->day = 0;
+             out->week++;
+         }
+         if (out->week >= calendar.weeks) {
+             out->stage = JSON_RESERVATIONS_START;
+             return true;
+         }
+         out->index = scheduler->day_first[day_cell(out->week, out->day)];
+         out->stage = JSON_ENTRIES;
+         return true;
+     case JSON_ENTRIES:
+         if (out->index < 0) {
+             out->day++; // Day finished
+             out->stage = JSON_DAY_START;
+             return true;
+         } else {
+             ScheduleEntry *s = &scheduler->schedule[out->index];
+             int comma = json_separator(out);
+             out->record_len = comma + format_entry_json(scheduler, s, out->record + comma, RECORD_MAX - comma);
+             out->index = s->next_in_day;
+             return true;
+         }
+     case JSON_RESERVATIONS_START:
+         record_printf(out, "],\"reservations\":[");
+         out->index = out->written = 0;
+         out->stage = JSON_RESERVATIONS;
+         return true;
+     case JSON_RESERVATIONS:
+         if (out->index < scheduler->reservation_count) {
+             if (scheduler->reservations[out->index].duration == 0) {
+                 out->index++; // Deleted
+                 return true;
+             }
+             int comma = json_separator(out);
+             out->record_len = comma + format_reservation_json(scheduler, out->index++, out->record + comma,
+                                                               RECORD_MAX - comma);
+             return true;
+         }
+         out->stage = JSON_FOOTER;
+         return true;
+     case JSON_FOOTER:
+         record_printf(out, "]}");
+         out->stage = JSON_DONE;
+         return true;
+     default:
+         return false; // Document complete
+     }
+ }
+ 
+ // Produces /api/meetings: every accepted meeting (not deleted), as it was asked for
+ bool next_meetings_json_record(OutputStream *out) {
+     MeetingScheduler *scheduler = out->scheduler;
+     switch (out->stage) {
+     case JSON_HEADER:
+         record_printf(out, "{\"meetings\":[");
+         out->index = out->written = 0;
+         out->stage = JSON_MEETINGS;
+         return true;
+     case JSON_MEETINGS:
+         if (out->index < scheduler->meeting_count) {
+             if (meeting_deleted(scheduler, out->index)) {
+                 out->index++;
+                 return true;
+             }
+             int comma = json_separator(out);
+             out->record_len = comma + format_meeting_json(scheduler, out->index++, out->record + comma,
+                                                           RECORD_MAX - comma);
+             return true;
+         }
+         out->stage = JSON_FOOTER;
+         return true;
+     case JSON_FOOTER:
+         record_printf(out, "]}");
+         out->stage = JSON_DONE;
+         return true;
+     default:
+         return false;
+     }
+ }
+ 
+ // Produces /api/attendees: every attendee, with how many meetings they attend and for how
+ // many minutes of the whole calendar they are booked (the set bits of their slots)
+ bool next_attendees_json_record(OutputStream *out) {
+     MeetingScheduler *scheduler = out->scheduler;
+     switch (out->stage) {
+     case JSON_HEADER:
+         record_printf(out, "{\"attendees\":[");
+         out->index = out->written = 0;
+         out->stage = JSON_ATTENDEES;
+         return true;
+     case JSON_ATTENDEES:
+         if (out->index < scheduler->attendee_count) {
+             int a = out->index++;
+             int meetings = 0;
+             for (int i = 0; i < scheduler->meeting_count; i++)
+                 meetings += !meeting_deleted(scheduler, i) && (scheduler->meetings[i].attendees >> a & 1);
+             long booked = 0;
+             const SlotMask *row = attendee_row(scheduler, a);
+             for (int c = 0; c < calendar.weeks * calendar.days; c++)
+                 booked += __builtin_popcountll(row[c]);
+             char name[JSON_STR_MAX];
+             json_escape(scheduler_string(scheduler, scheduler->attendee_names[a]), name);
+             int comma = json_separator(out);
+             int n = snprintf(out->record + comma, RECORD_MAX - comma,
+                              "{\"id\":%d,\"name\":\"%s\",\"meetings\":%d,\"booked_minutes\":%ld}",
+                              a, name, meetings, booked * calendar.slot_minutes);
+             out->record_len = comma + (n < 0 ? 0 : (size_t)n);
+             return true;
+         }
+         out->stage = JSON_FOOTER;
+         return true;
+     case JSON_FOOTER:
+         record_printf(out, "]}");
+         out->stage = JSON_DONE;
+         return true;
+     default:
+         return false;
+     }
+ }
+ 
+ // Produces /api/reservations
+ bool next_reservations_json_record(OutputStream *out) {
+     if (out->stage == JSON_HEADER) {
+         record_printf(out, "{\"reservations\":[");
+         out->index = out->written = 0;
+         out->stage = JSON_RESERVATIONS;
+         return true;
+     }
+     return next_schedule_json_record(out); // The rest is the same as the end of /api/schedule
+ }
+ 
+ // -------------------------
+ // METRICS
+ // -------------------------
+ 
+ // GET /metrics reports what the server has done since it started, for all tenants together,
+ // in the Prometheus text format: requests and their latency per route, placement attempts
+ // and why they failed, solver runs, and the time and size of each cached view render.
+ // Every thread counts into its own ThreadMetrics, which no other thread writes, so counting
+ // is a plain add: no locks, no atomic read-modify-write, no cache lines bouncing between
+ // threads. Only /metrics reads them all (with relaxed atomic loads, so a total may be a
+ // moment behind but is never torn).
+ 
+ // Every path handle_request answers is a route; anything else counts as "other"
+ typedef enum {
+     ROUTE_MAIN, ROUTE_ADD_RESERVATION, ROUTE_ADD_MEETING, ROUTE_SCHEDULE, ROUTE_ICS, ROUTE_IMPORT,
+     ROUTE_CLEAR, ROUTE_API_SCHEDULE, ROUTE_API_MEETINGS, ROUTE_API_RESERVATIONS, ROUTE_API_DELETE_MEETING,
+     ROUTE_API_MOVE_MEETING, ROUTE_API_DELETE_RESERVATION, ROUTE_API_MOVE_RESERVATION, ROUTE_API_WHATIF,
+     ROUTE_API_CHANGES, ROUTE_API_FREE, ROUTE_API_ATTENDEES, ROUTE_METRICS,
+     ROUTE_OTHER, ROUTE_COUNT
+ } Route;
+ 
+ const char *ROUTE_PATHS[ROUTE_COUNT] = {
+     "/", "/addReservation", "/addMeeting", "/displaySchedule", "/exportICS", "/importMeetings",
+     "/clearSession", "/api/schedule", "/api/meetings", "/api/reservations", "/api/meetings/delete",
+     "/api/meetings/move", "/api/reservations/delete", "/api/reservations/move", "/api/whatif", "/api/changes",
+     "/api/free", "/api/attendees", "/metrics", "other",
+ };
+ 
+ // Finds the route of a path (with any tenant prefix already removed)
+ Route find_route(const char *url) {
+     for (int i = 0; i < ROUTE_OTHER; i++) {
+         if (strcmp(url, ROUTE_PATHS[i]) == 0)
+             return (Route)i;
+     }
+     return ROUTE_OTHER;
+ }
+ 
+ // A histogram counts values into buckets: buckets[i] counts the values up to bounds[i]
+ // that did not fit an earlier bucket. The last bound is UINT64_MAX (Prometheus "+Inf").
+ // Each kind of histogram has its own bounds, and as many buckets as it has bounds.
+ #define HISTOGRAM_BUCKETS 14 // Most buckets of any histogram
+ 
+ typedef struct {
+     const uint64_t *bounds;
+     int count; // Number of bounds (and buckets)
+ } BucketBounds;
+ 
+ const uint64_t TIME_BOUND_VALUES[] = { // Nanoseconds: 50 us to 1 s
+     50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000, 25000000,
+     50000000, 100000000, 250000000, 1000000000, UINT64_MAX,
+ };
+ const uint64_t BYTE_BOUND_VALUES[] = { // 1 KiB to 16 MiB
+     1024, 4096, 16384, 65536, 262144, 1048576, 4194304, 16777216, UINT64_MAX,
+ };
+ #define BUCKET_BOUNDS(values) {values, (int)(sizeof(values) / sizeof(values[0]))}
+ const BucketBounds TIME_BOUNDS = BUCKET_BOUNDS(TIME_BOUND_VALUES);
+ const BucketBounds BYTE_BOUNDS = BUCKET_BOUNDS(BYTE_BOUND_VALUES);
+ _Static_assert(sizeof(TIME_BOUND_VALUES) <= HISTOGRAM_BUCKETS * sizeof(uint64_t), "raise HISTOGRAM_BUCKETS");
+ _Static_assert(sizeof(BYTE_BOUND_VALUES) <= HISTOGRAM_BUCKETS * sizeof(uint64_t), "raise HISTOGRAM_BUCKETS");
+ 
+ typedef struct {
+     atomic_ullong buckets[HISTOGRAM_BUCKETS];
+     atomic_ullong sum; // Sum of all values
+ } Histogram;
+ 
+ // The counts of one thread
+ typedef struct ThreadMetrics {
+     atomic_ullong counters[COUNTER_COUNT];
+     Histogram request_time[ROUTE_COUNT]; // Time to answer, in ns
+     Histogram render_time[VIEW_COUNT];   // Time to render each cached view, in ns
+     Histogram render_bytes[VIEW_COUNT];  // Size of each render
+     struct ThreadMetrics *next;          // Next in metrics_list
+ } ThreadMetrics;
+ 
+ // Every thread's counts, newest first. They are never freed, so nothing is lost when a
+ // thread ends (the server's threads live as long as it does anyway).
+ ThreadMetrics *metrics_list = NULL;
+ pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER; // Guards metrics_list
+ _Thread_local ThreadMetrics *thread_metrics = NULL;       // The calling thread's counts
+ 
+ // Current time in nanoseconds (only differences mean anything)
+ long long now_ns(void) {
+     struct timespec now;
+     clock_gettime(CLOCK_MONOTONIC, &now);
+     return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+ }
+ 
+ // The calling thread's counts, set up on first use; NULL if out of memory (then the
+ // thread counts nothing)
+ ThreadMetrics *my_metrics(void) {
+     if (!thread_metrics) {
+         ThreadMetrics *metrics = calloc(1, sizeof(ThreadMetrics));
+         if (!metrics)
+             return NULL;
+         pthread_mutex_lock(&metrics_lock);
+         metrics->next = metrics_list;
+         metrics_list = metrics;
+         pthread_mutex_unlock(&metrics_lock);
+         thread_metrics = metrics;
+     }
+     return thread_metrics;
+ }
+ 
+ // Adds to a number only the calling thread writes
+ void metric_add(atomic_ullong *number, uint64_t amount) {
+     atomic_store_explicit(number, atomic_load_explicit(number, memory_order_relaxed) + amount,
+                           memory_order_relaxed);
+ }
+ 
+ void count_event(Counter counter, uint64_t amount) {
+     ThreadMetrics *metrics = my_metrics();
+     if (metrics)
+         metric_add(&metrics->counters[counter], amount);
+ }
+ 
+ void observe(Histogram *histogram, const BucketBounds *bounds, uint64_t value) {
+     int i = 0;
+     while (i < bounds->count - 1 && value > bounds->bounds[i])
+         i++;
+     metric_add(&histogram->buckets[i], 1);
+     metric_add(&histogram->sum, value);
+ }
+ 
+ // Records how long a request took
+ void observe_request(Route route, long long ns) {
+     ThreadMetrics *metrics = my_metrics();
+     if (metrics)
+         observe(&metrics->request_time[route], &TIME_BOUNDS, ns);
+ }
+ 
+ // Records one render of a cached view
+ void observe_render(ViewId id, long long ns, size_t bytes) {
+     ThreadMetrics *metrics = my_metrics();
+     if (metrics) {
+         observe(&metrics->render_time[id], &TIME_BOUNDS, ns);
+         observe(&metrics->render_bytes[id], &BYTE_BOUNDS, bytes);
+     }
+ }
+ 
+ // How each counter is reported. Counters with the same name are one family and differ by
+ // their labels.
+ typedef struct {
+     const char *name;
+     const char *labels; // e.g. "{reason=\"no_slot\"}", or "" for none
+     const char *help;
+ } CounterInfo;
+ 
+ const CounterInfo COUNTERS[COUNTER_COUNT] = {
+     [COUNT_PLACEMENT_ATTEMPTS] = {"cweb_placement_attempts_total", "", "Meetings add_meeting tried to place"},
+     [COUNT_PLACEMENTS] = {"cweb_placements_total", "", "Meetings add_meeting placed"},
+     [COUNT_PLACEMENT_CANDIDATES] = {"cweb_placement_candidates_total", "", "Day and phase pairs add_meeting checked"},
+     [COUNT_FAILED_FIXED_TIME] = {"cweb_placement_failures_total", "{reason=\"fixed_time\"}", "Meetings add_meeting could not place, by reason"},
+     [COUNT_FAILED_DAY_FULL] = {"cweb_placement_failures_total", "{reason=\"day_full\"}", NULL},
+     [COUNT_FAILED_NO_SLOT] = {"cweb_placement_failures_total", "{reason=\"no_slot\"}", NULL},
+     [COUNT_FAILED_NO_MEMORY] = {"cweb_placement_failures_total", "{reason=\"no_memory\"}", NULL},
+     [COUNT_FAILED_ATTENDEES] = {"cweb_placement_failures_total", "{reason=\"attendees\"}", NULL},
+     [COUNT_RESERVATION_ATTEMPTS] = {"cweb_reservation_attempts_total", "", "Reservations reserve_slot tried to make"},
+     [COUNT_RESERVATIONS] = {"cweb_reservations_total", "", "Reservations reserve_slot made"},
+     [COUNT_SOLVER_RUNS] = {"cweb_solver_runs_total", "", "Times the constraint solver ran"},
+     [COUNT_SOLVER_SOLVED] = {"cweb_solver_solved_total", "", "Solver runs that found a schedule"},
+     [COUNT_SOLVER_TIMEOUTS] = {"cweb_solver_timeouts_total", "", "Solver runs that ran out of time"},
+     [COUNT_SOLVER_STEPS] = {"cweb_solver_steps_total", "", "Search steps taken by the solver"},
+ };
+ 
+ const char *VIEW_NAMES[VIEW_COUNT] = {"schedule_html", "ics", "schedule_json", "meetings_json", "reservations_json",
+                                      "attendees_json"};
+ 
+ // One histogram added up over every thread
+ typedef struct {
+     uint64_t buckets[HISTOGRAM_BUCKETS];
+     uint64_t sum;
+ } HistogramTotal;
+ 
+ void add_histogram(HistogramTotal *total, Histogram *histogram) {
+     for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+         total->buckets[i] += atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+     total->sum += atomic_load_explicit(&histogram->sum, memory_order_relaxed);
+ }
+ 
+ // Writes one histogram with one label; scale turns values into the reported unit
+ void print_histogram(TextBuffer *out, const char *name, const char *label, const char *value,
+                      const HistogramTotal *total, const BucketBounds *bounds, double scale) {
+     uint64_t count = 0;
+     for (int i = 0; i < bounds->count; i++) {
+         count += total->buckets[i];
+         if (bounds->bounds[i] == UINT64_MAX)
+             text_printf(out, "%s_bucket{%s=\"%s\",le=\"+Inf\"} %llu\n", name, label, value, (unsigned long long)count);
+         else
+             text_printf(out, "%s_bucket{%s=\"%s\",le=\"%g\"} %llu\n", name, label, value,
+                         bounds->bounds[i] * scale, (unsigned long long)count);
+     }
+     text_printf(out, "%s_sum{%s=\"%s\"} %.9g\n", name, label, value, total->sum * scale);
+     text_printf(out, "%s_count{%s=\"%s\"} %llu\n", name, label, value, (unsigned long long)count);
+ }
+ 
+ // Answers GET /metrics
+ enum MHD_Result serve_metrics(struct MHD_Connection *connection) {
+     // Add up every thread's counts
+     uint64_t counters[COUNTER_COUNT] = {0};
+     HistogramTotal request_time[ROUTE_COUNT] = {0}, render_time[VIEW_COUNT] = {0}, render_bytes[VIEW_COUNT] = {0};
+     pthread_mutex_lock(&metrics_lock);
+     ThreadMetrics *first = metrics_list;
+     pthread_mutex_unlock(&metrics_lock); // Threads only ever add in front of first
+     for (ThreadMetrics *m = first; m; m = m->next) {
+         for (int i = 0; i < COUNTER_COUNT; i++)
+             counters[i] += atomic_load_explicit(&m->counters[i], memory_order_relaxed);
+         for (int i = 0; i < ROUTE_COUNT; i++)
+             add_histogram(&request_time[i], &m->request_time[i]);
+         for (int i = 0; i < VIEW_COUNT; i++) {
+             add_histogram(&render_time[i], &m->render_time[i]);
+             add_histogram(&render_bytes[i], &m->render_bytes[i]);
+         }
+     }
+ 
+     TextBuffer out = {0};
+     for (int i = 0; i < COUNTER_COUNT; i++) {
+         if (COUNTERS[i].help)
+             text_printf(&out, "# HELP %s %s\n# TYPE %s counter\n", COUNTERS[i].name, COUNTERS[i].help, COUNTERS[i].name);
+         text_printf(&out, "%s%s %llu\n", COUNTERS[i].name, COUNTERS[i].labels, (unsigned long long)counters[i]);
+     }
+     text_printf(&out, "# HELP cweb_http_request_duration_seconds Time to answer a request, by route\n"
+                       "# TYPE cweb_http_request_duration_seconds histogram\n");
+     for (int i = 0; i < ROUTE_COUNT; i++)
+         print_histogram(&out, "cweb_http_request_duration_seconds", "route", ROUTE_PATHS[i], &request_time[i], &TIME_BOUNDS, 1e-9);
+     text_printf(&out, "# HELP cweb_render_duration_seconds Time to render a cached view\n"
+                       "# TYPE cweb_render_duration_seconds histogram\n");
+     for (int i = 0; i < VIEW_COUNT; i++)
+         print_histogram(&out, "cweb_render_duration_seconds", "view", VIEW_NAMES[i], &render_time[i], &TIME_BOUNDS, 1e-9);
+     text_printf(&out, "# HELP cweb_render_bytes Size of a rendered cached view\n"
+                       "# TYPE cweb_render_bytes histogram\n");
+     for (int i = 0; i < VIEW_COUNT; i++)
+         print_histogram(&out, "cweb_render_bytes", "view", VIEW_NAMES[i], &render_bytes[i], &BYTE_BOUNDS, 1);
+ 
+     if (out.failed) {
+         free(out.data);
+         return MHD_NO;
+     }
+     struct MHD_Response *response = MHD_create_response_from_buffer(out.len, out.data, MHD_RESPMEM_MUST_FREE);
+     if (!response) {
+         free(out.data);
+         return MHD_NO;
+     }
+     MHD_add_response_header(response, "Content-Type", "text/plain; version=0.0.4");
+     MHD_add_response_header(response, "Cache-Control", "no-store");
+     enum MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+     MHD_destroy_response(response);
+     return ret;
+ }
+ 
+ // -------------------------
+ // CACHED VIEWS
+ // -------------------------
+ 
+ // The schedule page, the ICS file and the JSON documents are read far more often than the
+ // schedule changes.
+ // Each is rendered once per snapshot generation and the finished libmicrohttpd response
+ // is handed to every client until the next change. Clients that send back our ETag in
+ // If-None-Match get an empty "304 Not Modified" instead of the whole document. Clients that
+ // accept gzip get a compressed copy, also made once per generation (and only if asked for).
+ 
+ // Compresses data in gzip format (zlib level 1-9, or Z_DEFAULT_COMPRESSION) into a new
+ // malloc'd buffer; NULL if it fails or does not shrink
+ char *gzip_compress(const char *data, size_t len, int level, size_t *out_len) {
+     z_stream zs;
+     memset(&zs, 0, sizeof(zs));
+     // 15 + 16: largest window, with a gzip header (what "Content-Encoding: gzip" expects)
+     if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+         return NULL;
+     size_t capacity = deflateBound(&zs, len);
+     char *out = malloc(capacity);
+     if (!out) {
+         deflateEnd(&zs);
+         return NULL;
+     }
+     zs.next_in = (Bytef *)data;
+     zs.avail_in = (uInt)len;
+     zs.next_out = (Bytef *)out;
+     zs.avail_out = (uInt)capacity;
+     int status = deflate(&zs, Z_FINISH); // Output fits in one go thanks to deflateBound
+     *out_len = zs.total_out;
+     deflateEnd(&zs);
+     if (status != Z_STREAM_END || *out_len >= len) {
+         free(out);
+         return NULL;
+     }
+     return out;
+ }
+ 
+ // Checks if the client said it can handle gzip (Accept-Encoding: gzip, deflate, ...)
+ bool client_accepts_gzip(struct MHD_Connection *connection) {
+     const char *accept = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Accept-Encoding");
+     if (!accept)
+         return false;
+     const char *gzip = strstr(accept, "gzip");
+     if (!gzip)
+         return false;
+     // "gzip;q=0" means "never send me gzip"
+     const char *q = gzip + 4;
+     while (*q == ' ') q++;
+     if (strncmp(q, ";q=", 3) == 0)
+         return strtod(q + 3, NULL) > 0;
+     return true;
+ }
+ 
+ // How to produce and label each cached document
+ typedef struct {
+     NextRecordFn next_record;  // Renderer
+     const char *content_type;  // Content-Type header
+     const char *disposition;   // Content-Disposition header, NULL for a normal page
+ } ViewInfo;
+ 
+ const ViewInfo VIEWS[VIEW_COUNT] = {
+     [VIEW_SCHEDULE_HTML] = {&next_schedule_html_record, "text/html; charset=utf-8", NULL},
+     [VIEW_ICS] = {&next_ics_record, "text/calendar", "attachment; filename=\"schedule.ics\""},
+     [VIEW_SCHEDULE_JSON] = {&next_schedule_json_record, "application/json", NULL},
+     [VIEW_MEETINGS_JSON] = {&next_meetings_json_record, "application/json", NULL},
+     [VIEW_RESERVATIONS_JSON] = {&next_reservations_json_record, "application/json", NULL},
+     [VIEW_ATTENDEES_JSON] = {&next_attendees_json_record, "application/json", NULL},
+ };
+ 
+ // Adds the headers a cached document and its 304 reply share
+ void add_view_headers(struct MHD_Response *response, const char *etag) {
+     MHD_add_response_header(response, "ETag", etag);
+     MHD_add_response_header(response, "Cache-Control", "no-cache"); // Always check back with us
+     // The session cookie picks the schedule, Accept-Encoding the encoding
+     MHD_add_response_header(response, "Vary", "Cookie, Accept-Encoding");
+ }
+ 
+ // Fills in one encoding of view id from data (which the response then owns and frees).
+ // Each encoding has its own ETag (gzip adds "-gz"): a client may only get a 304 for the
+ // bytes it actually holds. False if out of memory (data is freed).
+ bool make_encoding(SchedulerStore *store, ViewId id, unsigned long generation, ViewEncoding *encoding,
+                    char *data, size_t len, bool gzip) {
+     struct MHD_Response *response = MHD_create_response_from_buffer(len, data, MHD_RESPMEM_MUST_FREE);
+     struct MHD_Response *not_modified = MHD_create_response_from_buffer(0, "", MHD_RESPMEM_PERSISTENT);
+     if (!response || !not_modified) {
+         if (response) MHD_destroy_response(response); else free(data);
+         if (not_modified) MHD_destroy_response(not_modified);
+         return false;
+     }
+     snprintf(encoding->etag, sizeof(encoding->etag), "\"%lx-%lx-%lu%s\"", store->boot_id, store->store_id, generation,
+              gzip ? "-gz" : "");
+     MHD_add_response_header(response, "Content-Type", VIEWS[id].content_type);
+     if (VIEWS[id].disposition)
+         MHD_add_response_header(response, "Content-Disposition", VIEWS[id].disposition);
+     if (gzip)
+         MHD_add_response_header(response, "Content-Encoding", "gzip");
+     add_view_headers(response, encoding->etag);
+     add_view_headers(not_modified, encoding->etag);
+     // Where a client following /api/changes picks up from (see CHANGE FEED)
+     char generation_text[GENERATION_TOKEN_MAX];
+     generation_token(store, generation, generation_text);
+     MHD_add_response_header(response, "X-Schedule-Generation", generation_text);
+     encoding->response = response;
+     encoding->not_modified = not_modified;
+     return true;
+ }
+ 
+ // Re-renders a cached view from snapshot (call with cache_lock held); false if out of memory.
+ // The gzip copy is only made when a client asks for it (see serve_view).
+ bool refresh_view(SchedulerStore *store, ViewId id, SchedulerSnapshot *snapshot) {
+     CachedView *view = &store->views[id];
+     size_t len;
+     long long start = now_ns();
+     char *body = render_document(&snapshot->state, VIEWS[id].next_record, &len);
+     if (!body)
+         return false;
+     observe_render(id, now_ns() - start, len);
+     ViewEncoding plain = {0};
+     if (!make_encoding(store, id, snapshot->generation, &plain, body, len, false))
+         return false;
+     drop_view(view); // The old version
+     view->generation = snapshot->generation;
+     view->plain = plain;
+     view->body = body;
+     view->body_len = len;
+     return true;
+ }
+ 
+ // Compresses a view for the clients that accept gzip, once per generation (call with
+ // cache_lock held). Documents this repetitive shrink to a tenth or less; if it does not
+ // help, or memory runs out, those clients get the plain document.
+ void compress_view(SchedulerStore *store, ViewId id) {
+     CachedView *view = &store->views[id];
+     view->gzip_tried = true;
+     size_t gz_len;
+     char *gz = gzip_compress(view->body, view->body_len, Z_DEFAULT_COMPRESSION, &gz_len);
+     if (gz)
+         make_encoding(store, id, view->generation, &view->gzip, gz, gz_len, true);
+ }
+ 
+ // Checks an If-None-Match header (e.g., "\"a-1\", \"a-2\"" or "*") against our tag
+ bool etag_matches(const char *if_none_match, const char *etag) {
+     return strcmp(if_none_match, "*") == 0 || strstr(if_none_match, etag) != NULL;
+ }
+ 
+ // Sends a cached view, rendering it first if the schedule changed since last time
+ enum MHD_Result serve_view(SchedulerStore *store, struct MHD_Connection *connection, ViewId id) {
+     SchedulerSnapshot *snapshot = store_acquire(store);
+     enum MHD_Result ret = MHD_NO;
+     bool gzip = client_accepts_gzip(connection);
+     pthread_mutex_lock(&store->cache_lock);
+     CachedView *view = &store->views[id];
+     // Only re-render for a newer snapshot (another thread may already have rendered a newer one)
+     if (!view->plain.response || view->generation < snapshot->generation)
+         refresh_view(store, id, snapshot);
+     if (gzip && view->plain.response && !view->gzip_tried)
+         compress_view(store, id);
+     ViewEncoding *encoding = gzip && view->gzip.response ? &view->gzip : &view->plain;
+     if (encoding->response) {
+         const char *if_none_match = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "If-None-Match");
+         if (if_none_match && etag_matches(if_none_match, encoding->etag))
+             ret = MHD_queue_response(connection, MHD_HTTP_NOT_MODIFIED, encoding->not_modified);
+         else
+             ret = MHD_queue_response(connection, MHD_HTTP_OK, encoding->response);
+     }
+     pthread_mutex_unlock(&store->cache_lock); // Queued responses are safe to replace from here on
+     snapshot_release(snapshot);
+     return ret;
+ }
+ 
+ // -------------------------
+ // CHANGE FEED
+ // -------------------------
+ 
+ // GET /api/changes?since=G sends only what changed after generation G, so a client that
+ // has the schedule does not download all of it again after every change:
+ //   {"generation":"E-7","changes":[{"generation":"E-6",...},{"generation":"E-7",...}]}
+ // A generation is named by a token (see generation_token): E says which store counted it,
+ // as every new store counts from 0 again, so a number alone does not say which history
+ // it belongs to.
+ // Each change lists the entries that went away ("removed": meeting_id and week, which
+ // together name an entry), the entries that were added or moved there ("added", like
+ // /api/schedule), the ids of deleted meetings ("deleted_meetings"), reservations that are
+ // new or moved ("reservations", like /api/reservations) and the ids of deleted ones
+ // ("removed_reservations"). "reset":true means everything went away first
+ // (clearSession). A client too far behind, or following another store (after a restart,
+ // or after the tenant was evicted and loaded again), gets {"generation":G,"resync":true}
+ // and starts over from /api/schedule, whose X-Schedule-Generation header says which
+ // generation it shows.
+ // Every change is described once, when it is published, so sending it costs as much as
+ // the change, not the schedule.
+ //
+ // With wait=N (seconds, up to CHANGE_WAIT_MAX) a client that is up to date is not answered
+ // until the next change, or until N seconds pass without one (long polling). Its
+ // connection is suspended meanwhile, so no server thread is tied up while it waits.
+ #define CHANGE_WAIT_MAX 30
+ 
+ // A suspended /api/changes request
+ typedef struct ChangeWaiter {
+     struct MHD_Connection *connection;
+     SchedulerStore *store;     // Store it waits on; NULL once woken
+     long long deadline;        // now_ns() time at which it stops waiting
+     struct ChangeWaiter *next; // Next in feed_waiters
+ } ChangeWaiter;
+ 
+ pthread_mutex_t feed_lock = PTHREAD_MUTEX_INITIALIZER; // Guards feed_waiters and every store's changes
+ ChangeWaiter *feed_waiters = NULL;                     // Every suspended request, of all stores
+ atomic_bool feed_stopping;                             // Set when the server stops: nobody waits any more
+ 
+ // Describes the change from old to new as a JSON object; false if out of memory
+ bool describe_change(TextBuffer *json, const SchedulerStore *store, const SchedulerSnapshot *old_snapshot,
+                      const SchedulerSnapshot *new_snapshot) {
+     const MeetingScheduler *old = &old_snapshot->state, *new = &new_snapshot->state;
+     int old_meetings = old->meeting_count;
+     int old_reservations = old->reservation_count;
+     bool reset = new->meeting_count < old_meetings || new->reservation_count < old_reservations;
+     if (reset)
+         old_meetings = old_reservations = 0; // The lists only get shorter when everything is cleared
+     const Placement *before = old->placements, *after = new->placements;
+ 
+     char token[GENERATION_TOKEN_MAX];
+     generation_token(store, new_snapshot->generation, token);
+     text_printf(json, "{\"generation\":\"%s\",\"reset\":%s,\"removed\":[", token, reset ? "true" : "false");
+     // Meetings that moved (the solver may move several) or were deleted lose all their
+     // old entries...
+     int written = 0;
+     for (int i = 0; i < old_meetings; i++) {
+         const Placement *p = &before[i];
+         if (p->day == after[i].day && p->start == after[i].start && p->phase == after[i].phase)
+             continue; // Did not move
+         for (int week = p->phase; week >= 0 && week < calendar.weeks; week += FREQ_PERIOD[old->meetings[i].frequency])
+             text_printf(json, "%s{\"meeting_id\":%d,\"week\":%d}", written++ ? "," : "", i, week + 1);
+     }
+     // ... and moved ones get new ones, like new meetings
+     text_printf(json, "],\"added\":[");
+     written = 0;
+     for (int i = 0; i < new->meeting_count; i++) {
+         const Placement *p = &after[i];
+         if (i < old_meetings && p->day == before[i].day && p->start == before[i].start && p->phase == before[i].phase)
+             continue;
+         for (int week = p->phase; week >= 0 && week < calendar.weeks; week += FREQ_PERIOD[new->meetings[i].frequency]) {
+             ScheduleEntry entry = {.meeting_id = (uint32_t)i, .next_in_day = -1, .week = (uint8_t)week,
+                                    .day = (uint8_t)p->day, .start_time = (uint8_t)p->start};
+             char object[RECORD_MAX];
+             format_entry_json(new, &entry, object, sizeof(object));
+             text_printf(json, "%s%s", written++ ? "," : "", object);
+         }
+     }
+     text_printf(json, "],\"deleted_meetings\":[");
+     written = 0;
+     for (int i = 0; i < old_meetings; i++) {
+         if (meeting_deleted(new, i) && !meeting_deleted(old, i))
+             text_printf(json, "%s%d", written++ ? "," : "", i);
+     }
+     // Reservations added or moved (same id, new place), then the ids of deleted ones
+     text_printf(json, "],\"reservations\":[");
+     written = 0;
+     for (int i = 0; i < new->reservation_count; i++) {
+         const Reservation *r = &new->reservations[i];
+         if (r->duration == 0 || (i < old_reservations && r->day == old->reservations[i].day &&
+                                  r->start_time == old->reservations[i].start_time &&
+                                  r->duration == old->reservations[i].duration))
+             continue;
+         char object[RECORD_MAX];
+         format_reservation_json(new, i, object, sizeof(object));
+         text_printf(json, "%s%s", written++ ? "," : "", object);
+     }
+     text_printf(json, "],\"removed_reservations\":[");
+     written = 0;
+     for (int i = 0; i < old_reservations; i++) {
+         if (new->reservations[i].duration == 0 && old->reservations[i].duration > 0)
+             text_printf(json, "%s%d", written++ ? "," : "", i);
+     }
+     text_printf(json, "]}");
+     return !json->failed;
+ }
+ 
+ // Wakes the waiters of store (of every store if store is NULL) whose deadline is before
+ // (LLONG_MAX = all of them). Call with feed_lock held.
+ void wake_waiters(SchedulerStore *store, long long before) {
+     for (ChangeWaiter **link = &feed_waiters; *link;) {
+         ChangeWaiter *waiter = *link;
+         if ((store && waiter->store != store) || waiter->deadline > before) {
+             link = &waiter->next;
+             continue;
+         }
+         *link = waiter->next; // Unlink
+         waiter->store = NULL;
+         MHD_resume_connection(waiter->connection); // Its request is answered again, from the start
+     }
+ }
+ 
+ // Keeps the change new just published by store (called by store_commit, as the writer)
+ // and wakes the requests waiting for it
+ void feed_record(SchedulerStore *store, const SchedulerSnapshot *old, const SchedulerSnapshot *new) {
+     TextBuffer json = {0};
+     if (!describe_change(&json, store, old, new)) { // Kept as NULL: clients that need it resync
+         free(json.data);
+         json.data = NULL;
+         json.len = 0;
+     }
+     pthread_mutex_lock(&feed_lock);
+     ChangeRecord *record = &store->changes[new->generation % CHANGE_HISTORY];
+     free(record->json); // The change CHANGE_HISTORY generations ago
+     record->generation = new->generation;
+     record->json = json.data;
+     record->len = json.len;
+     store->feed_generation = new->generation;
+     wake_waiters(store, LLONG_MAX);
+     pthread_mutex_unlock(&feed_lock);
+ }
+ 
+ // Wakes the waiters of a store that is going away and frees its changes. Woken requests
+ // see the store that replaces it (see TENANTS), which tells them to resync.
+ void feed_close(SchedulerStore *store) {
+     pthread_mutex_lock(&feed_lock);
+     wake_waiters(store, LLONG_MAX);
+     pthread_mutex_unlock(&feed_lock);
+     for (int i = 0; i < CHANGE_HISTORY; i++)
+         free(store->changes[i].json);
+ }
+ 
+ // Takes a waiter out of feed_waiters if it is still there (its request is finished)
+ void forget_waiter(ChangeWaiter *waiter) {
+     pthread_mutex_lock(&feed_lock);
+     for (ChangeWaiter **link = &feed_waiters; *link; link = &(*link)->next) {
+         if (*link == waiter) {
+             *link = waiter->next;
+             break;
+         }
+     }
+     waiter->store = NULL;
+     pthread_mutex_unlock(&feed_lock);
+ }
+ 
+ // Wakes every waiter, so the server can stop (it must not have suspended connections)
+ void feed_wake_all(void) {
+     pthread_mutex_lock(&feed_lock);
+     wake_waiters(NULL, LLONG_MAX);
+     pthread_mutex_unlock(&feed_lock);
+ }
+ 
+ // Runs in the background: once a second, answers the waiters whose time is up
+ void *feed_timer(void *arg) {
+     (void)arg; // Unused parameter
+     for (;;) {
+         struct timespec second = {1, 0};
+         nanosleep(&second, NULL);
+         pthread_mutex_lock(&feed_lock);
+         wake_waiters(NULL, now_ns());
+         pthread_mutex_unlock(&feed_lock);
+     }
+     return NULL;
+ }
+ 
+ // -------------------------
+ // STATIC PAGES
+ // -------------------------
+ 
+ // Pages that never change are turned into libmicrohttpd responses once at startup and
+ // the same response is queued for every request: no copying, no allocations. Each page
+ // also gets a gzip-compressed copy for browsers that accept one.
+ 
+ // Main page: shows forms. Links are relative so the same page works for every tenant
+ // ("/" and "/u/<id>/", see TENANTS). The day and duration lists depend on the calendar,
+ // so the page is put together once at startup by build_main_page.
+ 
+ // Adds one <option> per working day
+ void append_day_options(TextBuffer *page) {
+     for (int i = 0; i < calendar.days; i++)
+         text_printf(page, "<option>%s</option>", DAYS[i]);
+ }
+ 
+ // Adds one <option> per allowed duration (every whole number of slots up to 90 min)
+ void append_duration_options(TextBuffer *page) {
+     for (int d = 1; d <= calendar.max_duration; d++)
+         text_printf(page, "<option value='%d'>%d</option>", d * calendar.slot_minutes, d * calendar.slot_minutes);
+ }
+ 
+ // Builds the main page for the current calendar (malloc'd); NULL if out of memory
+ char *build_main_page(void) {
+     TextBuffer page = {0};
+     int step = calendar.slot_minutes * 60; // Time inputs move in whole slots (seconds)
+     text_printf(&page,
+     "<!DOCTYPE html>"
+     "<html lang='en'><head><meta charset='utf-8'><meta name='viewport' content='width=device-width, initial-scale=1'>"
+     "<title>Meeting Scheduler</title>"
+     "<link rel='stylesheet' href='https://stackpath.bootstrapcdn.com/bootstrap/4.5.2/css/bootstrap.min.css'>"
+     "</head><body><div class='container mt-4'>"
+     "<h1>Meeting Scheduler</h1><hr>"
+     "<h3>Add Reservation</h3>"
+     "<form action='addReservation' method='post'>"
+       "<div class='form-group'><label>Day</label>"
+       "<select name='day' class='form-control'>");
+     append_day_options(&page);
+     text_printf(&page,
+       "</select></div>"
+       "<div class='form-group'><label>Start Time</label>"
+       "<input type='time' name='start_time' class='form-control' value='%s' step='%d'></div>"
+       "<div class='form-group'><label>Duration (minutes)</label>"
+       "<select name='duration' class='form-control'>", calendar.slot_names[0], step);
+     append_duration_options(&page);
+     text_printf(&page,
+       "</select></div>"
+       "<button type='submit' class='btn btn-primary'>Add Reservation</button>"
+     "</form><hr>"
+     "<h3>Add Meeting</h3>"
+     "<form action='addMeeting' method='post'>"
+       "<div class='form-group'><label>Meeting Name</label>"
+       "<input type='text' name='name' class='form-control' required></div>"
+       "<div class='form-group'><label>Meeting Type</label>"
+       "<select name='type' class='form-control' required>"
+         "<option value='One-to-one'>One-to-one</option>"
+         "<option value='Design'>Design</option>"
+         "<option value='Management'>Management</option>"
+         "<option value='Contractor'>Contractor</option>"
+         "<option value='Client'>Client</option>"
+       "</select></div>"
+       "<div class='form-group'><label>Duration (minutes)</label>"
+       "<select name='duration' class='form-control'>");
+     append_duration_options(&page);
+     text_printf(&page,
+       "</select></div>"
+       "<div class='form-group'><label>Preferred Times (comma separated e.g., 09:30,10:00)</label>"
+       "<input type='text' name='preferred_times' class='form-control'></div>"
+       "<div class='form-group'><label>Attendees (optional, comma separated e.g., Ann,Bob; none = everyone)</label>"
+       "<input type='text' name='attendees' class='form-control'></div>"
+       "<div class='form-group'><label>Fixed Day (optional)</label>"
+       "<select name='fixed_day' class='form-control'>"
+         "<option value=''>None</option>");
+     append_day_options(&page);
+     text_printf(&page,
+       "</select></div>"
+       "<div class='form-group'><label>Fixed Time (optional)</label>"
+       "<input type='time' name='fixed_time' class='form-control' step='%d'></div>"
+       "<div class='form-group'><label>Frequency</label>"
+       "<select name='frequency' class='form-control'>"
+         "<option value='weekly'>Weekly</option><option value='fortnightly'>Fortnightly</option>"
+         "<option value='third_week'>Third Week</option><option value='monthly'>Monthly</option>"
+       "</select></div>"
+       "<div class='form-check mb-3'><input type='checkbox' name='solve' value='1' class='form-check-input' id='solve'>"
+       "<label class='form-check-label' for='solve'>Move existing meetings if that is the only way to fit this one</label></div>"
+       "<button type='submit' class='btn btn-primary'>Add Meeting</button>"
+     "</form><hr>"
+     "<h3>Schedule</h3>"
+     "<p><a class='btn btn-secondary' href='displaySchedule'>View Schedule</a></p><hr>"
+     "<h3>Export ICS</h3>"
+     "<form action='exportICS' method='get'>"
+       "<div class='form-group'><label>Filename</label>"
+       "<input type='text' name='filename' class='form-control' placeholder='schedule.ics' required></div>"
+       "<button type='submit' class='btn btn-primary'>Export ICS</button>"
+     "</form><hr>"
+     "<h3>Clear Session</h3>"
+     "<p><a class='btn btn-danger' href='clearSession'>Clear All Meetings & Reservations</a></p>"
+     "</div></body></html>", step);
+     if (page.failed) {
+         free(page.data);
+         return NULL;
+     }
+     return page.data;
+ }
+ 
+ typedef enum {
+     PAGE_MAIN, PAGE_NOT_FOUND, PAGE_SESSION_CLEARED,
+     PAGE_RESERVATION_ADDED, PAGE_RESERVATION_FAILED,
+     PAGE_MEETING_ADDED, PAGE_MEETING_FAILED,
+     PAGE_METHOD_NOT_ALLOWED, PAGE_BUSY, PAGE_FIELD_TOO_LONG,
+     PAGE_COUNT
+ } PageId;
+ 
+ // Content and caching rules for each page
+ typedef struct {
+     const char *html;          // Page content
+     unsigned int status;       // HTTP status code
+     const char *cache_control; // How long browsers may keep it
+ } StaticPageInfo;
+ 
+ // Result pages must not be cached: the same form sent twice has to reach the server twice.
+ // Not Found is not cached either: it also answers an unknown tenant or session cookie, which
+ // can become valid later at the same URL
+ #define CACHE_FOREVER "public, max-age=86400"
+ #define CACHE_NEVER "no-store"
+ StaticPageInfo STATIC_PAGES[PAGE_COUNT] = {
+     [PAGE_MAIN] = {NULL, MHD_HTTP_OK, CACHE_FOREVER}, // Filled in by init_static_pages
+     [PAGE_NOT_FOUND] = {"<html><body><h3>404 Not Found</h3></body></html>", MHD_HTTP_NOT_FOUND, CACHE_NEVER},
+     [PAGE_SESSION_CLEARED] = {"<html><body><div class='container'><h3>Session Cleared.</h3>"
+                               "<p><a href='./'>Return to Main Page</a></p></div></body></html>", MHD_HTTP_OK, CACHE_NEVER},
+     [PAGE_RESERVATION_ADDED] = {"<html><body><div class='container'><h3>Reservation added successfully.</h3>"
+                                 "<p><a href='./'>Return to Main Page</a></p></div></body></html>", MHD_HTTP_OK, CACHE_NEVER},
+     [PAGE_RESERVATION_FAILED] = {"<html><body><div class='container'><h3>Failed to add reservation.</h3>"
+                                  "<p><a href='./'>Return to Main Page</a></p></div></body></html>", MHD_HTTP_OK, CACHE_NEVER},
+     [PAGE_MEETING_ADDED] = {"<html><body><div class='container'><h3>Meeting added successfully.</h3>"
+                             "<p><a href='./'>Return to Main Page</a></p></div></body></html>", MHD_HTTP_OK, CACHE_NEVER},
+     [PAGE_MEETING_FAILED] = {"<html><body><div class='container'><h3>Failed to add meeting.</h3>"
+                              "<p><a href='./'>Return to Main Page</a></p></div></body></html>", MHD_HTTP_OK, CACHE_NEVER},
+     [PAGE_METHOD_NOT_ALLOWED] = {"<html><body><h3>405 Method Not Allowed</h3></body></html>",
+                                  MHD_HTTP_METHOD_NOT_ALLOWED, CACHE_NEVER},
+     [PAGE_BUSY] = {"<html><body><h3>503 Too Many Schedules In Use</h3></body></html>",
+                    MHD_HTTP_SERVICE_UNAVAILABLE, CACHE_NEVER},
+     [PAGE_FIELD_TOO_LONG] = {"<html><body><h3>400 Form Field Too Long</h3></body></html>",
+                              MHD_HTTP_BAD_REQUEST, CACHE_NEVER},
+ };
+ 
+ // Ready-made responses: [page][0] plain, [page][1] gzip (NULL if compression did not help)
+ struct MHD_Response *static_responses[PAGE_COUNT][2];
+ 
+ // Builds the response for one page, compressed or not
+ struct MHD_Response *create_static_response(const StaticPageInfo *page, bool compressed) {
+     struct MHD_Response *response;
+     size_t len = strlen(page->html);
+     if (compressed) {
+         size_t gz_len;
+         char *gz = gzip_compress(page->html, len, Z_BEST_COMPRESSION, &gz_len); // Done once, so take the smallest
+         if (!gz)
+             return NULL; // Serve the plain page only
+         response = MHD_create_response_from_buffer(gz_len, gz, MHD_RESPMEM_MUST_FREE);
+         if (!response) {
+             free(gz);
+             return NULL;
+         }
+         MHD_add_response_header(response, "Content-Encoding", "gzip");
+     } else {
+         // The text is never freed, so libmicrohttpd can send it directly
+         response = MHD_create_response_from_buffer(len, (void *)page->html, MHD_RESPMEM_PERSISTENT);
+         if (!response)
+             return NULL;
+     }
+     MHD_add_response_header(response, "Content-Type", "text/html; charset=utf-8");
+     MHD_add_response_header(response, "Cache-Control", page->cache_control);
+     MHD_add_response_header(response, "Vary", "Accept-Encoding");
+     return response;
+ }
+ 
+ // Creates all static responses (call once before starting the server); false if out of memory
+ bool init_static_pages(void) {
+     STATIC_PAGES[PAGE_MAIN].html = build_main_page(); // Kept for as long as the program runs
+     if (!STATIC_PAGES[PAGE_MAIN].html)
+         return false;
+     for (int i = 0; i < PAGE_COUNT; i++) {
+         static_responses[i][0] = create_static_response(&STATIC_PAGES[i], false);
+         static_responses[i][1] = create_static_response(&STATIC_PAGES[i], true); // Optional
+         if (!static_responses[i][0])
+             return false;
+     }
+     return true;
+ }
+ 
+ // Sends one of the ready-made pages
+ enum MHD_Result serve_static_page(struct MHD_Connection *connection, PageId id) {
+     struct MHD_Response *response = static_responses[id][0];
+     if (static_responses[id][1] && client_accepts_gzip(connection))
+         response = static_responses[id][1];
+     return MHD_queue_response(connection, STATIC_PAGES[id].status, response);
+ }
+ 
+ // -------------------------
+ // BATCH IMPORT
+ // -------------------------
+ 
+ // POST /importMeetings adds many meetings in one request. The body is CSV, one meeting
+ // per line, with the same fields as the Add Meeting form:
+ //     name,type,duration,frequency,fixed_day,fixed_time,preferred_times,attendees
+ //     Team Sync,Design,60,weekly,,,09:30;10:00,Ann;Bob
+ // (preferred times and attendees are separated by ';', and either may be left out;
+ // a first line starting with "name" is a header).
+ // Example: curl --data-binary @meetings.csv http://localhost:8888/importMeetings
+ // Add "?solve=1" to let existing meetings move when that is the only way to fit the batch.
+ //
+ // Lines are read as the body arrives (see ImportBatch); the body itself is never kept.
+ // Once it is all in, the batch is placed in one change, hardest-to-place meetings first
+ // (fixed day/time, few preferred times, long and frequent), so flexible meetings do not
+ // take the only slots the strict ones could use.
+ #define MAX_IMPORT 400           // Most meetings in one batch
+ #define MAX_CSV_LINE 1024        // Longest line of a batch (longer lines are refused)
+ 
+ // One line of the batch
+ typedef struct {
+     Meeting meeting;   // Parsed meeting
+     int line;          // Line number in the body (for the summary)
+     int options;       // Number of (day, time) choices; fewer = harder to place
+     const char *error; // Why it was not placed, NULL if placed
+     Placement placement; // Where /api/whatif would put it (phase -1 = nowhere)
+ } ImportItem;
+ 
+ // Counts how many (day, start time) choices a meeting has
+ int meeting_options(const Meeting *meeting) {
+     int days = (meeting->fixed_day >= 0) ? 1 : calendar.days;
+     int times = calendar.slots;
+     if (meeting->fixed_time >= 0) {
+         times = 1;
+     } else if (meeting->preferred_hours[0] >= 0) {
+         times = 0;
+         while (times < 8 && meeting->preferred_hours[times] >= 0)
+             times++;
+     }
+     return days * times;
+ }
+ 
+ // Sort order for placement: fewest options, then most booked time, then file order
+ int compare_import_items(const void *a, const void *b) {
+     const ImportItem *x = *(ImportItem *const *)a;
+     const ImportItem *y = *(ImportItem *const *)b;
+     if (x->options != y->options)
+         return x->options - y->options;
+     int x_load = frequency_occurrences(x->meeting.frequency, 0) * x->meeting.duration;
+     int y_load = frequency_occurrences(y->meeting.frequency, 0) * y->meeting.duration;
+     if (x_load != y_load)
+         return y_load - x_load;
+     return x->line - y->line;
+ }
+ 
+ // Splits one CSV line in place into at most max_fields fields; returns how many were found
+ int split_csv_line(char *line, char **fields, int max_fields) {
+     int count = 0;
+     char *p = line;
+     while (count < max_fields) {
+         while (*p == ' ') p++; // Trim leading spaces
+         fields[count++] = p;
+         p += strcspn(p, ",");
+         char *end = p;
+         while (end > fields[count - 1] && (end[-1] == ' ' || end[-1] == '\r'))
+             end--; // Trim trailing spaces (and the '\r' of Windows line endings)
+         bool last = (*p == '\0');
+         *end = '\0';
+         if (last)
+             break;
+         p++; // Skip the comma
+     }
+     return count;
+ }
+ 
+ // A batch being read while its body arrives in pieces. Every complete line is parsed
+ // straight away; only the line a piece ends in the middle of is kept for the next piece.
+ typedef struct {
+     ImportItem *items;   // Room for MAX_IMPORT, in file order (NULL = not reading a batch)
+     ImportItem **order;  // The same items in the order to place them in (see finish_import_batch)
+     int count;           // Meetings read
+     int skipped;         // Lines that did not fit in the batch
+     int line_no;         // Lines read
+     char line[MAX_CSV_LINE + 1]; // The line being read
+     size_t line_len;
+     bool line_too_long;  // It was longer than MAX_CSV_LINE (the rest of it is dropped)
+ } ImportBatch;
+ 
+ // Gets a batch ready to read; false if out of memory
+ bool start_import_batch(ImportBatch *batch) {
+     memset(batch, 0, sizeof(*batch));
+     batch->items = calloc(MAX_IMPORT, sizeof(ImportItem));
+     batch->order = calloc(MAX_IMPORT, sizeof(ImportItem *));
+     return batch->items && batch->order;
+ }
+ 
+ // Frees what start_import_batch allocated
+ void free_import_batch(ImportBatch *batch) {
+     free(batch->items);
+     free(batch->order);
+     batch->items = NULL;
+     batch->order = NULL;
+ }
+ 
+ // Reads the line collected in batch->line into the next item
+ void read_import_line(ImportBatch *batch) {
+     batch->line_no++;
+     batch->line[batch->line_len] = '\0';
+     char *f[8] = {NULL};
+     int n = split_csv_line(batch->line, f, 8);
+     bool header = (batch->line_no == 1 && strncmp(f[0], "name", 4) == 0);
+     if (!header && !(n == 1 && f[0][0] == '\0')) { // Skip header and blank lines
+         if (batch->count == MAX_IMPORT) {
+             batch->skipped++; // Batch too large: the rest is ignored
+         } else {
+             ImportItem *item = &batch->items[batch->count];
+             item->line = batch->line_no;
+             item->error = parse_meeting(&item->meeting, f[0], f[1], f[2], f[6], f[4], f[5], f[3], f[7]);
+             if (batch->line_too_long)
+                 item->error = "line too long";
+             item->options = meeting_options(&item->meeting);
+             batch->order[batch->count] = item;
+             batch->count++;
+         }
+     }
+     batch->line_len = 0;
+     batch->line_too_long = false;
+ }
+ 
+ // Reads the next size bytes of the body
+ void read_import_data(ImportBatch *batch, const char *data, size_t size) {
+     while (size > 0) {
+         const char *newline = memchr(data, '\n', size);
+         size_t len = newline ? (size_t)(newline - data) : size; // Bytes of the current line
+         size_t room = MAX_CSV_LINE - batch->line_len;
+         if (len > room)
+             batch->line_too_long = true;
+         memcpy(batch->line + batch->line_len, data, len < room ? len : room);
+         batch->line_len += len < room ? len : room;
+         if (!newline)
+             return; // The line goes on in the next piece
+         read_import_line(batch);
+         data = newline + 1;
+         size -= len + 1;
+     }
+ }
+ 
+ // Reads the last line (if the body does not end with a newline) and sorts the batch into
+ // the order to place it in. Returns how many meetings were read.
+ int finish_import_batch(ImportBatch *batch) {
+     if (batch->line_len > 0 || batch->line_too_long)
+         read_import_line(batch);
+     qsort(batch->order, batch->count, sizeof(ImportItem *), &compare_import_items); // Hardest first
+     return batch->count;
+ }
+ 
+ // Places the whole batch, once its body is all in.
+ // With solve set, meetings that do not fit greedily trigger one re-plan of everything.
+ // Returns an HTML summary page (malloc'd, caller frees) or NULL if out of memory.
+ char *import_meetings(SchedulerStore *store, ImportBatch *batch, bool solve, size_t *page_len) {
+     // Pass 1: the last line (every other line was read as it arrived)
+     int count = finish_import_batch(batch);
+     int skipped = batch->skipped;
+     ImportItem *items = batch->items;
+     ImportItem **order = batch->order;
+     // Pass 2: place the batch, hardest first, as one change to the schedule
+     int placed = 0;
+     SchedulerSnapshot *copy = store_begin_write(store);
+     for (int i = 0; i < count; i++) {
+         ImportItem *item = order[i];
+         if (item->error)
+             continue; // Could not be read
+         if (!copy)
+             item->error = "out of memory";
+         else if (add_meeting(&copy->state, &item->meeting))
+             placed++;
+         else
+             item->error = "no free slot";
+     }
+     // Pass 3 (optional): move meetings around so the rejected ones fit too
+     if (copy && solve && placed < count) {
+         Meeting *rejected = malloc(count * sizeof(Meeting));
+         int rejected_count = 0;
+         for (int i = 0; rejected && i < count; i++) {
+             if (order[i]->error == NULL || strcmp(order[i]->error, "no free slot") != 0)
+                 continue;
+             rejected[rejected_count++] = order[i]->meeting;
+         }
+         if (rejected_count > 0 && solve_schedule(&copy->state, rejected, rejected_count, SOLVER_BUDGET_MS)) {
+             for (int i = 0; i < count; i++) {
+                 if (order[i]->error && strcmp(order[i]->error, "no free slot") == 0) {
+                     order[i]->error = NULL;
+                     placed++;
+                 }
+             }
+         }
+         free(rejected);
+     }
+     if (copy) {
+         if (placed == 0) {
+             store_abort(store, copy);
+         } else if (!store_commit(store, copy)) {
+             for (int i = 0; i < count; i++) {
+                 if (!order[i]->error)
+                     order[i]->error = "could not be saved";
+             }
+             placed = 0;
+         }
+     }
+     // Summary page (items are still in file order)
+     TextBuffer page = {0};
+     text_printf(&page, "<html><body><div class='container'><h3>Imported %d of %d meetings.</h3>",
+                 placed, count + skipped);
+     if (placed < count + skipped)
+         text_printf(&page, "<ul>");
+     for (int i = 0; i < count; i++) {
+         if (items[i].error) {
+             char name[HTML_STR_MAX], error[HTML_STR_MAX];
+             html_escape(items[i].meeting.name, name); // Straight from the uploaded file
+             html_escape(items[i].error, error);
+             text_printf(&page, "<li>Line %d (%s): %s</li>", items[i].line, name, error);
+         }
+     }
+     if (skipped > 0)
+         text_printf(&page, "<li>%d more lines ignored (at most %d meetings per batch)</li>", skipped, MAX_IMPORT);
+     if (placed < count + skipped)
+         text_printf(&page, "</ul>");
+     text_printf(&page, "<p><a href='./'>Return to Main Page</a></p></div></body></html>");
+     if (page.failed) {
+         free(page.data);
+         return NULL;
+     }
+     *page_len = page.len;
+     return page.data;
+ }
+ 
+ // -------------------------
+ // TENANTS
+ // -------------------------
+ 
+ // One server can hold a separate schedule per team ("tenant"). A request picks its tenant by
+ //   - a URL prefix: /u/team-a/displaySchedule is /displaySchedule for tenant "team-a", or
+ //   - a "session" cookie, when the URL has no prefix, or
+ //   - neither: the tenant "default" (so a single team can use the plain URLs as before).
+ // Tenants are created the first time they are used. Each has its own SchedulerStore, so
+ // writers of different tenants never wait for each other. When all MAX_TENANTS places are
+ // taken, the tenant that was used least recently (and is not serving a request right now)
+ // is dropped to make room. Without --data-dir its schedule is lost; with it, the schedule
+ // is saved and loaded again the next time the tenant is used.
+ // Loading and dropping a saved tenant read and write files, so they are done without the
+ // registry lock: the tenant stays in the registry meanwhile, marked loading or closing, and
+ // only requests for that tenant wait for it.
+ #define MAX_TENANTS 64       // Most schedules kept in memory at once
+ #define MAX_TENANT_ID 32     // Longest tenant name
+ #define DEFAULT_TENANT "default"
+ 
+ // One team's schedule
+ typedef struct {
+     char id[MAX_TENANT_ID + 1]; // Tenant name (letters, digits, '-' and '_')
+     SchedulerStore store;       // Its data, with its own locks
+     int users;                  // Requests using it right now (it is not dropped while > 0)
+     unsigned long last_used;    // Registry clock value at its last use (for LRU)
+     bool loading;               // Its saved schedule is being loaded into store
+     bool closing;               // It is being dropped (its store saved and freed)
+ } Tenant;
+ 
+ // All tenants, shared by the server threads
+ typedef struct {
+     pthread_mutex_t lock;          // Guards everything below (held only for lookups)
+     pthread_cond_t changed;        // Signalled when a tenant has been loaded or dropped
+     Tenant *tenants[MAX_TENANTS];  // Tenants in memory
+     int count;
+     unsigned long clock;           // Goes up by one with every lookup
+ } TenantRegistry;
+ 
+ // Sets up an empty registry
+ void registry_init(TenantRegistry *registry) {
+     pthread_mutex_init(&registry->lock, NULL);
+     pthread_cond_init(&registry->changed, NULL);
+     registry->count = 0;
+     registry->clock = 0;
+ }
+ 
+ // Checks that a tenant name is 1..MAX_TENANT_ID safe characters
+ bool valid_tenant_id(const char *id, size_t len) {
+     if (len == 0 || len > MAX_TENANT_ID)
+         return false;
+     for (size_t i = 0; i < len; i++) {
+         char c = id[i];
+         if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_'))
+             return false;
+     }
+     return true;
+ }
+ 
+ // Takes a tenant out of the registry (call with the lock held)
+ void tenant_remove(TenantRegistry *registry, Tenant *tenant) {
+     for (int i = 0; i < registry->count; i++) {
+         if (registry->tenants[i] == tenant) {
+             registry->tenants[i] = registry->tenants[--registry->count];
+             break;
+         }
+     }
+ }
+ 
+ // Finds (or creates) the tenant called id and marks it in use; call tenant_release when done.
+ // Returns NULL if out of memory, its saved schedule cannot be loaded, or every tenant is busy.
+ Tenant *tenant_acquire(TenantRegistry *registry, const char *id) {
+     pthread_mutex_lock(&registry->lock);
+     registry->clock++;
+     for (;;) {
+         Tenant *tenant = NULL;
+         for (int i = 0; i < registry->count; i++) {
+             if (strcmp(registry->tenants[i]->id, id) == 0) {
+                 tenant = registry->tenants[i];
+                 break;
+             }
+         }
+         if (tenant && (tenant->loading || tenant->closing)) {
+             pthread_cond_wait(&registry->changed, &registry->lock); // Then look again
+             continue;
+         }
+         if (tenant) {
+             tenant->users++;
+             tenant->last_used = registry->clock;
+             pthread_mutex_unlock(&registry->lock);
+             return tenant;
+         }
+         if (registry->count == MAX_TENANTS) {
+             // Full: drop the least recently used tenant nobody is using
+             Tenant *victim = NULL;
+             for (int i = 0; i < registry->count; i++) {
+                 Tenant *t = registry->tenants[i];
+                 if (t->users == 0 && !t->loading && !t->closing && (!victim || t->last_used < victim->last_used))
+                     victim = t;
+             }
+             if (!victim) {
+                 pthread_mutex_unlock(&registry->lock);
+                 return NULL; // All busy
+             }
+             victim->closing = true;
+             pthread_mutex_unlock(&registry->lock);
+             store_destroy(&victim->store); // Saves it, with --data-dir
+             pthread_mutex_lock(&registry->lock);
+             tenant_remove(registry, victim);
+             free(victim);
+             pthread_cond_broadcast(&registry->changed);
+             continue; // Others may have come and gone meanwhile
+         }
+         // Take its place now, then load what was saved for it (its files are named after
+         // the id, see PERSISTENCE) without the lock
+         tenant = malloc(sizeof(Tenant));
+         if (!tenant || !store_init(&tenant->store)) {
+             free(tenant);
+             pthread_mutex_unlock(&registry->lock);
+             return NULL;
+         }
+         snprintf(tenant->id, sizeof(tenant->id), "%s", id);
+         tenant->users = 1;
+         tenant->last_used = registry->clock;
+         tenant->loading = true;
+         tenant->closing = false;
+         registry->tenants[registry->count++] = tenant;
+         pthread_mutex_unlock(&registry->lock);
+         const char *error = store_open(&tenant->store, id);
+         pthread_mutex_lock(&registry->lock);
+         tenant->loading = false;
+         if (error)
+             tenant_remove(registry, tenant);
+         pthread_cond_broadcast(&registry->changed);
+         pthread_mutex_unlock(&registry->lock);
+         if (error) {
+             fprintf(stderr, "Cannot load the schedule of %s: %s\n", id, error);
+             store_destroy(&tenant->store);
+             free(tenant);
+             return NULL;
+         }
+         return tenant;
+     }
+ }
+ 
+ // Marks a tenant as no longer used by this request
+ void tenant_release(TenantRegistry *registry, Tenant *tenant) {
+     pthread_mutex_lock(&registry->lock);
+     tenant->users--;
+     pthread_mutex_unlock(&registry->lock);
+ }
+ 
+ // Frees every tenant (the server must be stopped); saved tenants get a fresh snapshot
+ void registry_close(TenantRegistry *registry) {
+     for (int i = 0; i < registry->count; i++) {
+         store_destroy(&registry->tenants[i]->store);
+         free(registry->tenants[i]);
+     }
+     registry->count = 0;
+     pthread_mutex_destroy(&registry->lock);
+     pthread_cond_destroy(&registry->changed);
+ }
+ 
+ // Sends a redirect to location (e.g., "/u/team/" for "/u/team")
+ enum MHD_Result redirect_to(struct MHD_Connection *connection, const char *location) {
+     struct MHD_Response *response = MHD_create_response_from_buffer(0, "", MHD_RESPMEM_PERSISTENT);
+     if (!response)
+         return MHD_NO;
+     MHD_add_response_header(response, "Location", location);
+     enum MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_MOVED_PERMANENTLY, response);
+     MHD_destroy_response(response);
+     return ret;
+ }
+ 
+ // -------------------------
+ // WEB SERVER
+ // -------------------------
+ 
+ // A POST body is read piece by piece as it arrives, and never kept whole:
+ //   - /importMeetings and /api/whatif take CSV, which is read a line at a time (see ImportBatch)
+ //   - everything else takes the fields of a form (application/x-www-form-urlencoded or
+ //     multipart/form-data), which libmicrohttpd's post processor decodes for us. The fields
+ //     the handlers know (FORM_FIELDS) are kept and added to the connection as POSTDATA
+ //     values, so request_value finds them like URL arguments. Other fields are dropped.
+//     A known field longer than FORM_VALUE_MAX - 1 bytes gets the request refused with 400.
+ #define FORM_VALUE_MAX 256   // Room for a form value and its '\0' (longer ones are refused)
+ #define FORM_BUFFER 1024     // Buffer size of the post processor
+ 
+ const char *FORM_FIELDS[] = {"name", "type", "duration", "preferred_times", "fixed_day", "fixed_time",
+                              "frequency", "attendees", "day", "start_time", "id", "first_week", "solve"};
+ #define FORM_FIELD_COUNT (int)(sizeof(FORM_FIELDS) / sizeof(FORM_FIELDS[0]))
+ 
+ // Per-request state kept by libmicrohttpd between calls (in *con_cls) while a body arrives
+ typedef struct {
+     struct MHD_Connection *connection;
+     ImportBatch batch;                // CSV body being read (batch.items = NULL if not CSV)
+     struct MHD_PostProcessor *form;   // Form body being read (NULL if not a form)
+     char form_values[FORM_FIELD_COUNT][FORM_VALUE_MAX]; // Values of the known form fields
+     bool form_given[FORM_FIELD_COUNT];                  // Which of them the body had
+     const char *form_too_long; // First known field that did not fit (NULL = none); answered with 400
+     bool waited;         // /api/changes already waited once (see CHANGE FEED)
+     ChangeWaiter waiter; // Its place in feed_waiters while it waits
+ } RequestContext;
+ 
+ // Called by the post processor with the next piece of a form value (off bytes of it came
+ // before). The pieces are added to the value in place; a value is only complete once the
+ // whole body has been read, which is before any handler looks at it.
+ static enum MHD_Result read_form_field(void *cls, enum MHD_ValueKind kind, const char *key, const char *filename,
+                                        const char *content_type, const char *transfer_encoding,
+                                        const char *data, uint64_t off, size_t size) {
+     (void)kind; (void)filename; (void)content_type; (void)transfer_encoding; // Unused parameters
+     RequestContext *context = (RequestContext *)cls;
+     for (int i = 0; i < FORM_FIELD_COUNT; i++) {
+         if (strcmp(key, FORM_FIELDS[i]) != 0)
+             continue;
+         char *value = context->form_values[i];
+         if (off < FORM_VALUE_MAX - 1) {
+             size_t len = size < FORM_VALUE_MAX - 1 - off ? size : FORM_VALUE_MAX - 1 - off;
+             memcpy(value + off, data, len);
+             value[off + len] = '\0';
+         }
+         // A cut value could still look valid (e.g., an attendee list cut inside a name)
+         if (off + size > FORM_VALUE_MAX - 1 && !context->form_too_long)
+             context->form_too_long = FORM_FIELDS[i];
+         if (!context->form_given[i]) {
+             context->form_given[i] = true;
+             // The strings stay where they are until request_completed frees the context
+             MHD_set_connection_value(context->connection, MHD_POSTDATA_KIND, FORM_FIELDS[i], value);
+         }
+         break;
+     }
+     return MHD_YES;
+ }
+ 
+ // Sets up the reading of a POST body to url; false if out of memory
+ bool start_body(RequestContext *context, struct MHD_Connection *connection, const char *url) {
+     context->connection = connection;
+     if (strncmp(url, "/u/", 3) == 0)
+         url = strchr(url + 3, '/'); // Leave out the tenant (see TENANTS)
+     Route route = url ? find_route(url) : ROUTE_OTHER;
+     if (route == ROUTE_IMPORT || route == ROUTE_API_WHATIF)
+         return start_import_batch(&context->batch);
+     // NULL if the body is not a form: it is then ignored
+     context->form = MHD_create_post_processor(connection, FORM_BUFFER, &read_form_field, context);
+     return true;
+ }
+ 
+ // A field of the request: from the URL (?key=value) or else from a form body
+ const char *request_value(struct MHD_Connection *connection, const char *key) {
+     return MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND | MHD_POSTDATA_KIND, key);
+ }
+ 
+ // Checks for "solve=1": the client allows existing meetings to be moved
+ bool wants_solver(struct MHD_Connection *connection) {
+     const char *solve = request_value(connection, "solve");
+     return solve && strcmp(solve, "1") == 0;
+ }
+ 
+ // Requests answer_to_connection has started on that are not completed yet (including
+ // their responses still being sent); stop_server waits for them
+ atomic_int requests_running;
+ 
+ // Called by libmicrohttpd when a request is finished, to free its RequestContext
+ static void request_completed(void *cls, struct MHD_Connection *connection, void **con_cls,
+                               enum MHD_RequestTerminationCode toe) {
+     (void)cls; (void)connection; (void)toe; // Unused parameters
+     atomic_fetch_sub(&requests_running, 1);
+     RequestContext *context = (RequestContext *)*con_cls;
+     if (context) {
+         if (context->waited)
+             forget_waiter(&context->waiter); // In case it ends while still waiting
+         if (context->form)
+             MHD_destroy_post_processor(context->form);
+         free_import_batch(&context->batch);
+         free(context);
+         *con_cls = NULL;
+     }
+ }
+ 
+ // -------------------------
+ // JSON API
+ // -------------------------
+ 
+ // For programs rather than browsers:
+ //   GET  /api/schedule      Every scheduled occurrence and every reservation
+ //   GET  /api/meetings      Every accepted meeting
+ //   GET  /api/reservations  Every reservation
+ //   GET  /api/attendees     Every attendee (see ATTENDEES): {"attendees":[{"id":0,"name":"...",
+ //                           "meetings":N,"booked_minutes":M}]}
+ //   POST /api/meetings      Add a meeting (same fields as /addMeeting, in the URL or a form)
+ //   POST /api/reservations  Add a reservation (same fields as /addReservation, likewise)
+ //   POST /api/meetings/delete?id=N                     Delete a meeting
+ //   POST /api/meetings/move?id=N&day=D&start_time=T    Move every occurrence of a meeting
+ //        [&first_week=W]                               (and to other weeks, counted from 1)
+ //   POST /api/reservations/delete?id=N                 Delete a reservation
+ //   POST /api/reservations/move?id=N&day=D&start_time=T
+ //   POST /api/whatif        Where a batch would go (a CSV body like /importMeetings), without
+ //                           adding it: {"ok":true,"generation":"G","placed":N,"count":M,"meetings":
+ //                           [{"line":L,"name":"...","placed":true,"day":"...","start":"...",
+ //                           "weeks":[...]} or {...,"placed":false,"error":"..."}]}
+ //                           The batch goes onto a throwaway fork of snapshot G's booked slots
+ //                           (see dry_run), so the answer is what /importMeetings would do now
+ //                           (without ?solve=1, which it does not try).
+ //   GET  /api/changes       What changed since a generation (see CHANGE FEED)
+ //   GET  /api/free?duration=M[&day=D][&week=W][&frequency=F][&attendees=A,B]
+ //                           Where a meeting of M minutes could start, without trying to add one
+ //                           (see api_free): {"ok":true,"generation":"G","duration":M,"free":
+ //                           [{"day":"...","weeks":[...],"starts":["09:00",...],"over_limit":false}]}
+ // The GET documents are cached views (see CACHED VIEWS). A POST answers with
+ // {"ok":true,...} and 201 Created, or {"ok":false,"error":"why"} and 400 (bad fields),
+ // 409 (does not fit) or 503 (out of memory or could not be saved). Deleting or moving
+ // answers 200 OK, or 404 for an unknown id. Ids never change: a deleted meeting's id is
+ // not used again, while a deleted reservation's may be (there are only MAX_RESERVATIONS).
+ 
+ // Sends a JSON document built in json (which is freed); MHD_NO if out of memory
+ enum MHD_Result send_json(struct MHD_Connection *connection, unsigned int status, TextBuffer *json) {
+     if (json->failed) {
+         free(json->data);
+         return MHD_NO;
+     }
+     struct MHD_Response *response = MHD_create_response_from_buffer(json->len, json->data, MHD_RESPMEM_MUST_FREE);
+     if (!response) {
+         free(json->data);
+         return MHD_NO;
+     }
+     MHD_add_response_header(response, "Content-Type", "application/json");
+     MHD_add_response_header(response, "Cache-Control", CACHE_NEVER);
+     enum MHD_Result ret = MHD_queue_response(connection, status, response);
+     MHD_destroy_response(response);
+     return ret;
+ }
+ 
+ // Sends {"ok":false,"error":"message"}
+ enum MHD_Result send_json_error(struct MHD_Connection *connection, unsigned int status, const char *message) {
+     TextBuffer json = {0};
+     char escaped[JSON_STR_MAX];
+     json_escape(message, escaped);
+     text_printf(&json, "{\"ok\":false,\"error\":\"%s\"}", escaped);
+     return send_json(connection, status, &json);
+ }
+ 
+ // Writes {"ok":true,"meeting":{...},"weeks":[...],"day":"...","start":"..."} for a meeting
+ // that was just placed
+ void describe_placed_meeting(TextBuffer *json, const MeetingScheduler *s, int meeting_id) {
+     char object[RECORD_MAX];
+     format_meeting_json(s, meeting_id, object, sizeof(object));
+     text_printf(json, "{\"ok\":true,\"meeting\":%s,\"weeks\":[", object);
+     const Placement *p = &s->placements[meeting_id]; // Every occurrence is on the same day and time
+     int period = FREQ_PERIOD[s->meetings[meeting_id].frequency];
+     for (int week = p->phase; week < calendar.weeks; week += period)
+         text_printf(json, "%s%d", week > p->phase ? "," : "", week + 1);
+     text_printf(json, "],\"day\":\"%s\",\"start\":\"%s\"}", DAYS[p->day], calendar.slot_names[p->start]);
+ }
+ 
+ // POST /api/meetings
+ enum MHD_Result api_add_meeting(SchedulerStore *store, struct MHD_Connection *connection) {
+     Meeting meeting;
+     const char *duration = request_value(connection, "duration");
+     const char *error = parse_meeting(&meeting,
+         request_value(connection, "name"),
+         request_value(connection, "type"),
+         duration,
+         request_value(connection, "preferred_times"),
+         request_value(connection, "fixed_day"),
+         request_value(connection, "fixed_time"),
+         request_value(connection, "frequency"),
+         request_value(connection, "attendees"));
+     // The form falls back to one slot for an odd duration; the API says so instead
+     if (!error && duration_from_minutes(atoi(duration)) < 0)
+         error = "duration must be a whole number of slots, up to 90 minutes";
+     if (error)
+         return send_json_error(connection, MHD_HTTP_BAD_REQUEST, error);
+     bool solve = wants_solver(connection);
+     SchedulerSnapshot *copy = store_begin_write(store);
+     if (!copy)
+         return send_json_error(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "out of memory");
+     if (!add_meeting(&copy->state, &meeting) &&
+         !(solve && solve_schedule(&copy->state, &meeting, 1, SOLVER_BUDGET_MS))) {
+         const char *why = solve ? "no way to fit it, even moving other meetings"
+                                 : meeting_problem(&copy->state, &meeting);
+         store_abort(store, copy);
+         return send_json_error(connection, MHD_HTTP_CONFLICT, why);
+     }
+     // Describe the result while the copy is still ours
+     TextBuffer json = {0};
+     describe_placed_meeting(&json, &copy->state, copy->state.meeting_count - 1);
+     if (!store_commit(store, copy)) {
+         free(json.data);
+         return send_json_error(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "the change could not be saved");
+     }
+     return send_json(connection, MHD_HTTP_CREATED, &json);
+ }
+ 
+ // POST /api/reservations
+ enum MHD_Result api_add_reservation(SchedulerStore *store, struct MHD_Connection *connection) {
+     const char *day = request_value(connection, "day");
+     const char *start_time = request_value(connection, "start_time");
+     const char *duration = request_value(connection, "duration");
+     int day_idx = day ? find_day_index(day) : -1;
+     int start_idx = start_time ? find_slot_index(start_time) : -1;
+     int duration_slots = duration ? duration_from_minutes(atoi(duration)) : -1;
+     if (day_idx < 0)
+         return send_json_error(connection, MHD_HTTP_BAD_REQUEST, "unknown day");
+     if (start_idx < 0)
+         return send_json_error(connection, MHD_HTTP_BAD_REQUEST, "unknown start time");
+     if (duration_slots < 0)
+         return send_json_error(connection, MHD_HTTP_BAD_REQUEST, "duration must be a whole number of slots, up to 90 minutes");
+     SchedulerSnapshot *copy = store_begin_write(store);
+     if (!copy)
+         return send_json_error(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "out of memory");
+     const char *why = reservation_problem(&copy->state, day_idx, start_idx, duration_slots);
+     if (why) {
+         store_abort(store, copy);
+         return send_json_error(connection, MHD_HTTP_CONFLICT, why);
+     }
+     int id = free_reservation_index(&copy->state); // Where reserve_slot puts it
+     reserve_slot(&copy->state, day_idx, start_idx, duration_slots);
+     char object[RECORD_MAX];
+     format_reservation_json(&copy->state, id, object, sizeof(object));
+     if (!store_commit(store, copy))
+         return send_json_error(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "the change could not be saved");
+     TextBuffer json = {0};
+     text_printf(&json, "{\"ok\":true,\"reservation\":%s}", object);
+     return send_json(connection, MHD_HTTP_CREATED, &json);
+ }
+ 
+ // POST /api/whatif (see JSON API)
+ enum MHD_Result api_whatif(SchedulerStore *store, struct MHD_Connection *connection, ImportBatch *lines) {
+     Meeting *batch = malloc(MAX_IMPORT * sizeof(Meeting));    // The lines that could be read, in order
+     Placement *where = malloc(MAX_IMPORT * sizeof(Placement)); // Where each of them would go
+     const char **why = malloc(MAX_IMPORT * sizeof(const char *));
+     if (!batch || !where || !why) {
+         free(batch);
+         free(where);
+         free(why);
+         return send_json_error(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "out of memory");
+     }
+     int count = finish_import_batch(lines);
+     int skipped = lines->skipped;
+     ImportItem *items = lines->items;
+     ImportItem **order = lines->order;
+     int valid = 0;
+     for (int i = 0; i < count; i++) {
+         if (!order[i]->error)
+             batch[valid++] = order[i]->meeting;
+     }
+     // Read the published schedule like a page does; nothing is locked or copied but the grid
+     SchedulerSnapshot *snapshot = store_acquire(store);
+     int placed = dry_run(&snapshot->state, batch, valid, where, why);
+     char generation[GENERATION_TOKEN_MAX];
+     generation_token(store, snapshot->generation, generation);
+     snapshot_release(snapshot);
+     TextBuffer json = {0};
+     if (placed >= 0) {
+         for (int i = 0, k = 0; i < count; i++) {
+             order[i]->placement.phase = -1;
+             if (!order[i]->error) {
+                 order[i]->placement = where[k];
+                 order[i]->error = why[k];
+                 k++;
+             }
+         }
+         // The answer is in file order
+         text_printf(&json, "{\"ok\":true,\"generation\":\"%s\",\"placed\":%d,\"count\":%d,\"meetings\":[",
+                     generation, placed, count + skipped);
+         for (int i = 0; i < count; i++) {
+             char name[JSON_STR_MAX];
+             json_escape(items[i].meeting.name, name);
+             text_printf(&json, "%s{\"line\":%d,\"name\":\"%s\",", i ? "," : "", items[i].line, name);
+             const Placement *p = &items[i].placement;
+             if (p->phase < 0) {
+                 char error[JSON_STR_MAX];
+                 json_escape(items[i].error, error);
+                 text_printf(&json, "\"placed\":false,\"error\":\"%s\"}", error);
+                 continue;
+             }
+             text_printf(&json, "\"placed\":true,\"day\":\"%s\",\"start\":\"%s\",\"weeks\":[",
+                         DAYS[p->day], calendar.slot_names[p->start]);
+             for (int week = p->phase; week < calendar.weeks; week += FREQ_PERIOD[items[i].meeting.frequency])
+                 text_printf(&json, "%s%d", week > p->phase ? "," : "", week + 1);
+             text_printf(&json, "]}");
+         }
+         text_printf(&json, "]}");
+     }
+     free(batch);
+     free(where);
+     free(why);
+     if (placed < 0) {
+         free(json.data);
+         return send_json_error(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "out of memory");
+     }
+     return send_json(connection, MHD_HTTP_OK, &json);
+ }
+ 
+ // Reads the id argument (-1 if it is missing or not a number)
+ int id_argument(struct MHD_Connection *connection) {
+     const char *text = request_value(connection, "id");
+     char *end;
+     long id = text ? strtol(text, &end, 10) : -1;
+     return (!text || end == text || *end || id < 0 || id > INT_MAX) ? -1 : (int)id;
+ }
+ 
+ // POST /api/meetings/delete?id=N (move false) and
+ // POST /api/meetings/move?id=N&day=D&start_time=T[&first_week=W] (move true)
+ enum MHD_Result api_change_meeting(SchedulerStore *store, struct MHD_Connection *connection, bool move) {
+     int id = id_argument(connection);
+     int day_idx = -1, start_idx = -1, first_week = -1;
+     if (move) {
+         const char *day = request_value(connection, "day");
+         const char *start_time = request_value(connection, "start_time");
+         const char *week = request_value(connection, "first_week");
+         day_idx = day ? find_day_index(day) : -1;
+         start_idx = start_time ? find_slot_index(start_time) : -1;
+         first_week = week ? atoi(week) - 1 : -1; // Counted from 1, like on the pages
+         if (day_idx < 0)
+             return send_json_error(connection, MHD_HTTP_BAD_REQUEST, "unknown day");
+         if (start_idx < 0)
+             return send_json_error(connection, MHD_HTTP_BAD_REQUEST, "unknown start time");
+         if (week && first_week < 0)
+             return send_json_error(connection, MHD_HTTP_BAD_REQUEST, "first_week counts from 1");
+     }
+     SchedulerSnapshot *copy = store_begin_write(store);
+     if (!copy)
+         return send_json_error(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "out of memory");
+     MeetingScheduler *s = &copy->state;
+     if (id < 0 || id >= s->meeting_count || meeting_deleted(s, id)) {
+         store_abort(store, copy);
+         return send_json_error(connection, MHD_HTTP_NOT_FOUND, "unknown meeting");
+     }
+     TextBuffer json = {0};
+     if (move) {
+         const char *why = move_meeting(s, id, day_idx, start_idx, first_week);
+         if (why) {
+             store_abort(store, copy);
+             return send_json_error(connection, strcmp(why, "out of memory") == 0 ? MHD_HTTP_SERVICE_UNAVAILABLE
+                                                                                 : MHD_HTTP_CONFLICT, why);
+         }
+         describe_placed_meeting(&json, s, id);
+     } else {
+         delete_meeting(s, id);
+         text_printf(&json, "{\"ok\":true}");
+     }
+     if (!store_commit(store, copy)) {
+         free(json.data);
+         return send_json_error(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "the change could not be saved");
+     }
+     return send_json(connection, MHD_HTTP_OK, &json);
+ }
+ 
+ // GET /api/free: the start times still free for a meeting of duration minutes, read
+ // straight from the booked slots of the published snapshot (nothing is tried or copied):
+ //   - without frequency, in one week (week, counted from 1; default the first)
+ //   - with a frequency, in every week such a meeting meets in: from week, every period
+ //     weeks, or (without week) once for each first week it could have ("fortnightly" gives
+ //     weeks 1, 3, ... and weeks 2, 4, ...)
+ // A start is free in several weeks if it is free in each of them: one AND per week.
+ // day limits the answer to one day. over_limit says the day already has more than 2.5 hours
+ // of meetings per week, so add_meeting would not use it (a reservation still fits).
+ // attendees asks about a meeting for just those people (see ATTENDEES); without it, the
+ // answer is for a meeting for everyone. Names not known yet have nothing booked.
+ enum MHD_Result api_free(SchedulerStore *store, struct MHD_Connection *connection) {
+     const char *duration = request_value(connection, "duration");
+     const char *day = request_value(connection, "day");
+     const char *week = request_value(connection, "week");
+     const char *frequency = request_value(connection, "frequency");
+     const char *attendees = request_value(connection, "attendees");
+     int duration_slots = duration ? duration_from_minutes(atoi(duration)) : -1;
+     int day_idx = day ? find_day_index(day) : -1;
+     int first_week = week ? atoi(week) - 1 : -1; // Counted from 1, like on the pages
+     int freq = frequency ? find_frequency_index(frequency) : -1;
+     if (duration_slots <= 0)
+         return send_json_error(connection, MHD_HTTP_BAD_REQUEST, "duration must be a whole number of slots, "
+                                "up to 90 minutes");
+     if (day && day_idx < 0)
+         return send_json_error(connection, MHD_HTTP_BAD_REQUEST, "unknown day");
+     if (week && (first_week < 0 || first_week >= calendar.weeks))
+         return send_json_error(connection, MHD_HTTP_BAD_REQUEST, "week is outside the calendar");
+     if (frequency && freq < 0)
+         return send_json_error(connection, MHD_HTTP_BAD_REQUEST, "unknown frequency");
+     // The weeks to check: first_week, first_week + period, ... for each first week asked for
+     int period = freq >= 0 ? FREQ_PERIOD[freq] : calendar.weeks; // No frequency: one week
+     int phase_begin = first_week >= 0 ? first_week : 0;
+     int phase_end = first_week >= 0 ? first_week + 1 : (freq >= 0 ? frequency_phases((Frequency)freq) : 1);
+ 
+     SchedulerSnapshot *snapshot = store_acquire(store);
+     MeetingScheduler *s = &snapshot->state;
+     // Unknown names are left out, as they have nothing booked. If no name is known, only
+     // reservations and meetings for everyone are in the way.
+     AttendeeSet set = attendees ? known_attendee_set(s, attendees) : 0;
+     bool for_everyone = !attendees || count_attendee_names(attendees) == 0;
+     TextBuffer json = {0};
+     char generation[GENERATION_TOKEN_MAX];
+     generation_token(store, snapshot->generation, generation);
+     text_printf(&json, "{\"ok\":true,\"generation\":\"%s\",\"duration\":%d,\"free\":[", generation,
+                 duration_slots * calendar.slot_minutes);
+     bool first = true;
+     for (int d = 0; d < calendar.days; d++) {
+         if (day_idx >= 0 && d != day_idx)
+             continue;
+         bool over_limit = s->meeting_hours[d] / calendar.weeks > 2.5;
+         for (int phase = phase_begin; phase < phase_end; phase++) {
+             SlotMask starts = ~(SlotMask)0;
+             if (for_everyone || set) {
+                 starts = attendee_phase_starts(s, set, period, phase, d, duration_slots);
+             } else {
+                 for (int w = phase; w < calendar.weeks; w += period)
+                     starts &= free_starts(s->blocked_slots[day_cell(w, d)], duration_slots);
+             }
+             text_printf(&json, "%s{\"day\":\"%s\",\"weeks\":[", first ? "" : ",", DAYS[d]);
+             first = false;
+             for (int w = phase; w < calendar.weeks; w += period)
+                 text_printf(&json, "%s%d", w > phase ? "," : "", w + 1);
+             text_printf(&json, "],\"starts\":[");
+             for (SlotMask left = starts; left; left &= left - 1) // One set bit at a time
+                 text_printf(&json, "%s\"%s\"", left == starts ? "" : ",", calendar.slot_names[lowest_slot(left)]);
+             text_printf(&json, "],\"over_limit\":%s}", over_limit ? "true" : "false");
+         }
+     }
+     text_printf(&json, "]}");
+     snapshot_release(snapshot);
+     return send_json(connection, MHD_HTTP_OK, &json);
+ }
+ 
+ // POST /api/reservations/delete?id=N (move false) and
+ // POST /api/reservations/move?id=N&day=D&start_time=T (move true)
+ enum MHD_Result api_change_reservation(SchedulerStore *store, struct MHD_Connection *connection, bool move) {
+     int id = id_argument(connection);
+     int day_idx = -1, start_idx = -1;
+     if (move) {
+         const char *day = request_value(connection, "day");
+         const char *start_time = request_value(connection, "start_time");
+         day_idx = day ? find_day_index(day) : -1;
+         start_idx = start_time ? find_slot_index(start_time) : -1;
+         if (day_idx < 0)
+             return send_json_error(connection, MHD_HTTP_BAD_REQUEST, "unknown day");
+         if (start_idx < 0)
+             return send_json_error(connection, MHD_HTTP_BAD_REQUEST, "unknown start time");
+     }
+     SchedulerSnapshot *copy = store_begin_write(store);
+     if (!copy)
+         return send_json_error(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "out of memory");
+     MeetingScheduler *s = &copy->state;
+     if (id < 0 || id >= s->reservation_count || s->reservations[id].duration == 0) {
+         store_abort(store, copy);
+         return send_json_error(connection, MHD_HTTP_NOT_FOUND, "unknown reservation");
+     }
+     TextBuffer json = {0};
+     if (move) {
+         const char *why = move_reservation(s, id, day_idx, start_idx);
+         if (why) {
+             store_abort(store, copy);
+             return send_json_error(connection, MHD_HTTP_CONFLICT, why);
+         }
+         char object[RECORD_MAX];
+         format_reservation_json(s, id, object, sizeof(object));
+         text_printf(&json, "{\"ok\":true,\"reservation\":%s}", object);
+     } else {
+         unreserve(s, id);
+         text_printf(&json, "{\"ok\":true}");
+     }
+     if (!store_commit(store, copy)) {
+         free(json.data);
+         return send_json_error(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "the change could not be saved");
+     }
+     return send_json(connection, MHD_HTTP_OK, &json);
+ }
+ 
+ // Reads a generation token of store (see generation_token) into *generation. Returns false
+ // if text is not a token at all; *same_store says whether store counted it.
+ bool parse_generation_token(const SchedulerStore *store, const char *text, unsigned long *generation,
+                             bool *same_store) {
+     unsigned long boot_id, store_id;
+     int used = -1;
+     if (sscanf(text, "%lx-%lx-%lu%n", &boot_id, &store_id, generation, &used) != 3 || used < 0 ||
+         text[used] != '\0' || *text == '-')
+         return false;
+     *same_store = boot_id == store->boot_id && store_id == store->store_id;
+     return true;
+ }
+ 
+ // Sends {"generation":G,"changes":[...]} with every change after since, or a resync
+ // (always, if since was counted by another store). Call with feed_lock held.
+ enum MHD_Result send_changes(SchedulerStore *store, struct MHD_Connection *connection, unsigned long since,
+                              bool same_store) {
+     unsigned long newest = store->feed_generation;
+     bool complete = same_store && since <= newest && newest - since <= CHANGE_HISTORY;
+     for (unsigned long g = since + 1; complete && g <= newest; g++) {
+         ChangeRecord *record = &store->changes[g % CHANGE_HISTORY];
+         complete = record->generation == g && record->json;
+     }
+     char token[GENERATION_TOKEN_MAX];
+     generation_token(store, newest, token);
+     TextBuffer json = {0};
+     if (!complete) {
+         text_printf(&json, "{\"generation\":\"%s\",\"resync\":true}", token);
+     } else {
+         text_printf(&json, "{\"generation\":\"%s\",\"changes\":[", token);
+         for (unsigned long g = since + 1; g <= newest; g++) {
+             ChangeRecord *record = &store->changes[g % CHANGE_HISTORY];
+             if (g > since + 1)
+                 text_append(&json, ",", 1);
+             text_append(&json, record->json, record->len);
+         }
+         text_append(&json, "]}", 2);
+     }
+     return send_json(connection, MHD_HTTP_OK, &json);
+ }
+ 
+ // GET /api/changes?since=G[&wait=N] (see CHANGE FEED)
+ enum MHD_Result api_changes(SchedulerStore *store, struct MHD_Connection *connection, void **con_cls) {
+     const char *since_text = request_value(connection, "since");
+     const char *wait_text = request_value(connection, "wait");
+     unsigned long since;
+     bool same_store;
+     if (!since_text || !parse_generation_token(store, since_text, &since, &same_store))
+         return send_json_error(connection, MHD_HTTP_BAD_REQUEST, "since must be a generation "
+                                "(from \"generation\" or X-Schedule-Generation)");
+     int wait = wait_text ? atoi(wait_text) : 0;
+     if (wait > CHANGE_WAIT_MAX)
+         wait = CHANGE_WAIT_MAX;
+     RequestContext *context = (RequestContext *)*con_cls;
+     pthread_mutex_lock(&feed_lock);
+     // Up to date and willing to wait (and not just woken from waiting): wait for a change.
+     // Once the server stops, answer at once: it cannot close while a connection is suspended
+     if (wait > 0 && same_store && since == store->feed_generation && !(context && context->waited) &&
+         !atomic_load(&feed_stopping)) {
+         if (!context)
+             context = *con_cls = calloc(1, sizeof(RequestContext)); // Freed by request_completed
+         if (context) {
+             context->waited = true;
+             context->waiter.connection = connection;
+             context->waiter.store = store;
+             context->waiter.deadline = now_ns() + wait * 1000000000LL;
+             context->waiter.next = feed_waiters;
+             feed_waiters = &context->waiter;
+             MHD_suspend_connection(connection); // Until a change, the timer or shutdown
+             pthread_mutex_unlock(&feed_lock);
+             return MHD_YES;
+         }
+     }
+     enum MHD_Result ret = send_changes(store, connection, since, same_store);
+     pthread_mutex_unlock(&feed_lock);
+     return ret;
+ }
+ 
+ // Answers one request for one tenant; url has the tenant prefix already removed
+ enum MHD_Result handle_request(SchedulerStore *store, struct MHD_Connection *connection,
+                                const char *url, bool is_post, void **con_cls) {
+     // Main page: shows forms
+     if (strcmp(url, "/") == 0) {
+         return serve_static_page(connection, PAGE_MAIN);
+     }
+     // Add reservation
+     else if (strcmp(url, "/addReservation") == 0) {
+         // Get form data
+         const char *day = request_value(connection, "day");
+         const char *start_time = request_value(connection, "start_time");
+         const char *duration_str = request_value(connection, "duration");
+         bool success = false;
+         // Turn the text into indices once, here; the scheduler only works with numbers
+         int day_idx = day ? find_day_index(day) : -1;
+         int start_idx = start_time ? find_slot_index(start_time) : -1;
+         // Duration must be a whole number of slots, up to 90 min
+         int duration_slots = duration_str ? duration_from_minutes(atoi(duration_str)) : -1;
+         if (day_idx >= 0 && start_idx >= 0 && duration_slots > 0) {
+             SchedulerSnapshot *copy = store_begin_write(store);
+             if (copy) {
+                 success = reserve_slot(&copy->state, day_idx, start_idx, duration_slots); // Try to reserve
+                 if (success)
+                     success = store_commit(store, copy); // Fails if it could not be saved
+                 else
+                     store_abort(store, copy);
+             }
+         }
+         return serve_static_page(connection, success ? PAGE_RESERVATION_ADDED : PAGE_RESERVATION_FAILED);
+     }
+     // Add meeting
+     else if (strcmp(url, "/addMeeting") == 0) {
+         Meeting meeting;
+         // Get form data
+         const char *error = parse_meeting(&meeting,
+             request_value(connection, "name"),
+             request_value(connection, "type"),
+             request_value(connection, "duration"),
+             request_value(connection, "preferred_times"),
+             request_value(connection, "fixed_day"),
+             request_value(connection, "fixed_time"),
+             request_value(connection, "frequency"),
+             request_value(connection, "attendees"));
+         // Try to add meeting (a failed attempt leaves the published schedule untouched)
+         bool solve = wants_solver(connection);
+         bool success = false;
+         SchedulerSnapshot *copy = error ? NULL : store_begin_write(store); // Bad fields fail right away
+         if (copy) {
+             success = add_meeting(&copy->state, &meeting) ||
+                       (solve && solve_schedule(&copy->state, &meeting, 1, SOLVER_BUDGET_MS)); // Re-plan if asked
+             if (success)
+                 success = store_commit(store, copy); // Fails if it could not be saved
+             else
+                 store_abort(store, copy);
+         }
+         return serve_static_page(connection, success ? PAGE_MEETING_ADDED : PAGE_MEETING_FAILED);
+     }
+     // Show schedule
+     else if (strcmp(url, "/displaySchedule") == 0) {
+         return serve_view(store, connection, VIEW_SCHEDULE_HTML); // Rendered once per change
+     }
+     // Export ICS
+     else if (strcmp(url, "/exportICS") == 0) {
+         return serve_view(store, connection, VIEW_ICS); // Send file directly
+     }
+     // Add many meetings from a CSV body
+     else if (strcmp(url, "/importMeetings") == 0) {
+         if (!is_post)
+             return serve_static_page(connection, PAGE_METHOD_NOT_ALLOWED);
+         RequestContext *context = (RequestContext *)*con_cls;
+         size_t len;
+         char *page = import_meetings(store, &context->batch, wants_solver(connection), &len);
+         if (!page)
+             return MHD_NO;
+         struct MHD_Response *response = MHD_create_response_from_buffer(len, page, MHD_RESPMEM_MUST_FREE);
+         if (!response) {
+             free(page);
+             return MHD_NO;
+         }
+         MHD_add_response_header(response, "Content-Type", "text/html; charset=utf-8");
+         enum MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+         MHD_destroy_response(response);
+         return ret;
+     }
+     // Clear schedule
+     else if (strcmp(url, "/clearSession") == 0) {
+         SchedulerSnapshot *copy = store_begin_write(store);
+         if (copy) {
+             free_scheduler(&copy->state); // Reset everything
+             if (init_scheduler(&copy->state))
+                 store_commit(store, copy); // A write error is reported on the console
+             else
+                 store_abort(store, copy);
+         }
+         return serve_static_page(connection, PAGE_SESSION_CLEARED);
+     }
+     // JSON API (see JSON API)
+     else if (strcmp(url, "/api/schedule") == 0) {
+         return serve_view(store, connection, VIEW_SCHEDULE_JSON);
+     }
+     else if (strcmp(url, "/api/meetings") == 0) {
+         return is_post ? api_add_meeting(store, connection) : serve_view(store, connection, VIEW_MEETINGS_JSON);
+     }
+     else if (strcmp(url, "/api/reservations") == 0) {
+         return is_post ? api_add_reservation(store, connection) : serve_view(store, connection, VIEW_RESERVATIONS_JSON);
+     }
+     else if (strcmp(url, "/api/meetings/delete") == 0 || strcmp(url, "/api/meetings/move") == 0) {
+         if (!is_post)
+             return send_json_error(connection, MHD_HTTP_METHOD_NOT_ALLOWED, "use POST");
+         return api_change_meeting(store, connection, strcmp(url, "/api/meetings/move") == 0);
+     }
+     else if (strcmp(url, "/api/reservations/delete") == 0 || strcmp(url, "/api/reservations/move") == 0) {
+         if (!is_post)
+             return send_json_error(connection, MHD_HTTP_METHOD_NOT_ALLOWED, "use POST");
+         return api_change_reservation(store, connection, strcmp(url, "/api/reservations/move") == 0);
+     }
+     else if (strcmp(url, "/api/whatif") == 0) {
+         if (!is_post)
+             return send_json_error(connection, MHD_HTTP_METHOD_NOT_ALLOWED, "use POST");
+         RequestContext *context = (RequestContext *)*con_cls;
+         return api_whatif(store, connection, &context->batch);
+     }
+     else if (strcmp(url, "/api/changes") == 0) {
+         return api_changes(store, connection, con_cls);
+     }
+     else if (strcmp(url, "/api/free") == 0) {
+         return api_free(store, connection);
+     }
+     else if (strcmp(url, "/api/attendees") == 0) {
+         return serve_view(store, connection, VIEW_ATTENDEES_JSON);
+     }
+     // Unknown URL
+     else {
+         return serve_static_page(connection, PAGE_NOT_FOUND);
+     }
+ }
+ 
+ // Handles web requests (like clicking a link or submitting a form)
+ static enum MHD_Result answer_to_connection(void *cls, struct MHD_Connection *connection,
+     const char *url, const char *method, const char *version, const char *upload_data,
+     size_t *upload_data_size, void **con_cls) {
+     (void)version; // Unused parameter
+ 
+     TenantRegistry *registry = (TenantRegistry *)cls; // Get shared scheduler data from cls
+     // The first call for a request (later calls have a context: a POST body, or a long
+     // poll coming back); every request is answered in its first call or gets a context
+     if (!*con_cls)
+         atomic_fetch_add(&requests_running, 1);
+ 
+     // A POST body arrives over several calls: first set up a context, then read each
+     // piece as it comes (see start_body), and only answer once the whole body is in (the
+     // call with no new data)
+     bool is_post = (strcmp(method, "POST") == 0);
+     if (is_post) {
+         RequestContext *context = (RequestContext *)*con_cls;
+         if (!context) {
+             context = calloc(1, sizeof(RequestContext));
+             if (!context)
+                 return MHD_NO; // Out of memory: drop the connection
+             *con_cls = context;
+             return start_body(context, connection, url) ? MHD_YES : MHD_NO; // Ask for the body
+         }
+         if (*upload_data_size > 0) {
+             if (context->batch.items)
+                 read_import_data(&context->batch, upload_data, *upload_data_size);
+             else if (context->form && MHD_post_process(context->form, upload_data, *upload_data_size) != MHD_YES)
+                 return MHD_NO; // Malformed form
+             *upload_data_size = 0; // Tell libmicrohttpd we used this piece
+             return MHD_YES;
+         }
+     }
+ 
+     // /metrics covers the whole server, so it comes before any tenant
+     if (strcmp(url, "/metrics") == 0) {
+         long long start = now_ns();
+         enum MHD_Result ret = serve_metrics(connection);
+         observe_request(ROUTE_METRICS, now_ns() - start);
+         return ret;
+     }
+ 
+     // Work out which tenant the request is for (see TENANTS)
+     char tenant_id[MAX_TENANT_ID + 1] = DEFAULT_TENANT;
+     if (strncmp(url, "/u/", 3) == 0) {
+         const char *id = url + 3;
+         const char *rest = strchr(id, '/');
+         size_t len = rest ? (size_t)(rest - id) : strlen(id);
+         if (!valid_tenant_id(id, len))
+             return serve_static_page(connection, PAGE_NOT_FOUND);
+         if (!rest) {
+             // "/u/team" -> "/u/team/", so the page's relative links stay inside the tenant
+             char location[MAX_TENANT_ID + 8];
+             snprintf(location, sizeof(location), "/u/%.*s/", (int)len, id);
+             return redirect_to(connection, location);
+         }
+         memcpy(tenant_id, id, len);
+         tenant_id[len] = '\0';
+         url = rest; // The rest of the path, starting with '/'
+     } else {
+         const char *session = MHD_lookup_connection_value(connection, MHD_COOKIE_KIND, "session");
+         if (session) {
+             if (!valid_tenant_id(session, strlen(session)))
+                 return serve_static_page(connection, PAGE_NOT_FOUND);
+             snprintf(tenant_id, sizeof(tenant_id), "%s", session);
+         }
+     }
+     // A form field that did not fit is refused rather than used cut off (see read_form_field)
+     RequestContext *context = is_post ? (RequestContext *)*con_cls : NULL;
+     if (context && context->form_too_long) {
+         if (strncmp(url, "/api/", 5) != 0)
+             return serve_static_page(connection, PAGE_FIELD_TOO_LONG);
+         char message[64];
+         snprintf(message, sizeof(message), "field too long: %s", context->form_too_long);
+         return send_json_error(connection, MHD_HTTP_BAD_REQUEST, message);
+     }
+     long long start = now_ns(); // Loading the tenant counts as part of the request
+     Tenant *tenant = tenant_acquire(registry, tenant_id);
+     if (!tenant)
+         return serve_static_page(connection, PAGE_BUSY);
+     enum MHD_Result ret = handle_request(&tenant->store, connection, url, is_post, con_cls);
+     tenant_release(registry, tenant);
+     observe_request(find_route(url), now_ns() - start);
+     return ret;
+ }
+ 
+ // Starts the timer that ends long polls (see CHANGE FEED); runs once per process
+ void start_feed_timer(void) {
+     pthread_t thread;
+     if (pthread_create(&thread, NULL, feed_timer, NULL) == 0)
+         pthread_detach(thread);
+     else
+         fprintf(stderr, "Cannot start the change feed timer; long polls wait for the next change\n");
+ }
+ 
+ // -------------------------
+ // SERVER OPTIONS
+ // -------------------------
+ 
+ // How the server takes connections, set on the command line:
+ //   --port N                the port to listen on (default PORT)
+ //   --server-mode MODE      how connections are watched: epoll, poll, select, or auto (the
+ //                           best this system has: epoll on Linux). select cannot watch more
+ //                           than FD_SETSIZE (usually 1024) connections.
+ //   --threads N             threads answering requests (default THREAD_POOL_SIZE); each has
+ //                           its own share of the connections
+ //   --max-connections N     connections open at once (default SERVER_MAX_CONNECTIONS)
+ //   --max-per-ip N          connections open at once from one address (default 0 = any)
+ //   --connection-timeout S  close a connection idle for S seconds (default 0 = never).
+ //                           /api/changes?wait= does not count as idle.
+ //   --drain-seconds S       on shutdown, how long requests in progress may take to finish
+ //                           (default SERVER_DRAIN_SECONDS)
+ // Long polls (see CHANGE FEED) are suspended while they wait, so thousands of waiting
+ // clients take a connection each but no thread. At startup the limit on open files is
+ // raised to fit --max-connections, as far as the system allows.
+ #define SERVER_MAX_CONNECTIONS 10000
+ #define SERVER_DRAIN_SECONDS 10
+ 
+ typedef struct {
+     int port;                // --port
+     const char *mode;        // --server-mode
+     int threads;             // --threads
+     int max_connections;     // --max-connections
+     int max_per_ip;          // --max-per-ip
+     int connection_timeout;  // --connection-timeout
+     int drain_seconds;       // --drain-seconds
+ } ServerOptions;
+ 
+ ServerOptions server = {PORT, "auto", THREAD_POOL_SIZE, SERVER_MAX_CONNECTIONS, 0, 0, SERVER_DRAIN_SECONDS};
+ 
+ // The libmicrohttpd flag for a --server-mode (0 if unknown)
+ unsigned int server_mode_flag(const char *mode) {
+     if (strcmp(mode, "auto") == 0)
+         return MHD_USE_AUTO_INTERNAL_THREAD;
+     if (strcmp(mode, "epoll") == 0)
+         return MHD_USE_EPOLL_INTERNAL_THREAD;
+     if (strcmp(mode, "poll") == 0)
+         return MHD_USE_POLL_INTERNAL_THREAD;
+     if (strcmp(mode, "select") == 0)
+         return MHD_USE_SELECT_INTERNALLY;
+     return 0;
+ }
+ 
+ // Raises the limit on open files so max_connections fit (plus some for the data files)
+ void raise_file_limit(int max_connections) {
+     struct rlimit limit;
+     rlim_t wanted = (rlim_t)max_connections + 64;
+     if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur >= wanted)
+         return;
+     limit.rlim_cur = (limit.rlim_max == RLIM_INFINITY || limit.rlim_max > wanted) ? wanted : limit.rlim_max;
+     if (setrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur < wanted)
+         fprintf(stderr, "Only %lu files may be open: fewer than %d connections will fit\n",
+                 (unsigned long)limit.rlim_cur, max_connections);
+ }
+ 
+ // Starts the web server on port, as the server options say; returns NULL if it could not
+ // start. Stop it with stop_server.
+ struct MHD_Daemon *start_server(uint16_t port, TenantRegistry *registry) {
+     static pthread_once_t timer_once = PTHREAD_ONCE_INIT;
+     pthread_once(&timer_once, start_feed_timer);
+     unsigned int max_connections = (unsigned int)server.max_connections;
+     if (strcmp(server.mode, "select") == 0 && max_connections > FD_SETSIZE - 4)
+         max_connections = FD_SETSIZE - 4; // All select can watch (libmicrohttpd keeps a few)
+     raise_file_limit((int)max_connections);
+     // ITC lets stop_server stop taking connections while the others finish
+     return MHD_start_daemon(server_mode_flag(server.mode) | MHD_ALLOW_SUSPEND_RESUME | MHD_USE_ITC, port, NULL, NULL,
+                             &answer_to_connection, registry,
+                             MHD_OPTION_THREAD_POOL_SIZE, (unsigned int)server.threads,
+                             MHD_OPTION_CONNECTION_LIMIT, max_connections,
+                             MHD_OPTION_PER_IP_CONNECTION_LIMIT, (unsigned int)server.max_per_ip,
+                             MHD_OPTION_CONNECTION_TIMEOUT, (unsigned int)server.connection_timeout,
+                             MHD_OPTION_NOTIFY_COMPLETED, &request_completed, NULL,
+                             MHD_OPTION_END);
+ }
+ 
+ // The signals that stop the server (blocked in every thread, see wait_for_stop_signal)
+ sigset_t stop_signals;
+ 
+ // Blocks SIGINT and SIGTERM, so that no thread is interrupted by them and main can wait for
+ // them instead. Call before starting any thread: new threads inherit the blocked signals.
+ void block_stop_signals(void) {
+     sigemptyset(&stop_signals);
+     sigaddset(&stop_signals, SIGINT);
+     sigaddset(&stop_signals, SIGTERM);
+     pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+ }
+ 
+ // Waits until SIGINT or SIGTERM arrives (needs no terminal, so it works under systemd)
+ void wait_for_stop_signal(void) {
+     int signal_number;
+     while (sigwait(&stop_signals, &signal_number) != 0) {}
+ }
+ 
+ // Stops the web server: stops taking connections, answers the requests that wait for
+ // changes, gives the requests in progress up to drain_seconds to finish (a second stop
+ // signal cuts that short), then closes every connection
+ void stop_server(struct MHD_Daemon *daemon, int drain_seconds) {
+     int listen_fd = MHD_quiesce_daemon(daemon); // -1 if it could not
+     atomic_store(&feed_stopping, true); // Checked under feed_lock, so no one suspends after the wake below
+     feed_wake_all();
+     long long deadline = now_ns() + drain_seconds * 1000000000LL;
+     while (now_ns() < deadline) {
+         if (atomic_load(&requests_running) == 0)
+             break; // Every request is done (idle keep-alive connections are not waited for)
+         struct timespec pause = {0, 100000000}; // Check again in 0.1 s
+         if (sigtimedwait(&stop_signals, NULL, &pause) >= 0)
+             break; // Asked again: stop now
+     }
+     feed_wake_all(); // Again, so no connection can be left suspended when the daemon stops
+     MHD_stop_daemon(daemon);
+     if (listen_fd >= 0)
+         close(listen_fd);
+ }
+ 
+ // -------------------------
+ // BENCHMARKS
+ // -------------------------
+ 
+ // "./cweb --bench all" measures instead of serving, so a change can be timed before and after:
+ //   scheduler  add_meeting, reserve_slot, copy_scheduler, fork_occupancy, dry_run,
+ //              choose_placement and the three renderers, in ns/op
+ //              (and allocations per op, when built with COUNT_ALLOCATIONS; see the top)
+ //   http       client threads send requests to a real server on BENCH_PORT over keep-alive
+ //              connections, and the requests/s and p50/p99 latency are printed
+ // ("--bench scheduler" or "--bench http" runs one part.) The calendar options set the horizon;
+ // the workload is chosen with:
+ //   --bench-meetings N   meetings per scheduler run (default 200)
+ //   --bench-mix NAME     weekly (short weekly meetings), mixed (every length and frequency,
+ //                        some preferred times) or fixed (mixed, with half of them fixed)
+ //   --bench-requests N   HTTP requests in total (default 20000)
+ //   --bench-clients N    HTTP client threads, one connection each (default 4)
+ //   --bench-writes P     percent of HTTP requests that add a meeting (default 10)
+ //   --bench-attendees N  a pool of N attendees, three of whom attend each meeting of the
+ //                        mix (default 0: every meeting is for everyone; see ATTENDEES)
+ // The HTTP clients all use the tenant "bench"; with --data-dir it is saved like any other,
+ // so the cost of saving is measured too.
+ 
+ #define BENCH_PORT (PORT + 1)     // Not PORT, so a running server is left alone
+ #define BENCH_MIN_NS 300000000LL  // Repeat each scheduler benchmark for at least 0.3 s
+ #define BENCH_BUFFER 65536        // Receive buffer of one HTTP client
+ 
+ typedef struct {
+     const char *what;  // "scheduler", "http" or "all"; NULL = serve as usual
+     int meetings;      // --bench-meetings
+     const char *mix;   // --bench-mix
+     int requests;      // --bench-requests
+     int clients;       // --bench-clients
+     int writes;        // --bench-writes
+     int attendees;     // --bench-attendees
+ } BenchOptions;
+ 
+ BenchOptions bench = {NULL, 200, "mixed", 20000, 4, 10, 0};
+ 
+ // Number of malloc, calloc and realloc calls made by this file so far. Built with
+ // COUNT_ALLOCATIONS and the linker's --wrap options (see the top), those calls go through
+ // the __wrap_ functions below first; otherwise it stays 0.
+ atomic_ulong allocation_count;
+ 
+ #ifdef COUNT_ALLOCATIONS
+ void *__real_malloc(size_t size);
+ void *__real_calloc(size_t count, size_t size);
+ void *__real_realloc(void *pointer, size_t size);
+ 
+ void *__wrap_malloc(size_t size) {
+     atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+     return __real_malloc(size);
+ }
+ 
+ void *__wrap_calloc(size_t count, size_t size) {
+     atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+     return __real_calloc(count, size);
+ }
+ 
+ void *__wrap_realloc(void *pointer, size_t size) {
+     atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+     return __real_realloc(pointer, size);
+ }
+ #endif
+ 
+ // Fills in meeting number i of the chosen mix (the same list every run, so runs compare)
+ void bench_meeting(Meeting *meeting, int i) {
+     bool weekly = strcmp(bench.mix, "weekly") == 0;
+     memset(meeting, 0, sizeof(*meeting));
+     for (int k = 0; k < 8; k++) meeting->preferred_hours[k] = -1;
+     snprintf(meeting->name, MAX_STR, "Bench %d", i);
+     snprintf(meeting->type, MAX_STR, "%s", i % 2 ? "Review" : "Sync");
+     meeting->duration = duration_from_minutes(weekly ? 30 : 30 * (1 + i % 3));
+     if (meeting->duration < 0)
+         meeting->duration = 1; // Slots longer than the meeting: one slot, as the form does
+     meeting->frequency = weekly ? FREQ_WEEKLY : (Frequency)(i % FREQ_COUNT);
+     meeting->fixed_day = meeting->fixed_time = -1;
+     if (!weekly && i % 3 == 0) {
+         meeting->preferred_hours[0] = (i * 7) % calendar.slots;
+         meeting->preferred_hours[1] = (i * 11) % calendar.slots;
+     }
+     if (strcmp(bench.mix, "fixed") == 0 && i % 2 == 0) {
+         meeting->fixed_day = (i / 2) % calendar.days;
+         if (i % 4 == 0)
+             meeting->fixed_time = (i * 5) % calendar.slots;
+     }
+     if (bench.attendees > 0)
+         snprintf(meeting->attendees, sizeof(meeting->attendees), "Person %d;Person %d;Person %d",
+                  i % bench.attendees, (i * 7 + 1) % bench.attendees, (i * 13 + 2) % bench.attendees);
+ }
+ 
+ // Adds the reservations used by the benchmarks (some of them clash and are refused)
+ void bench_reservations(MeetingScheduler *scheduler) {
+     for (int i = 0; i < MAX_RESERVATIONS; i++)
+         reserve_slot(scheduler, i % calendar.days, (i * 5) % calendar.slots, 1 + i % 2);
+ }
+ 
+ // One benchmark step: does some work (on full, a filled schedule, if it needs one)
+ // and returns how many operations that was
+ typedef int (*BenchStep)(MeetingScheduler *full);
+ 
+ // Adds every meeting of the mix to an empty schedule (per meeting, empty schedule included)
+ int bench_add_meeting(MeetingScheduler *full) {
+     (void)full;
+     MeetingScheduler s;
+     Meeting meeting;
+     if (init_scheduler(&s)) {
+         for (int i = 0; i < bench.meetings; i++) {
+             bench_meeting(&meeting, i);
+             add_meeting(&s, &meeting);
+         }
+     }
+     free_scheduler(&s);
+     return bench.meetings;
+ }
+ 
+ // Fills an empty schedule with reservations (per reservation)
+ int bench_reserve_slot(MeetingScheduler *full) {
+     (void)full;
+     MeetingScheduler s;
+     if (init_scheduler(&s))
+         bench_reservations(&s);
+     free_scheduler(&s);
+     return MAX_RESERVATIONS;
+ }
+ 
+ // Copies the filled schedule, as every change does before it is published
+ int bench_copy_scheduler(MeetingScheduler *full) {
+     MeetingScheduler copy;
+     if (copy_scheduler(&copy, full))
+         free_scheduler(&copy);
+     return 1;
+ }
+ 
+ // Forks the filled schedule's occupancy, as /api/whatif does instead of copying it
+ int bench_fork_occupancy(MeetingScheduler *full) {
+     MeetingScheduler fork;
+     if (fork_occupancy(&fork, full, full->attendee_count))
+         free_occupancy(&fork);
+     return 1;
+ }
+ 
+ // Dry-runs ten meetings of the mix against the filled schedule (per meeting)
+ int bench_dry_run(MeetingScheduler *full) {
+     Meeting batch[10];
+     Placement where[10];
+     const char *why[10];
+     for (int i = 0; i < 10; i++)
+         bench_meeting(&batch[i], i);
+     dry_run(full, batch, 10, where, why);
+     return 10;
+ }
+ 
+ // Chooses places for ten meetings of the mix in the filled schedule, per meeting
+ int bench_choose(MeetingScheduler *full) {
+     for (int i = 0; i < 10; i++) {
+         Meeting meeting;
+         Placement where;
+         int candidates;
+         bench_meeting(&meeting, i);
+         choose_placement(full, &meeting, known_attendee_set(full, meeting.attendees), &where, &candidates);
+     }
+     return 10;
+ }
+ 
+ // Renders the filled schedule as the schedule page, the ICS file and the JSON document
+ int bench_schedule_html(MeetingScheduler *full) {
+     size_t len;
+     free(render_document(full, next_schedule_html_record, &len));
+     return 1;
+ }
+ 
+ int bench_ics(MeetingScheduler *full) {
+     size_t len;
+     free(render_document(full, next_ics_record, &len));
+     return 1;
+ }
+ 
+ int bench_schedule_json(MeetingScheduler *full) {
+     size_t len;
+     free(render_document(full, next_schedule_json_record, &len));
+     return 1;
+ }
+ 
+ // Repeats step until BENCH_MIN_NS has passed and prints the time and allocations per operation
+ void bench_run(const char *name, BenchStep step, MeetingScheduler *full) {
+     long long ops = 0, start = now_ns(), elapsed;
+     unsigned long allocations = atomic_load(&allocation_count);
+     do {
+         ops += step(full);
+         elapsed = now_ns() - start;
+     } while (elapsed < BENCH_MIN_NS);
+     allocations = atomic_load(&allocation_count) - allocations;
+     printf("  %-16s %12.1f ns/op %10.2f allocs/op %12lld ops\n", name,
+            (double)elapsed / ops, (double)allocations / ops, ops);
+ }
+ 
+ // The scheduler part of --bench; false if out of memory
+ bool bench_scheduler(void) {
+     MeetingScheduler full; // Reservations first, then every meeting of the mix
+     if (!init_scheduler(&full)) {
+         free_scheduler(&full);
+         return false;
+     }
+     bench_reservations(&full);
+     for (int i = 0; i < bench.meetings; i++) {
+         Meeting meeting;
+         bench_meeting(&meeting, i);
+         add_meeting(&full, &meeting);
+     }
+     printf("Scheduler (mix: %s, %d of %d meetings placed, %d entries, %d reservations, %d attendees)\n", bench.mix,
+            full.meeting_count, bench.meetings, full.schedule_count, full.reservation_count, full.attendee_count);
+     if (atomic_load(&allocation_count) == 0)
+         printf("  (allocations are not counted: build with COUNT_ALLOCATIONS)\n");
+     bench_run("add_meeting", bench_add_meeting, &full);
+     bench_run("reserve_slot", bench_reserve_slot, &full);
+     bench_run("copy_scheduler", bench_copy_scheduler, &full);
+     bench_run("fork_occupancy", bench_fork_occupancy, &full);
+     bench_run("dry_run", bench_dry_run, &full);
+     bench_run("choose_placement", bench_choose, &full);
+     bench_run("schedule page", bench_schedule_html, &full);
+     bench_run("ICS file", bench_ics, &full);
+     bench_run("schedule JSON", bench_schedule_json, &full);
+     free_scheduler(&full);
+     return true;
+ }
+ 
+ // One HTTP client thread of the benchmark
+ typedef struct {
+     pthread_t thread;
+     int id;             // Client number (keeps the meeting names of clients apart)
+     int requests;       // Requests to send
+     long long *latency; // Time each answered request took, in ns
+     int done;           // Requests answered
+ } BenchClient;
+ 
+ // Reads one response (headers, then a body of Content-Length bytes); false on error
+ bool bench_read_response(int fd, char *buf) {
+     size_t len = 0;
+     char *end = NULL;
+     while (!end) {
+         if (len == BENCH_BUFFER - 1)
+             return false; // Headers too long
+         ssize_t n = read(fd, buf + len, BENCH_BUFFER - 1 - len);
+         if (n <= 0)
+             return false;
+         len += n;
+         buf[len] = '\0';
+         end = strstr(buf, "\r\n\r\n");
+     }
+     *end = '\0'; // Only look for Content-Length in the headers
+     const char *length = strstr(buf, "\r\nContent-Length:");
+     size_t body = length ? strtoul(length + 17, NULL, 10) : 0;
+     size_t have = len - (size_t)(end + 4 - buf); // Body bytes that came with the headers
+     while (have < body) {
+         ssize_t n = read(fd, buf, body - have < BENCH_BUFFER ? body - have : BENCH_BUFFER);
+         if (n <= 0)
+             return false;
+         have += n;
+     }
+     return true;
+ }
+ 
+ // Sends the client's requests one after the other over one connection. Most of them read a
+ // page; --bench-writes percent of them, spread evenly, add a meeting.
+ void *bench_client(void *arg) {
+     BenchClient *client = (BenchClient *)arg;
+     static const char *READS[] = {"/displaySchedule", "/api/schedule", "/exportICS", "/"};
+     char *buf = malloc(BENCH_BUFFER);
+     int fd = socket(AF_INET, SOCK_STREAM, 0);
+     struct sockaddr_in address = {0};
+     address.sin_family = AF_INET;
+     address.sin_port = htons(BENCH_PORT);
+     address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+     if (!buf || fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+         fprintf(stderr, "Benchmark client %d could not connect\n", client->id);
+         goto done;
+     }
+     int one = 1;
+     setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // Send each request at once
+     for (int i = 0; i < client->requests; i++) {
+         char request[256];
+         int len;
+         if ((i + 1) * bench.writes / 100 > i * bench.writes / 100)
+             len = snprintf(request, sizeof(request),
+                            "GET /addMeeting?name=Load+%d-%d&type=Sync&duration=30&frequency=weekly HTTP/1.1\r\n"
+                            "Host: localhost\r\nCookie: session=bench\r\n\r\n", client->id, i);
+         else
+             len = snprintf(request, sizeof(request),
+                            "GET %s HTTP/1.1\r\nHost: localhost\r\nCookie: session=bench\r\n\r\n", READS[i % 4]);
+         long long start = now_ns();
+         if (write(fd, request, len) != len || !bench_read_response(fd, buf)) {
+             fprintf(stderr, "Benchmark client %d lost its connection\n", client->id);
+             break;
+         }
+         client->latency[client->done++] = now_ns() - start;
+     }
+ done:
+     if (fd >= 0)
+         close(fd);
+     free(buf);
+     return NULL;
+ }
+ 
+ // For qsort: orders latencies from fastest to slowest
+ int compare_latency(const void *a, const void *b) {
+     long long x = *(const long long *)a, y = *(const long long *)b;
+     return (x > y) - (x < y);
+ }
+ 
+ // The HTTP part of --bench; false if it could not run
+ bool bench_http(void) {
+     int clients = bench.clients;
+     BenchClient *client = calloc(clients, sizeof(BenchClient));
+     long long *latency = malloc(sizeof(long long) * bench.requests);
+     if (!client || !latency) {
+         free(client);
+         free(latency);
+         return false;
+     }
+     TenantRegistry registry;
+     registry_init(&registry);
+     struct MHD_Daemon *daemon = start_server(BENCH_PORT, &registry);
+     if (!daemon) {
+         fprintf(stderr, "Failed to start the benchmark server on port %d\n", BENCH_PORT);
+         free(client);
+         free(latency);
+         return false;
+     }
+     // Each client gets its share of the requests and its part of the latency array
+     long long start = now_ns();
+     int given = 0;
+     for (int i = 0; i < clients; i++) {
+         client[i].id = i;
+         client[i].requests = bench.requests / clients + (i < bench.requests % clients);
+         client[i].latency = latency + given;
+         given += client[i].requests;
+         if (pthread_create(&client[i].thread, NULL, bench_client, &client[i]) != 0)
+             client[i].requests = -1; // Not started
+     }
+     int answered = 0;
+     for (int i = 0; i < clients; i++) {
+         if (client[i].requests < 0)
+             continue;
+         pthread_join(client[i].thread, NULL);
+         // Close the gaps left by clients that stopped early
+         memmove(latency + answered, client[i].latency, sizeof(long long) * client[i].done);
+         answered += client[i].done;
+     }
+     double seconds = (now_ns() - start) / 1e9;
+     stop_server(daemon, 0);
+     registry_close(&registry);
+     printf("HTTP (%d clients, %d%% writes)\n", clients, bench.writes);
+     if (answered > 0) {
+         qsort(latency, answered, sizeof(long long), compare_latency);
+         printf("  %d requests in %.2f s: %.0f requests/s, p50 %.1f us, p99 %.1f us\n", answered, seconds,
+                answered / seconds, latency[answered / 2] / 1e3, latency[(long long)answered * 99 / 100] / 1e3);
+     }
+     free(client);
+     free(latency);
+     return answered == bench.requests;
+ }
+ 
+ // Runs the parts of the benchmark asked for; returns the exit code
+ int run_benchmarks(void) {
+     printf("Calendar: %d weeks, %d days, %d slots of %d minutes\n",
+            calendar.weeks, calendar.days, calendar.slots, calendar.slot_minutes);
+     bool all = strcmp(bench.what, "all") == 0;
+     bool ok = true;
+     if (all || strcmp(bench.what, "scheduler") == 0)
+         ok = bench_scheduler() && ok;
+     if (all || strcmp(bench.what, "http") == 0)
+         ok = bench_http() && ok;
+     return ok ? 0 : 1;
+ }
+ 
+ // -------------------------
+ // MAIN PROGRAM
+ // -------------------------
+ 
+ // Reads "HH:MM-HH:MM" into start and end minutes; false if malformed
+ bool parse_time_range(const char *text, int *start, int *end) {
+     char first[8];
+     const char *dash = strchr(text, '-');
+     if (!dash || dash - text >= (int)sizeof(first))
+         return false;
+     memcpy(first, text, dash - text);
+     first[dash - text] = '\0';
+     *start = parse_clock_time(first);
+     *end = parse_clock_time(dash + 1);
+     return *start >= 0 && *end > *start;
+ }
+ 
+ // Reads the calendar options from the command line:
+ //     --weeks N  --days N  --slot-minutes N  --hours HH:MM-HH:MM  --break HH:MM-HH:MM
+ // --break may be given up to MAX_BREAKS times; the first one replaces the default lunch break.
+ // --data-dir DIR keeps the schedules in DIR (see PERSISTENCE), so they survive a restart
+ // (the calendar options must then stay the same between runs).
+ // --seed N makes placements repeatable: the same seed and requests give the same schedule.
+ // --bench WHAT and the --bench-... options measure instead of serving (see BENCHMARKS).
+ // --port, --server-mode, --threads and the connection options are in SERVER OPTIONS.
+ // Returns false (after printing why) if an option is unknown or malformed.
+ bool parse_options(int argc, char **argv) {
+     bool breaks_given = false;
+     for (int i = 1; i < argc; i++) {
+         const char *option = argv[i];
+         const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+         if (!value) {
+             fprintf(stderr, "Unknown option or missing value: %s\n", option);
+             return false;
+         }
+         i++; // Every option takes a value
+         if (strcmp(option, "--data-dir") == 0) {
+             data_dir = value;
+         } else if (strcmp(option, "--seed") == 0) {
+             random_seed = strtoull(value, NULL, 10);
+         } else if (strcmp(option, "--bench") == 0) {
+             bench.what = value;
+         } else if (strcmp(option, "--bench-meetings") == 0) {
+             bench.meetings = atoi(value);
+         } else if (strcmp(option, "--bench-mix") == 0) {
+             bench.mix = value;
+         } else if (strcmp(option, "--bench-requests") == 0) {
+             bench.requests = atoi(value);
+         } else if (strcmp(option, "--bench-clients") == 0) {
+             bench.clients = atoi(value);
+         } else if (strcmp(option, "--bench-writes") == 0) {
+             bench.writes = atoi(value);
+         } else if (strcmp(option, "--bench-attendees") == 0) {
+             bench.attendees = atoi(value);
+         } else if (strcmp(option, "--port") == 0) {
+             server.port = atoi(value);
+         } else if (strcmp(option, "--server-mode") == 0) {
+             server.mode = value;
+         } else if (strcmp(option, "--threads") == 0) {
+             server.threads = atoi(value);
+         } else if (strcmp(option, "--max-connections") == 0) {
+             server.max_connections = atoi(value);
+         } else if (strcmp(option, "--max-per-ip") == 0) {
+             server.max_per_ip = atoi(value);
+         } else if (strcmp(option, "--connection-timeout") == 0) {
+             server.connection_timeout = atoi(value);
+         } else if (strcmp(option, "--drain-seconds") == 0) {
+             server.drain_seconds = atoi(value);
+         } else if (strcmp(option, "--weeks") == 0) {
+             calendar.weeks = atoi(value);
+         } else if (strcmp(option, "--days") == 0) {
+             calendar.days = atoi(value);
+         } else if (strcmp(option, "--slot-minutes") == 0) {
+             calendar.slot_minutes = atoi(value);
+         } else if (strcmp(option, "--hours") == 0) {
+             if (!parse_time_range(value, &calendar.day_start, &calendar.day_end)) {
+                 fprintf(stderr, "Bad --hours value (use HH:MM-HH:MM): %s\n", value);
+                 return false;
+             }
+         } else if (strcmp(option, "--break") == 0) {
+             if (!breaks_given) {
+                 calendar.break_count = 0; // Replace the default lunch break
+                 breaks_given = true;
+             }
+             int b = calendar.break_count;
+             if (b == MAX_BREAKS || !parse_time_range(value, &calendar.break_start[b], &calendar.break_end[b])) {
+                 fprintf(stderr, "Bad --break value (use HH:MM-HH:MM, at most %d): %s\n", MAX_BREAKS, value);
+                 return false;
+             }
+             calendar.break_count++;
+         } else {
+             fprintf(stderr, "Unknown option: %s\n", option);
+             return false;
+         }
+     }
+     if (bench.what && strcmp(bench.what, "all") != 0 && strcmp(bench.what, "scheduler") != 0 &&
+         strcmp(bench.what, "http") != 0) {
+         fprintf(stderr, "Bad --bench value (use all, scheduler or http): %s\n", bench.what);
+         return false;
+     }
+     if (strcmp(bench.mix, "weekly") != 0 && strcmp(bench.mix, "mixed") != 0 && strcmp(bench.mix, "fixed") != 0) {
+         fprintf(stderr, "Bad --bench-mix value (use weekly, mixed or fixed): %s\n", bench.mix);
+         return false;
+     }
+     if (!server_mode_flag(server.mode)) {
+         fprintf(stderr, "Bad --server-mode value (use auto, epoll, poll or select): %s\n", server.mode);
+         return false;
+     }
+     if (server.port < 1 || server.port > 65535 || server.threads < 1 || server.max_connections < 1 ||
+         server.max_per_ip < 0 || server.connection_timeout < 0 || server.drain_seconds < 0) {
+         fprintf(stderr, "Bad server option value\n");
+         return false;
+     }
+     if (bench.meetings < 1 || bench.requests < 1 || bench.clients < 1 || bench.clients > bench.requests ||
+         bench.writes < 0 || bench.writes > 100 || bench.attendees < 0 || bench.attendees > MAX_ATTENDEES) {
+         fprintf(stderr, "Bad --bench-... value\n");
+         return false;
+     }
+     return true;
+ }
+ 
+ int main(int argc, char **argv) {
+     random_seed = (uint64_t)time(NULL); // Different placements each run, unless --seed says otherwise
+     if (!parse_options(argc, argv))
+         return 1;
+     const char *problem = init_calendar(); // Work out the time slots and which start times fit each duration
+     if (problem) {
+         fprintf(stderr, "Bad calendar: %s\n", problem);
+         return 1;
+     }
+     if (data_dir && mkdir(data_dir, 0755) != 0 && errno != EEXIST) {
+         fprintf(stderr, "Cannot create %s\n", data_dir);
+         return 1;
+     }
+     if (!init_static_pages()) { // Build the fixed pages once
+         fprintf(stderr, "Out of memory\n");
+         return 1;
+     }
+     if (bench.what)
+         return run_benchmarks(); // Measure instead of serving
+     TenantRegistry registry; // Schedules of all tenants, created when first used
+     registry_init(&registry);
  
-     // Start web server
-     struct MHD_Daemon *daemon;
-     daemon = MHD_start_daemon(MHD_USE_SELECT_INTERNALLY, PORT, NULL, NULL,
-                               &answer_to_connection, &scheduler, MHD_OPTION_END);
+     // Start web server (a pool of threads answers requests in parallel)
+     block_stop_signals(); // Before any thread starts
+     struct MHD_Daemon *daemon = start_server((uint16_t)server.port, &registry);
      if (NULL == daemon) {
          fprintf(stderr, "Failed to start web server\n");
          return 1; // Exit with error
      }
-     printf("Server running on http://localhost:%d\n", PORT);
-     getchar(); // Wait for Enter to stop
-     MHD_stop_daemon(daemon); // Shut down server
+     printf("Server running on http://localhost:%d (Ctrl+C to stop)\n", server.port);
+     fflush(stdout); // Also when stdout is a log file, not a terminal
+     wait_for_stop_signal();
+     printf("Stopping: finishing the requests in progress\n");
+     fflush(stdout);
+     stop_server(daemon, server.drain_seconds); // Shut down server
+     registry_close(&registry); // Saved schedules get a snapshot, so the next start is quick
      return 0; // Exit successfully
  }
\ No newline at end of file